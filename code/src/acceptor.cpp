@@ -1,15 +1,124 @@
 #include "acceptor.h"
+#include <errno.h>
 #include "eventhandler.h"
 #include "reactor.h"
+#include "logger.h"
 
 namespace followermaze
 {
 
-Acceptor::Acceptor(int port, Reactor &reactor, EventHandlerFactory &factory) :
-    m_connection(port),
+AcceptStats::AcceptStats(const char *name) :
+    m_name(name),
+    m_wakeups(0),
+    m_accepted(0),
+    m_limited(0),
+    m_errors(0),
+    m_overflows(0)
+{
+}
+
+void AcceptStats::countWakeup(unsigned long accepted, bool limited)
+{
+    __atomic_add_fetch(&m_wakeups, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&m_accepted, accepted, __ATOMIC_RELAXED);
+    if (limited)
+    {
+        __atomic_add_fetch(&m_limited, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void AcceptStats::countError()
+{
+    __atomic_add_fetch(&m_errors, 1, __ATOMIC_RELAXED);
+}
+
+void AcceptStats::countOverflows(unsigned long overflows)
+{
+    __atomic_add_fetch(&m_overflows, overflows, __ATOMIC_RELAXED);
+}
+
+unsigned long AcceptStats::getWakeups() const
+{
+    return __atomic_load_n(&m_wakeups, __ATOMIC_RELAXED);
+}
+
+unsigned long AcceptStats::getAccepted() const
+{
+    return __atomic_load_n(&m_accepted, __ATOMIC_RELAXED);
+}
+
+unsigned long AcceptStats::getLimited() const
+{
+    return __atomic_load_n(&m_limited, __ATOMIC_RELAXED);
+}
+
+unsigned long AcceptStats::getErrors() const
+{
+    return __atomic_load_n(&m_errors, __ATOMIC_RELAXED);
+}
+
+unsigned long AcceptStats::getOverflows() const
+{
+    return __atomic_load_n(&m_overflows, __ATOMIC_RELAXED);
+}
+
+void AcceptStats::format(ostream &out) const
+{
+    out << "accept " << m_name
+        << " wakeups=" << getWakeups()
+        << " accepted=" << getAccepted()
+        << " limited=" << getLimited()
+        << " errors=" << getErrors()
+        << " overflows=" << getOverflows() << "\n";
+}
+
+Acceptor::Acceptor(int port, Reactor &reactor, EventHandlerFactory &factory, int backlog, bool reusePort) :
+    m_connection(port, true, backlog, reusePort),
+    m_reactor(reactor),
+    m_factory(factory),
+    m_clientEvent(Reactor::EvntRead),
+    m_acceptLimit(DEFAULT_ACCEPT_LIMIT),
+    m_stats(NULL),
+    m_dropCount(0),
+    m_failing(false),
+    m_retryDelay(MIN_RETRY_DELAY),
+    m_event(Reactor::EvntAccept)
+{
+}
+
+Acceptor::Acceptor(const SocketAddress &address, Reactor &reactor, EventHandlerFactory &factory, int backlog, bool reusePort) :
+    m_connection(address, true, backlog, reusePort),
     m_reactor(reactor),
-    m_factory(factory)
+    m_factory(factory),
+    m_clientEvent(Reactor::EvntRead),
+    m_acceptLimit(DEFAULT_ACCEPT_LIMIT),
+    m_stats(NULL),
+    m_dropCount(0),
+    m_failing(false),
+    m_retryDelay(MIN_RETRY_DELAY),
+    m_event(Reactor::EvntAccept)
+{
+}
+
+void Acceptor::setClientEvent(Reactor::EventType event)
+{
+    m_clientEvent = event;
+}
+
+void Acceptor::setSocketProfile(const SocketProfile &profile)
+{
+    m_connection.setProfile(profile);
+}
+
+void Acceptor::setAcceptLimit(int limit)
 {
+    m_acceptLimit = limit > 0 ? limit : 1;
+}
+
+void Acceptor::setStats(AcceptStats *stats)
+{
+    m_stats = stats;
+    m_dropCount = m_connection.getDropCount();
 }
 
 Handle Acceptor::getHandle()
@@ -17,15 +126,89 @@ Handle Acceptor::getHandle()
     return m_connection.getHandle();
 }
 
-void Acceptor::handleInput(int /*hint*/)
+const char *Acceptor::getCategory() const
 {
-    auto_ptr<Connection> clientConn(m_connection.accept(true));
-    auto_ptr<EventHandler> client(m_factory.createEventHandler(clientConn, m_reactor));
-    m_reactor.addHandler(client, Reactor::EvntRead);
+    return "Acceptor";
+}
+
+void Acceptor::handleInput(int hint)
+{
+    int accepted = 0;
+    try
+    {
+        while (accepted < m_acceptLimit)
+        {
+            auto_ptr<Connection> clientConn(m_connection.acceptPending(true));
+            if (clientConn.get() == NULL)
+            {
+                break;
+            }
+
+            auto_ptr<EventHandler> client(m_factory.createEventHandler(clientConn, m_reactor));
+            m_reactor.addHandler(client, m_clientEvent);
+            ++accepted;
+        }
+
+        m_failing = false;
+        m_retryDelay = MIN_RETRY_DELAY;
+    }
+    catch (Connection::Exception &e)
+    {
+        // Keep the accepted ones and retry. Complain once per run of
+        // failures.
+        if (!m_failing)
+        {
+            Logger::getInstance().error("Failed to accept client, errno: ", e.getErr());
+            m_failing = true;
+        }
+
+        int err = e.getErr();
+        if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM)
+        {
+            // Retrying in the next round would spin until a descriptor or
+            // memory is freed.
+            backOff(hint);
+        }
+
+        if (m_stats != NULL)
+        {
+            m_stats->countError();
+        }
+    }
+
+    if (m_stats != NULL)
+    {
+        m_stats->countWakeup(accepted, accepted == m_acceptLimit);
+
+        long dropCount = m_connection.getDropCount();
+        if (dropCount > m_dropCount)
+        {
+            m_stats->countOverflows(dropCount - m_dropCount);
+        }
+        m_dropCount = dropCount;
+    }
+}
+
+void Acceptor::handleTimeout(int hint)
+{
+    m_reactor.resetHandler(hint, m_event);
 }
 
 Acceptor::~Acceptor()
 {
 }
 
+void Acceptor::backOff(int hint)
+{
+    m_event = m_reactor.getEvent(hint);
+    m_reactor.resetHandler(hint, 0);
+    m_reactor.scheduleTimeout(hint, m_retryDelay);
+
+    m_retryDelay *= 2;
+    if (m_retryDelay > MAX_RETRY_DELAY)
+    {
+        m_retryDelay = MAX_RETRY_DELAY;
+    }
+}
+
 } // namespace followermaze
@@ -4,36 +4,128 @@
 #ifndef ACCEPTOR_H
 #define ACCEPTOR_H
 
+#include <ostream>
 #include "eventhandler.h"
 #include "connection.h"
+#include "reactor.h"
 
 namespace followermaze
 {
 
-class Reactor;
+/*
+ * AcceptStats counts the work of the Acceptors listening on the same port
+ * (e.g. one per Reactor): wakeups, accepted clients, wakeups which hit the
+ * accept limit, accept errors, and connection requests dropped by the OS
+ * because the queue of pending requests was full (overflows).
+ * Counting is thread safe.
+ */
+class AcceptStats
+{
+public:
+    // name tells whom the clients are (e.g. "users").
+    AcceptStats(const char *name);
+
+    // Counting.
+    void countWakeup(unsigned long accepted, bool limited);
+    void countError();
+    void countOverflows(unsigned long overflows);
+
+    // Getters.
+    unsigned long getWakeups() const;
+    unsigned long getAccepted() const;
+    unsigned long getLimited() const;
+    unsigned long getErrors() const;
+    unsigned long getOverflows() const;
+
+    // Writes the counters in one line ("accept <name> ...").
+    void format(ostream &out) const;
+
+protected:
+    const char *m_name;
+
+    // Updated atomically.
+    unsigned long m_wakeups;
+    unsigned long m_accepted;
+    unsigned long m_limited;
+    unsigned long m_errors;
+    unsigned long m_overflows;
+
+private:
+    // Make non-copyable.
+    AcceptStats(const AcceptStats&);
+    AcceptStats& operator=(const AcceptStats&);
+};
 
 /*
  * Acceptor is an event handler which accepts connection requests, creates
  * clients (using an EventHandlerFactory), and registers them to the Reactor.
+ * The listening connection is non-blocking and every wakeup accepts the
+ * queueing clients until there are no more or the accept limit is reached
+ * (the rest is accepted in the next rounds) so a burst of reconnecting
+ * clients doesn't overflow the queue while other handlers wait.
+ * If the process runs out of descriptors or memory the pending requests
+ * keep the listening connection ready, so Acceptor stops watching it and
+ * retries after a timeout which doubles with every failed retry.
  */
 class Acceptor : public EventHandler
 {
+public:
+    // Default max amount of clients accepted per wakeup.
+    static const int DEFAULT_ACCEPT_LIMIT = 256;
+
+    // Bounds of the delay (in milliseconds) of retrying to accept when out
+    // of descriptors or memory.
+    static const long MIN_RETRY_DELAY = 10;
+    static const long MAX_RETRY_DELAY = 1000;
+
 public:
     // Create server connection and listen for clients.
-    Acceptor(int port, Reactor &reactor, EventHandlerFactory &factory);
+    // backlog limits the queue of clients waiting to be accepted.
+    // If reusePort other Acceptors (e.g. owned by other Reactors) can listen
+    // on the same port.
+    Acceptor(int port, Reactor &reactor, EventHandlerFactory &factory,
+             int backlog = Connection::DEFAULT_BACKLOG, bool reusePort = false);
+    // Same as above, but listens on the address (see SocketAddress).
+    Acceptor(const SocketAddress &address, Reactor &reactor, EventHandlerFactory &factory,
+             int backlog = Connection::DEFAULT_BACKLOG, bool reusePort = false);
+
+    // Sets the event the clients are registered for (default EvntRead).
+    void setClientEvent(Reactor::EventType event);
+
+    // Sets the socket options of the accepted connections.
+    // Will throw on error.
+    void setSocketProfile(const SocketProfile &profile);
+
+    // Sets the max amount of clients accepted per wakeup (positive).
+    void setAcceptLimit(int limit);
+
+    // Sets AcceptStats to count to (none by default). Must outlive this.
+    void setStats(AcceptStats *stats);
 
     // Implementation of EventHandler interface.
     virtual Handle getHandle();
+    virtual const char *getCategory() const;
     virtual void handleInput(int hint);
+    virtual void handleTimeout(int hint);
 
 protected:
     // Ensure dynamic allocation.
     virtual ~Acceptor();
 
+    // Stops watching for connection requests until the retry delay passes.
+    void backOff(int hint);
+
 protected:
     Connection m_connection;
     Reactor &m_reactor;
     EventHandlerFactory &m_factory;
+    Reactor::EventType m_clientEvent;
+    int m_acceptLimit;
+    AcceptStats *m_stats;
+    long m_dropCount;  // Requests dropped by the OS as of the last wakeup.
+    bool m_failing;    // The last wakeup has failed to accept.
+    long m_retryDelay; // Delay of the next back off.
+    Reactor::EventType m_event; // Event to watch again after backing off.
 };
 
 } // namespace followermaze
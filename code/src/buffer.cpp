@@ -0,0 +1,105 @@
+#include <cstring>
+#include <assert.h>
+#include "buffer.h"
+
+namespace followermaze
+{
+
+Buffer::Buffer(size_t capacity) :
+    m_storage(capacity),
+    m_begin(0),
+    m_end(0)
+{
+}
+
+const char *Buffer::data() const
+{
+    return m_storage.empty() ? NULL : &m_storage[m_begin];
+}
+
+size_t Buffer::size() const
+{
+    return m_end - m_begin;
+}
+
+bool Buffer::empty() const
+{
+    return m_begin == m_end;
+}
+
+size_t Buffer::capacity() const
+{
+    return m_storage.size();
+}
+
+size_t Buffer::available() const
+{
+    return m_storage.size() - size();
+}
+
+char *Buffer::prepare(size_t length)
+{
+    if (m_storage.size() - m_end < length)
+    {
+        size_t used = size();
+
+        if (m_begin > 0)
+        {
+            // Reclaim the space of the consumed data.
+            memmove(&m_storage[0], &m_storage[m_begin], used);
+            m_begin = 0;
+            m_end = used;
+        }
+
+        if (m_storage.size() - m_end < length)
+        {
+            size_t capacity = m_storage.size() * 2;
+            m_storage.resize(capacity > used + length ? capacity : used + length);
+        }
+    }
+
+    return m_storage.empty() ? NULL : &m_storage[m_end];
+}
+
+void Buffer::commit(size_t length)
+{
+    assert(m_end + length <= m_storage.size());
+    m_end += length;
+}
+
+void Buffer::append(const char *data, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    memcpy(prepare(length), data, length);
+    commit(length);
+}
+
+void Buffer::consume(size_t length)
+{
+    assert(length <= size());
+    m_begin += length;
+
+    if (m_begin == m_end)
+    {
+        // Nothing left to move.
+        clear();
+    }
+}
+
+void Buffer::clear()
+{
+    m_begin = 0;
+    m_end = 0;
+}
+
+void Buffer::release()
+{
+    vector< char >().swap(m_storage);
+    clear();
+}
+
+} // namespace followermaze
@@ -0,0 +1,67 @@
+/* This file declears Buffer class.
+ */
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* Buffer is a growable byte buffer with a read and a write position.
+ * Data is written straight into the free space at the back (e.g. by recv, see
+ * prepare and commit) and consumed from the front, so parsers can work on the
+ * data in place. Consuming only moves the read position. The unconsumed
+ * data (normally an incomplete message) is moved to the front only when the
+ * free space at the back runs out, and the storage grows only if that is
+ * still not enough.
+ * Buffer is not thread safe.
+ */
+class Buffer
+{
+public:
+    Buffer(size_t capacity = 0);
+
+    // Returns the unconsumed data (size bytes). Invalidated by prepare.
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+
+    // Returns the amount of bytes which can be held without moving the data
+    // or growing.
+    size_t capacity() const;
+
+    // Returns the amount of bytes which can be prepared without growing.
+    size_t available() const;
+
+    // Returns free space for at least length bytes at the back. The data
+    // written there becomes a part of the buffer by commit.
+    char *prepare(size_t length);
+
+    // Appends length bytes written into the space returned by prepare.
+    void commit(size_t length);
+
+    // Appends a copy of length bytes of data.
+    void append(const char *data, size_t length);
+
+    // Drops length bytes from the front.
+    void consume(size_t length);
+
+    // Drops all the data.
+    void clear();
+
+    // Drops all the data and frees the storage.
+    void release();
+
+protected:
+    vector< char > m_storage;
+    size_t m_begin; // Read position.
+    size_t m_end;   // Write position.
+};
+
+} // namespace followermaze
+
+#endif // BUFFER_H
@@ -1,4 +1,7 @@
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sstream>
 #include "client.h"
 #include "reactor.h"
 #include "logger.h"
@@ -6,15 +9,118 @@
 namespace followermaze
 {
 
+const size_t Client::DEFAULT_READ_BUDGET;
+const size_t Client::DEFAULT_HIGH_WATERMARK;
+const size_t Client::DEFAULT_LOW_WATERMARK;
+
+Pool Client::AsyncSend::m_pool("async_sends", sizeof(Client::AsyncSend));
+
+Client::AsyncSend::AsyncSend() :
+    m_count(0),
+    m_length(0),
+    m_discarded(false)
+{
+    memset(&m_message, 0, sizeof(m_message));
+}
+
+Client::AsyncSend::~AsyncSend()
+{
+    for (int i = 0; i < m_count; ++i)
+    {
+        m_held[i]->release();
+    }
+}
+
+void *Client::AsyncSend::operator new(size_t size)
+{
+    return m_pool.allocate(size);
+}
+
+void Client::AsyncSend::operator delete(void *block, size_t size)
+{
+    m_pool.deallocate(block, size);
+}
+
+/*----------------------------------------------------------------------------*/
+
 Client::~Client()
 {
+    clearOutput();
+
+    // The Reactor is done with the send (see Demultiplexer::remove).
+    delete m_send;
+
+    // Not lingering (see linger) only if never disposed of by the Reactor
+    // (e.g. at shutdown).
+    for (HeldMessages::iterator it = m_zeroCopyHeld.begin(); it != m_zeroCopyHeld.end(); ++it)
+    {
+        it->second->release();
+    }
+
+    if (m_backpressured && m_budget != NULL)
+    {
+        m_budget->countStalled(false);
+    }
 }
 
 Client::Client(auto_ptr<Connection> connection, Reactor &reactor) :
     m_connection(connection),
-    m_reactor(reactor)
+    m_reactor(reactor),
+    m_readBudget(DEFAULT_READ_BUDGET),
+    m_inputPending(false),
+    m_lowWatermark(DEFAULT_LOW_WATERMARK),
+    m_highWatermark(DEFAULT_HIGH_WATERMARK),
+    m_backpressured(false),
+    m_budget(NULL),
+    m_paused(false),
+    m_overflowed(false),
+    m_asyncOutput(reactor.canSend()),
+    m_send(NULL),
+    m_asyncInput(false),
+    m_receiving(false),
+    m_receivedPending(false),
+    m_received(NULL),
+    m_receivedResult(0)
 {
     assert(m_connection.get() != NULL);
+
+    // Sends without copying are done by the Connection.
+    if (m_connection->getProfile().m_zeroCopy > 0)
+    {
+        m_asyncOutput = false;
+    }
+}
+
+void Client::setReadBudget(size_t budget)
+{
+    m_readBudget = budget > 0 ? budget : DEFAULT_READ_BUDGET;
+}
+
+void Client::setWatermarks(size_t low, size_t high)
+{
+    m_highWatermark = high;
+    m_lowWatermark = low < high ? low : high;
+}
+
+void Client::setOutputBudget(OutputBudget *budget)
+{
+    assert(m_output.empty());
+    m_budget = budget;
+}
+
+void Client::setAsyncInput(bool async)
+{
+    m_asyncInput = async;
+}
+
+bool Client::isBackpressured() const
+{
+    return m_backpressured;
+}
+
+size_t Client::getPendingOutput() const
+{
+    return m_output.size();
 }
 
 Handle Client::getHandle()
@@ -22,11 +128,35 @@ Handle Client::getHandle()
     return m_connection->getHandle();
 }
 
+const char *Client::getCategory() const
+{
+    return "Client";
+}
+
 void Client::handleInput(int hint)
 {
     try
     {
         doHandleInput(hint);
+
+        if (m_connection->isPeerClosed())
+        {
+            // The data received before the client closed the connection has
+            // been handled.
+            handleClose(hint);
+            return;
+        }
+
+        if (m_asyncInput && !m_receiving && receiveAsync(hint))
+        {
+            // The rest of the input (if any) is received by the Reactor.
+            m_inputPending = false;
+        }
+        else if (m_inputPending)
+        {
+            m_inputPending = false;
+            m_reactor.resumeHandler(hint);
+        }
     }
     catch (Connection::Exception e)
     {
@@ -62,6 +192,41 @@ void Client::handleOutput(int hint)
     }
 }
 
+void Client::handleSent(int hint, int result)
+{
+    // The Messages are released when done.
+    auto_ptr<AsyncSend> send(m_send);
+    m_send = NULL;
+
+    try
+    {
+        doHandleSent(hint, result, send->m_discarded);
+    }
+    catch (Connection::Exception e)
+    {
+        if (e.getErr() == Connection::Exception::ErrClientDisconnect)
+        {
+            handleClose(hint);
+        }
+        else
+        {
+            handleError(hint);
+            throw e;
+        }
+    }
+}
+
+void Client::handleReceived(int hint, const char *data, int result)
+{
+    // Handed out by receive.
+    m_receiving = false;
+    m_receivedPending = true;
+    m_received = data;
+    m_receivedResult = result;
+
+    handleInput(hint);
+}
+
 void Client::handleClose(int hint)
 {
     dispose(hint);
@@ -69,26 +234,387 @@ void Client::handleClose(int hint)
 
 void Client::handleError(int hint)
 {
-    dispose(hint);
+    if (!handleCompletions())
+    {
+        dispose(hint);
+    }
 }
 
 void Client::doHandleInput(int /*hint*/)
 {
 }
 
-void Client::doHandleOutput(int /*hint*/)
+void Client::doHandleOutput(int hint)
+{
+    if (m_overflowed)
+    {
+        // Disconnected by the output budget policy.
+        handleClose(hint);
+        return;
+    }
+
+    if (!m_output.empty() && sendAsync(hint))
+    {
+        // Continued when done (see handleSent).
+        return;
+    }
+
+    bool drained = flushOutput();
+
+    handleCatchUp(hint);
+
+    // Keep the rest of the event (e.g. EvntEdge). Deferred output (see
+    // queueOutput) may not be waiting for EvntWrite yet.
+    Reactor::EventType event = m_reactor.getEvent(hint);
+    m_reactor.resetHandler(hint, drained ? event & ~Reactor::EvntWrite : event | Reactor::EvntWrite);
+}
+
+void Client::queueOutput(int hint, Message *message)
+{
+    if (m_overflowed)
+    {
+        return;
+    }
+
+    if (m_paused)
+    {
+        if (m_output.size() > m_lowWatermark)
+        {
+            m_budget->countDropped(1);
+            return;
+        }
+
+        // The peer has caught up (or the Client has been paused because of
+        // the total limit).
+        m_paused = false;
+        setBackpressured(hint, false);
+    }
+
+    if (m_budget != NULL && !m_budget->fits(m_output.size(), message->size()))
+    {
+        m_budget->countOverflow();
+        if (!handleOverflow(hint, message->size()))
+        {
+            return;
+        }
+    }
+
+    bool idle = m_output.empty();
+    m_output.push(message);
+    if (m_budget != NULL)
+    {
+        m_budget->acquire(message->size());
+    }
+
+    if (idle && !m_output.empty())
+    {
+        if (m_asyncOutput)
+        {
+            // Handed to the Reactor along with the rest of the output of
+            // this round.
+            m_reactor.deferOutput(hint);
+        }
+        else
+        {
+            m_reactor.resetHandler(hint, m_reactor.getEvent(hint) | Reactor::EvntWrite);
+        }
+    }
+
+    if (m_output.size() > m_highWatermark)
+    {
+        setBackpressured(hint, true);
+    }
+}
+
+bool Client::flushOutput()
+{
+    // Gather as many messages as possible into one system call. Stop when
+    // the transport layer doesn't take everything.
+    struct iovec iov[Connection::MAX_GATHER];
+    while (!m_output.empty())
+    {
+        int count = m_output.gather(iov, Connection::MAX_GATHER);
+        size_t gathered = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            gathered += iov[i].iov_len;
+        }
+
+        // Let the transport layer know if the batch doesn't end here.
+        unsigned int zeroCopySends = m_connection->getZeroCopySends();
+        size_t sent = m_connection->send(iov, count, gathered < m_output.size());
+        if (m_connection->getZeroCopySends() != zeroCopySends)
+        {
+            // Keep the data until the send is completed.
+            vector< Message* > held;
+            m_output.retain(sent, held);
+            for (size_t i = 0; i < held.size(); ++i)
+            {
+                m_zeroCopyHeld.push_back(make_pair(zeroCopySends, held[i]));
+            }
+        }
+        m_output.consume(sent);
+        if (m_budget != NULL)
+        {
+            m_budget->release(sent);
+        }
+
+        if (sent < gathered)
+        {
+            break;
+        }
+    }
+
+    return m_output.empty();
+}
+
+bool Client::sendAsync(int hint)
+{
+    if (m_send != NULL)
+    {
+        // Continued when done.
+        return true;
+    }
+
+    if (!m_asyncOutput)
+    {
+        return false;
+    }
+
+    auto_ptr<AsyncSend> send(new AsyncSend);
+    send->m_count = m_output.gather(send->m_iov, Connection::MAX_GATHER, send->m_held);
+    for (int i = 0; i < send->m_count; ++i)
+    {
+        send->m_length += send->m_iov[i].iov_len;
+    }
+
+    send->m_message.msg_iov = send->m_iov;
+    send->m_message.msg_iovlen = send->m_count;
+
+    m_reactor.send(hint, &send->m_message);
+    m_send = send.release();
+    return true;
+}
+
+void Client::doHandleSent(int hint, int result, bool discarded)
+{
+    if (result < 0)
+    {
+        throw Connection::Exception(result == -EPIPE ? static_cast<int>(Connection::Exception::ErrClientDisconnect) : -result);
+    }
+
+    if (!discarded)
+    {
+        m_output.consume(result);
+        if (m_budget != NULL)
+        {
+            m_budget->release(result);
+        }
+    }
+
+    handleCatchUp(hint);
+
+    if (!m_output.empty())
+    {
+        m_reactor.deferOutput(hint);
+    }
+}
+
+bool Client::receiveAsync(int hint)
+{
+    Reactor::EventType event = m_reactor.getEvent(hint);
+
+    if (!m_reactor.receive(hint))
+    {
+        // Not supported by the backend (or out of buffers for now).
+        if (!(event & Reactor::EvntRead))
+        {
+            m_reactor.resetHandler(hint, event | Reactor::EvntRead);
+        }
+        return false;
+    }
+
+    m_receiving = true;
+
+    // Not called back for input meanwhile.
+    m_reactor.resetHandler(hint, event & ~Reactor::EvntRead);
+    return true;
+}
+
+bool Client::handleCompletions()
 {
+    if (m_zeroCopyHeld.empty())
+    {
+        return false;
+    }
+
+    unsigned int completed = m_connection->reapZeroCopy();
+    while (!m_zeroCopyHeld.empty() && static_cast<int>(completed - m_zeroCopyHeld.front().first) > 0)
+    {
+        m_zeroCopyHeld.front().second->release();
+        m_zeroCopyHeld.pop_front();
+    }
+
+    return m_connection->getPendingError() == 0;
+}
+
+void Client::clearOutput()
+{
+    if (m_budget != NULL)
+    {
+        m_budget->release(m_output.size());
+    }
+
+    if (m_send != NULL)
+    {
+        // The data is held until the send is done, but not consumed then.
+        m_send->m_discarded = true;
+    }
+
+    m_output.clear();
+}
+
+bool Client::handleOverflow(int hint, size_t length)
+{
+    switch (m_budget->getPolicy())
+    {
+    case OutputBudget::PolicyDropOldest:
+    {
+        size_t count = 0;
+        // Data being sent by the Reactor has started to be sent.
+        size_t busy = (m_send != NULL && !m_send->m_discarded) ? m_send->m_length : 0;
+        size_t dropped = m_output.dropOldest(length, count, busy);
+        m_budget->release(dropped);
+        m_budget->countDropped(count);
+
+        if (m_budget->fits(m_output.size(), length))
+        {
+            return true;
+        }
+
+        // Doesn't fit anyway.
+        m_budget->countDropped(1);
+        return false;
+    }
+
+    case OutputBudget::PolicyPause:
+        Logger::getInstance().info("Client paused (output budget exceeded).");
+        m_paused = true;
+        setBackpressured(hint, true);
+        m_budget->countDropped(1);
+        return false;
+
+    case OutputBudget::PolicyDisconnect:
+    default:
+        Logger::getInstance().info("Client disconnected (output budget exceeded).");
+        m_overflowed = true;
+        m_budget->countDisconnected();
+        clearOutput();
+
+        // Closed when called back for writing (not while the caller may be
+        // iterating over the clients).
+        m_reactor.resetHandler(hint, m_reactor.getEvent(hint) | Reactor::EvntWrite);
+        return false;
+    }
+}
+
+void Client::setBackpressured(int hint, bool backpressured)
+{
+    if (m_backpressured == backpressured)
+    {
+        return;
+    }
+
+    m_backpressured = backpressured;
+    if (m_budget != NULL)
+    {
+        m_budget->countStalled(backpressured);
+    }
+
+    handleBackpressure(hint);
+}
+
+void Client::handleCatchUp(int hint)
+{
+    if (m_output.size() <= m_lowWatermark)
+    {
+        // The peer has caught up.
+        m_paused = false;
+        setBackpressured(hint, false);
+    }
+}
+
+void Client::handleBackpressure(int /*hint*/)
+{
+}
+
+size_t Client::receive(Buffer &buffer)
+{
+    return receive(buffer, m_readBudget);
+}
+
+size_t Client::receive(Buffer &buffer, size_t budget)
+{
+    if (m_receivedPending)
+    {
+        // Received by the Reactor. Thrown like Connection::receive.
+        m_receivedPending = false;
+        m_inputPending = false;
+        if (m_receivedResult <= 0)
+        {
+            throw Connection::Exception(m_receivedResult == 0 ? static_cast<int>(Connection::Exception::ErrClientDisconnect) : -m_receivedResult);
+        }
+
+        buffer.append(m_received, m_receivedResult);
+        return m_receivedResult;
+    }
+
+    if (m_receiving)
+    {
+        // Being received by the Reactor.
+        return 0;
+    }
+
+    size_t received = m_connection->receive(buffer, budget);
+    m_inputPending = (received >= budget);
+    return received;
 }
 
 void Client::dispose(int hint)
 {
     EventHandler* self = m_reactor.detouchHandler(hint);
     assert(self == (EventHandler*)this);
+    linger();
     delete self;
 }
 
+void Client::linger()
+{
+    // An error other than the completions means the transport layer has
+    // dropped the data.
+    if (!handleCompletions() || m_zeroCopyHeld.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        m_connection->shutdownOutput();
+        auto_ptr<EventHandler> lingering(new ZeroCopyLinger(m_connection, m_reactor, m_zeroCopyHeld));
+        int hint = m_reactor.addHandler(lingering, 0);
+        m_reactor.scheduleTimeout(hint, ZeroCopyLinger::TIMEOUT);
+    }
+    catch (BaseException &e)
+    {
+        Logger::getInstance().error("Failed to linger for zero-copy sends. Error: ", e.what(), e.getErr());
+    }
+}
+
 Admin::Admin(auto_ptr<Connection> connection, Reactor &reactor) :
-    Client(connection, reactor)
+    Client(connection, reactor),
+    m_reactors(NULL),
+    m_reportedBudget(NULL),
+    m_reportedAccepts(NULL)
 {
     Logger::getInstance().info("Admin connected.");
 }
@@ -98,7 +624,27 @@ Admin::~Admin()
     Logger::getInstance().info("Admin disconnected.");
 }
 
-void Admin::doHandleInput(int /*hint*/)
+void Admin::setReactors(const vector< Reactor* > *reactors)
+{
+    m_reactors = reactors;
+}
+
+void Admin::setReportedBudget(const OutputBudget *budget)
+{
+    m_reportedBudget = budget;
+}
+
+void Admin::setReportedAccepts(const AcceptStats *accepts)
+{
+    m_reportedAccepts = accepts;
+}
+
+const char *Admin::getCategory() const
+{
+    return "Admin";
+}
+
+void Admin::doHandleInput(int hint)
 {
     string command(m_connection->receive());
 
@@ -107,6 +653,150 @@ void Admin::doHandleInput(int /*hint*/)
         Logger::getInstance().info("Got stop command.");
         throw Reactor::Exception(Reactor::Exception::ErrStop);
     }
+
+    if (command.compare(0, 5, "stats") == 0)
+    {
+        ostringstream out;
+        if (m_reactors == NULL)
+        {
+            out << "reactor 0 " << Reactor::getBackendName(m_reactor.getBackend()) << "\n";
+            m_reactor.getStats().format(out);
+        }
+        else
+        {
+            for (size_t i = 0; i < m_reactors->size(); ++i)
+            {
+                const Reactor *reactor = (*m_reactors)[i];
+                out << "reactor " << i << " " << Reactor::getBackendName(reactor->getBackend()) << "\n";
+                reactor->getStats().format(out);
+            }
+        }
+
+        if (m_reportedBudget != NULL)
+        {
+            m_reportedBudget->format(out);
+        }
+
+        if (m_reportedAccepts != NULL)
+        {
+            m_reportedAccepts->format(out);
+        }
+
+        Pool::formatAll(out);
+        out << "pool messages reused=" << Message::getReuses() << "\n";
+
+        string data(out.str());
+        Message *message = new Message(data);
+        queueOutput(hint, message);
+        message->release();
+    }
+}
+
+AdminFactory::AdminFactory() :
+    m_reactors(NULL),
+    m_reportedBudget(NULL),
+    m_reportedAccepts(NULL)
+{
+}
+
+void AdminFactory::setReactors(const vector< Reactor* > *reactors)
+{
+    m_reactors = reactors;
+}
+
+void AdminFactory::setReportedBudget(const OutputBudget *budget)
+{
+    m_reportedBudget = budget;
+}
+
+void AdminFactory::setReportedAccepts(const AcceptStats *accepts)
+{
+    m_reportedAccepts = accepts;
+}
+
+EventHandler *AdminFactory::createEventHandler(auto_ptr<Connection> connection, Reactor &reactor)
+{
+    Admin *admin = new Admin(connection, reactor);
+    admin->setReactors(m_reactors);
+    admin->setReportedBudget(m_reportedBudget);
+    admin->setReportedAccepts(m_reportedAccepts);
+    return admin;
+}
+
+/*----------------------------------------------------------------------------*/
+
+const long ZeroCopyLinger::TIMEOUT;
+
+ZeroCopyLinger::ZeroCopyLinger(auto_ptr<Connection> connection, Reactor &reactor, Client::HeldMessages &held) :
+    m_connection(connection),
+    m_reactor(reactor)
+{
+    m_held.swap(held);
+}
+
+ZeroCopyLinger::~ZeroCopyLinger()
+{
+    // Done with the data only once the connection is closed.
+    m_connection.reset();
+    for (Client::HeldMessages::iterator it = m_held.begin(); it != m_held.end(); ++it)
+    {
+        it->second->release();
+    }
+}
+
+Handle ZeroCopyLinger::getHandle()
+{
+    return m_connection->getHandle();
+}
+
+const char *ZeroCopyLinger::getCategory() const
+{
+    return "ZeroCopyLinger";
+}
+
+void ZeroCopyLinger::handleError(int hint)
+{
+    if (reap() || m_connection->getPendingError() != 0)
+    {
+        dispose(hint);
+    }
+}
+
+void ZeroCopyLinger::handleClose(int hint)
+{
+    // Nothing is going to be sent anymore.
+    reap();
+    dispose(hint);
+}
+
+void ZeroCopyLinger::handleTimeout(int hint)
+{
+    if (!reap())
+    {
+        Logger::getInstance().info("Zero-copy sends not completed, resetting the connection.");
+        m_connection->setResetOnClose();
+    }
+
+    dispose(hint);
+}
+
+bool ZeroCopyLinger::reap()
+{
+    unsigned int completed = m_connection->reapZeroCopy();
+    while (!m_held.empty() && static_cast<int>(completed - m_held.front().first) > 0)
+    {
+        m_held.front().second->release();
+        m_held.pop_front();
+    }
+
+    return m_held.empty();
+}
+
+void ZeroCopyLinger::dispose(int hint)
+{
+    EventHandler* self = m_reactor.detouchHandler(hint);
+    assert(self == (EventHandler*)this);
+    delete self;
 }
 
 } // namespace followermaze
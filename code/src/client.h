@@ -6,8 +6,14 @@
 #define CLIENT_H
 
 #include <memory>
+#include <vector>
+#include <deque>
+#include <utility>
 #include "eventhandler.h"
 #include "connection.h"
+#include "message.h"
+#include "outputbudget.h"
+#include "acceptor.h"
 
 namespace followermaze
 {
@@ -20,27 +26,136 @@ class Reactor;
  * Client encapsulates a Connection and uses Reactor to handle events.
  * Client instances normally are created by Acceptor, owned by Reactor and
  * disposed of in call back functions while hadling client disconnect or error.
+ * Input is received until there is no more data waiting or the read budget
+ * is exhausted. In the latter case the Client asks the Reactor to call it
+ * back again in the next round so other clients get their turn (this makes
+ * Client suitable for edge-triggered handling, see Reactor::EvntEdge).
+ * Output is queued (see MessageQueue) and sent when the connection is ready
+ * for writing. Partially sent data stays in the queue and the Client stays
+ * interested in writing until the queue is drained. A Client whose queue
+ * grows above the high watermark is backpressured (the peer doesn't read fast
+ * enough) until the queue drains below the low watermark. The memory used
+ * by the queue can be bounded by an OutputBudget.
+ * If the Reactor's backend can send (io_uring) the output is handed to it
+ * right away instead (see Reactor::send) and goes to the kernel with the
+ * next wait, along with the output of the other clients. The next part of
+ * the queue is handed over when the send is done. A Client can also ask to
+ * have its input received by the Reactor (see setAsyncInput).
  */
 class Client : public EventHandler
 {
+public:
+    // Default max amount of bytes received per call back.
+    static const size_t DEFAULT_READ_BUDGET = 256 * 1024;
+
+    // Default watermarks of the output queue.
+    static const size_t DEFAULT_HIGH_WATERMARK = 1024 * 1024;
+    static const size_t DEFAULT_LOW_WATERMARK = 256 * 1024;
+
+    // Messages sent without copying by id of the send (until completed).
+    typedef deque< pair< unsigned int, Message* > > HeldMessages;
+
 public:
     // Creates an client. Takes ownership over connection.
     Client(auto_ptr<Connection> connection, Reactor &reactor);
 
+    // Sets max amount of bytes received per call back.
+    void setReadBudget(size_t budget);
+
+    // Sets the watermarks of the output queue. low is capped by high.
+    void setWatermarks(size_t low, size_t high);
+
+    // Sets the budget (shared, must outlive this) bounding the output queue
+    // (NULL - unbounded). Should be set before queueing output.
+    void setOutputBudget(OutputBudget *budget);
+
+    // Makes the Reactor receive the input (see Reactor::receive) from the
+    // first call back on, if its backend can. Data received by the Reactor
+    // is handed out by receive at once regardless of the budget.
+    void setAsyncInput(bool async);
+
+    // Returns true if the Client is backpressured.
+    bool isBackpressured() const;
+
+    // Returns the amount of bytes waiting to be sent.
+    size_t getPendingOutput() const;
+
     // Implement EventHandler  interface.
     virtual Handle getHandle();
+    virtual const char *getCategory() const;
     virtual void handleInput(int hint);
     virtual void handleOutput(int hint);
     virtual void handleClose(int hint);
     virtual void handleError(int hint);
+    virtual void handleSent(int hint, int result);
+    virtual void handleReceived(int hint, const char *data, int result);
+
+    // Hands the connection over to a ZeroCopyLinger if zero-copy sends
+    // haven't completed yet, so the Messages are kept until they have. Must
+    // be called by the thread of the Reactor after this has been detouched
+    // from it (see dispose).
+    void linger();
 
 protected:
     // handleInput and handleOutput are implemented as template methods
     // which define error handling around doHandleInput/doHandleOutput
     // which should be overridden by the subclasses to do the processing.
+    // The default doHandleOutput sends the queued output.
     virtual void doHandleInput(int hint);
     virtual void doHandleOutput(int hint);
 
+    // Queues the message (acquires a reference) to be sent when the
+    // connection is ready for writing. hint is the one the Client has been
+    // called back with.
+    void queueOutput(int hint, Message *message);
+
+    // Sends as much of the queued output as the transport layer accepts (as
+    // few system calls as possible). Returns true if the queue is drained.
+    bool flushOutput();
+
+    // Hands the front of the queued output to the Reactor to send unless a
+    // send is in flight already. Returns false if the Reactor can't send
+    // (the output has to be sent when the connection is ready for writing).
+    bool sendAsync(int hint);
+
+    // Handles a send done by the Reactor (of the data discarded meanwhile
+    // if discarded). Will throw like flushOutput.
+    void doHandleSent(int hint, int result, bool discarded);
+
+    // Asks the Reactor to receive the next input. Returns false if it can't,
+    // then the client is called back when there is input.
+    bool receiveAsync(int hint);
+
+    // Drops the queued output.
+    void clearOutput();
+
+    // Releases the Messages of the zero-copy sends which the transport
+    // layer has completed. Returns true if the error reported for the
+    // connection is nothing but the completions (should be checked by
+    // handleError).
+    bool handleCompletions();
+
+    // Called when the Client becomes (or stops being) backpressured. Does
+    // nothing by default.
+    virtual void handleBackpressure(int hint);
+
+    // Applies the policy of the budget to a message of length bytes which
+    // doesn't fit. Returns true if the message can be queued now.
+    bool handleOverflow(int hint, size_t length);
+
+    // Updates the backpressure state.
+    void setBackpressured(int hint, bool backpressured);
+
+    // Lifts the backpressure once the queue has drained below the low
+    // watermark.
+    void handleCatchUp(int hint);
+
+    // Appends received data to buffer (up to the read budget, or budget
+    // bytes). Returns the amount of bytes received. Should be used by
+    // doHandleInput.
+    size_t receive(Buffer &buffer);
+    size_t receive(Buffer &buffer, size_t budget);
+
     // Unregister this from the Reactor and delete this.
     void dispose(int hint);
 
@@ -48,9 +163,97 @@ protected:
     // Ensure dynamic allocation.
     virtual ~Client();
 
+protected:
+    // AsyncSend is a send handed to the Reactor. The Messages are held until
+    // it's done.
+    struct AsyncSend
+    {
+        AsyncSend();
+        ~AsyncSend();
+
+        struct msghdr m_message;
+        struct iovec m_iov[Connection::MAX_GATHER];
+        Message *m_held[Connection::MAX_GATHER];
+        int m_count;
+        size_t m_length;   // Bytes being sent.
+        bool m_discarded;  // The queue has been cleared meanwhile.
+
+        // Allocated from a Pool (one is in flight per busy Client).
+        static void *operator new(size_t size);
+        static void operator delete(void *block, size_t size);
+
+        static Pool m_pool;
+    };
+
 protected:
     auto_ptr<Connection> m_connection;
     Reactor &m_reactor;
+    size_t m_readBudget;
+    bool m_inputPending; // Read budget has been exhausted.
+    MessageQueue m_output;
+    size_t m_lowWatermark;
+    size_t m_highWatermark;
+    bool m_backpressured;
+    OutputBudget *m_budget;
+    bool m_paused;     // Gets no output until the queue drains.
+    bool m_overflowed; // To be closed by the budget policy.
+
+    // Messages sent without copying by id of the send (until completed).
+    HeldMessages m_zeroCopyHeld;
+
+    bool m_asyncOutput;      // Output is sent by the Reactor.
+    AsyncSend *m_send;       // Send in flight (NULL if none).
+    bool m_asyncInput;       // The Reactor receives the input if it can.
+    bool m_receiving;        // Receive in flight.
+    bool m_receivedPending;  // Data received by the Reactor not handed out:
+    const char *m_received;  //  the data,
+    int m_receivedResult;    //  and the result (see handleReceived).
+};
+
+/*
+ * ZeroCopyLinger keeps the Connection of a disposed Client open until the
+ * transport layer reports the zero-copy sends completed, and only then
+ * releases the Messages held for them (a released Message can be reused for
+ * other data right away). The output is shut down so the queued data is
+ * still sent, as if the connection had been closed. Completions are reported
+ * as errors (see handleError). Hangup means the queued data is gone. If the
+ * sends don't complete within TIMEOUT milliseconds (e.g. the peer doesn't
+ * read) the connection is reset, which drops the queued data.
+ */
+class ZeroCopyLinger : public EventHandler
+{
+public:
+    static const long TIMEOUT = 10000;
+
+public:
+    // Takes ownership over connection and the Messages of held (left empty).
+    ZeroCopyLinger(auto_ptr<Connection> connection, Reactor &reactor, Client::HeldMessages &held);
+    virtual ~ZeroCopyLinger();
+
+    // Implement EventHandler interface.
+    virtual Handle getHandle();
+    virtual const char *getCategory() const;
+    virtual void handleError(int hint);
+    virtual void handleClose(int hint);
+    virtual void handleTimeout(int hint);
+
+protected:
+    // Releases the Messages of the completed sends. Returns true if there is
+    // nothing left to wait for.
+    bool reap();
+
+    // Unregister this from the Reactor and delete this.
+    void dispose(int hint);
+
+protected:
+    auto_ptr<Connection> m_connection;
+    Reactor &m_reactor;
+    Client::HeldMessages m_held;
+
+private:
+    // Make non-copyable.
+    ZeroCopyLinger(const ZeroCopyLinger&);
+    ZeroCopyLinger& operator=(const ZeroCopyLinger&);
 };
 
 /*
@@ -62,13 +265,57 @@ public:
     // Creates an Admin. Takes ownership over connection.
     Admin(auto_ptr<Connection> connection, Reactor &reactor);
 
+    // Sets Reactors to report statistics of (own Reactor by default). The
+    // list must outlive this.
+    void setReactors(const vector< Reactor* > *reactors);
+
+    // Sets OutputBudget to report counters of (none by default). Must
+    // outlive this.
+    void setReportedBudget(const OutputBudget *budget);
+
+    // Sets AcceptStats to report (none by default). Must outlive this.
+    void setReportedAccepts(const AcceptStats *accepts);
+
+    virtual const char *getCategory() const;
+
 protected:
-    // Stop Reactor if received "stop".
+    // Stop Reactor if received "stop". Send statistics of the Reactors (and
+    // the OutputBudget and AcceptStats) if received "stats".
     virtual void doHandleInput(int hint);
 
 protected:
     // Ensure dynamic allocation.
     virtual ~Admin();
+
+protected:
+    const vector< Reactor* > *m_reactors;
+    const OutputBudget *m_reportedBudget;
+    const AcceptStats *m_reportedAccepts;
+};
+
+/*
+ * AdminFactory creates Admins which report statistics of the given Reactors.
+ */
+class AdminFactory : public EventHandlerFactory
+{
+public:
+    AdminFactory();
+
+    // Sets Reactors to report statistics of. The list must outlive this.
+    void setReactors(const vector< Reactor* > *reactors);
+
+    // Sets OutputBudget to report counters of. Must outlive this.
+    void setReportedBudget(const OutputBudget *budget);
+
+    // Sets AcceptStats to report. Must outlive this.
+    void setReportedAccepts(const AcceptStats *accepts);
+
+    virtual EventHandler *createEventHandler(auto_ptr<Connection> connection, Reactor &reactor);
+
+protected:
+    const vector< Reactor* > *m_reactors;
+    const OutputBudget *m_reportedBudget;
+    const AcceptStats *m_reportedAccepts;
 };
 
 /*
@@ -7,53 +7,172 @@
 #include <unistd.h>
 #include <cstring>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <netdb.h>
 #include <errno.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/sock_diag.h>
+#include <linux/errqueue.h>
+#endif
 
 namespace followermaze
 {
 
-Connection::Connection(int portno, bool async)
+const int Connection::DEFAULT_BACKLOG;
+const size_t Connection::READ_CHUNK;
+const size_t Connection::FIRST_READ_CHUNK;
+Pool Connection::m_pool("connections", sizeof(Connection));
+
+Connection::Connection(int portno, bool async, int backlog, bool reusePort) :
+    m_peerClosed(false),
+    m_family(SocketAddress::FamilyTcp4),
+    m_zeroCopySends(0),
+    m_zeroCopyCompleted(0),
+    m_zeroCopyOff(false)
+{
+    open(SocketAddress(portno), async, backlog, reusePort);
+}
+
+Connection::Connection(const SocketAddress &address, bool async, int backlog, bool reusePort) :
+    m_peerClosed(false),
+    m_family(address.m_family),
+    m_zeroCopySends(0),
+    m_zeroCopyCompleted(0),
+    m_zeroCopyOff(false)
 {
-    // Create socket (we assume TCP/IP with IPv4 for simplicity)
+    open(address, async, backlog, reusePort);
+}
+
+void Connection::open(const SocketAddress &address, bool async, int backlog, bool reusePort)
+{
+    // Initialize socket address structure
+    struct sockaddr_storage serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    socklen_t serverAddrLen = 0;
+    int domain = AF_INET;
+
+    if (address.m_family == SocketAddress::FamilyUnix)
+    {
+        // Only one listener can own the path.
+        if (reusePort)
+        {
+            throw Exception(EINVAL);
+        }
+
+        struct sockaddr_un *unixAddr = (struct sockaddr_un *) &serverAddr;
+        unixAddr->sun_family = AF_UNIX;
+        strncpy(unixAddr->sun_path, address.m_path.c_str(), sizeof(unixAddr->sun_path) - 1);
+        serverAddrLen = sizeof(struct sockaddr_un);
+        domain = AF_UNIX;
+    }
+    else if (address.m_family == SocketAddress::FamilyTcp6)
+    {
+        struct sockaddr_in6 *inAddr = (struct sockaddr_in6 *) &serverAddr;
+        inAddr->sin6_family = AF_INET6;
+        inAddr->sin6_addr = in6addr_any;
+        inAddr->sin6_port = htons(address.m_port);
+        if (!address.m_host.empty() && inet_pton(AF_INET6, address.m_host.c_str(), &inAddr->sin6_addr) != 1)
+        {
+            throw Exception(EINVAL);
+        }
+        serverAddrLen = sizeof(struct sockaddr_in6);
+        domain = AF_INET6;
+    }
+    else
+    {
+        struct sockaddr_in *inAddr = (struct sockaddr_in *) &serverAddr;
+        inAddr->sin_family = AF_INET;
+        inAddr->sin_addr.s_addr = INADDR_ANY;
+        inAddr->sin_port = htons(address.m_port);
+        if (!address.m_host.empty() && inet_pton(AF_INET, address.m_host.c_str(), &inAddr->sin_addr) != 1)
+        {
+            throw Exception(EINVAL);
+        }
+        serverAddrLen = sizeof(struct sockaddr_in);
+    }
+
+    // Create socket
     int type = async ? (SOCK_STREAM | SOCK_NONBLOCK) : SOCK_STREAM;
-    m_handle = socket(AF_INET, type, 0);
+    m_handle = socket(domain, type, 0);
     if (m_handle < 0)
     {
         throw Exception(errno);
     }
 
-    // Make socket reuse the address to enable server restart without waiting.
-    int so_reuseaddr = 1;
-    if (setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, &so_reuseaddr, sizeof(so_reuseaddr)) < 0)
+    if (domain == AF_UNIX)
     {
-        close(m_handle);
-        throw Exception(errno);
-    }
+        // Replace the socket of a listener which is gone (nobody accepts
+        // connections on it).
+        struct stat st;
+        if (lstat(address.m_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (probe >= 0 && ::connect(probe, (struct sockaddr *) &serverAddr, serverAddrLen) < 0 && errno == ECONNREFUSED)
+            {
+                unlink(address.m_path.c_str());
+            }
 
-    // Initialize socket address structure
-    struct sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
+            if (probe >= 0)
+            {
+                close(probe);
+            }
+        }
+    }
+    else
+    {
+        // Make socket reuse the address to enable server restart without waiting.
+        int so_reuseaddr = 1;
+        if (setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, &so_reuseaddr, sizeof(so_reuseaddr)) < 0)
+        {
+            close(m_handle);
+            throw Exception(errno);
+        }
 
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(portno);
+        // Let the kernel balance connection requests between the listeners.
+        int so_reuseport = 1;
+        if (reusePort && setsockopt(m_handle, SOL_SOCKET, SO_REUSEPORT, &so_reuseport, sizeof(so_reuseport)) < 0)
+        {
+            close(m_handle);
+            throw Exception(errno);
+        }
+    }
 
-    // Now bind the host address using bind() call.
-    if (0 != bind(m_handle, (struct sockaddr *) &serverAddr, sizeof(serverAddr)))
+    // Now bind the address using bind() call.
+    if (0 != bind(m_handle, (struct sockaddr *) &serverAddr, serverAddrLen))
     {
+        int err = errno;
         close(m_handle);
-        throw Exception(errno);
+        throw Exception(err);
     }
 
-    if (0 != listen(m_handle, 5))
+    if (domain == AF_UNIX)
     {
+        m_path = address.m_path;
+    }
+
+    if (0 != listen(m_handle, backlog))
+    {
+        int err = errno;
         close(m_handle);
-        throw Exception(errno);
+        if (!m_path.empty())
+        {
+            unlink(m_path.c_str());
+        }
+        throw Exception(err);
     }
 }
 
-Connection::Connection()
+Connection::Connection() :
+    m_peerClosed(false),
+    m_family(SocketAddress::FamilyTcp4),
+    m_zeroCopySends(0),
+    m_zeroCopyCompleted(0),
+    m_zeroCopyOff(false)
 {
     m_handle = -1;
 }
@@ -64,6 +183,11 @@ Connection::~Connection()
     {
         close(m_handle);
     }
+
+    if (!m_path.empty())
+    {
+        unlink(m_path.c_str());
+    }
 }
 
 Connection* Connection::accept(bool async)
@@ -82,6 +206,39 @@ Connection* Connection::accept(bool async)
     }
 
     clientConnection->m_handle = sockfd;
+    clientConnection->m_profile = m_profile;
+    clientConnection->m_family = m_family;
+
+    return clientConnection;
+}
+
+Connection* Connection::acceptPending(bool async)
+{
+    Connection* clientConnection = new Connection();
+
+    int flags = async ? SOCK_NONBLOCK : 0;
+    int sockfd = -1;
+    do
+    {
+        sockfd = ::accept4(m_handle, NULL, NULL, flags);
+    }
+    while (sockfd < 0 && (errno == EINTR || errno == ECONNABORTED || errno == EPROTO));
+
+    if (sockfd < 0)
+    {
+        int err = errno;
+        delete clientConnection;
+        if (err == EAGAIN || err == EWOULDBLOCK)
+        {
+            return NULL;
+        }
+
+        throw Exception(err);
+    }
+
+    clientConnection->m_handle = sockfd;
+    clientConnection->m_profile = m_profile;
+    clientConnection->m_family = m_family;
 
     return clientConnection;
 }
@@ -97,10 +254,16 @@ const char *Connection::receive()
         // Client closed the connection.
         throw Exception(Exception::ErrClientDisconnect);
     }
-    else if (bytesRecieved < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK))
+    else if (bytesRecieved < 0)
     {
-        // Error.
-        throw Exception(errno);
+        if (!(errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Error.
+            throw Exception(errno);
+        }
+
+        // No data waiting.
+        bytesRecieved = 0;
     }
 
     m_buffer[bytesRecieved] = 0; // zterminate
@@ -108,14 +271,280 @@ const char *Connection::receive()
     return m_buffer;
 }
 
-void Connection::send(const string &message)
+size_t Connection::receive(Buffer &buffer, size_t budget)
+{
+    if (m_peerClosed)
+    {
+        throw Exception(Exception::ErrClientDisconnect);
+    }
+
+    size_t total = 0;
+    while (total < budget)
+    {
+        // Read into the free space of the buffer. Only a full buffer grows
+        // (by its capacity up to READ_CHUNK), so an idle connection never
+        // holds more than it has received.
+        size_t chunk = buffer.available();
+        if (chunk == 0)
+        {
+            chunk = buffer.capacity() == 0 ? FIRST_READ_CHUNK :
+                    buffer.capacity() < READ_CHUNK ? buffer.capacity() : READ_CHUNK;
+        }
+        else if (chunk > READ_CHUNK)
+        {
+            chunk = READ_CHUNK;
+        }
+
+        if (chunk > budget - total)
+        {
+            chunk = budget - total;
+        }
+
+        // Receive directly into the buffer.
+        ssize_t bytesRecieved = recv(m_handle, buffer.prepare(chunk), chunk, 0);
+
+        if (bytesRecieved > 0)
+        {
+            buffer.commit(bytesRecieved);
+            total += bytesRecieved;
+            continue;
+        }
+
+        if (bytesRecieved < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (bytesRecieved < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Drained.
+            break;
+        }
+
+        // Client closed the connection (or error). Hand out the data
+        // received so far first.
+        if (total == 0)
+        {
+            throw Exception(bytesRecieved == 0 ? static_cast<int>(Exception::ErrClientDisconnect) : errno);
+        }
+
+        m_peerClosed = true;
+        break;
+    }
+
+    return total;
+}
+
+bool Connection::isPeerClosed() const
+{
+    return m_peerClosed;
+}
+
+size_t Connection::send(const string &message)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(message.data());
+    iov.iov_len = message.length();
+    return send(&iov, 1);
+}
+
+size_t Connection::send(const struct iovec *iov, int count, bool more)
 {
     int flags = MSG_NOSIGNAL;
-    if (::send(m_handle, message.c_str(), message.length(), flags) < 0)
+    if (more && m_profile.m_cork)
+    {
+        flags |= MSG_MORE;
+    }
+
+#ifdef MSG_ZEROCOPY
+    if (m_profile.m_zeroCopy > 0 && !m_zeroCopyOff && m_family != SocketAddress::FamilyUnix)
+    {
+        size_t length = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            length += iov[i].iov_len;
+        }
+
+        // Pinning the pages costs more than copying small batches.
+        if (length >= static_cast<size_t>(m_profile.m_zeroCopy))
+        {
+            flags |= MSG_ZEROCOPY;
+        }
+    }
+#endif
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = count;
+
+    ssize_t bytesSent;
+    do
+    {
+        bytesSent = sendmsg(m_handle, &msg, flags);
+#ifdef MSG_ZEROCOPY
+        if (bytesSent < 0 && (flags & MSG_ZEROCOPY) && errno == ENOBUFS)
+        {
+            // Too many pages pinned. Copy until the completions catch up.
+            flags &= ~MSG_ZEROCOPY;
+            bytesSent = sendmsg(m_handle, &msg, flags);
+        }
+#endif
+    }
+    while (bytesSent < 0 && errno == EINTR);
+
+    if (bytesSent < 0)
     {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // Not accepting writes.
+            return 0;
+        }
+
         // Client closed the connection or some error has happened.
         throw Exception(errno == EPIPE ? Exception::ErrClientDisconnect : errno);
     }
+
+#ifdef MSG_ZEROCOPY
+    if (flags & MSG_ZEROCOPY)
+    {
+        ++m_zeroCopySends;
+    }
+#endif
+
+    return bytesSent;
+}
+
+unsigned int Connection::getZeroCopySends() const
+{
+    return m_zeroCopySends;
+}
+
+unsigned int Connection::reapZeroCopy()
+{
+#ifdef MSG_ZEROCOPY
+    while (m_zeroCopyCompleted != m_zeroCopySends)
+    {
+        char control[256];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(m_handle, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            // Nothing more reported (EAGAIN) or the socket is broken.
+            break;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            // Sends [ee_info, ee_data] are completed. The ranges come in order.
+            m_zeroCopyCompleted = err.ee_data + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                m_zeroCopyOff = true;
+            }
+        }
+    }
+#endif
+    return m_zeroCopyCompleted;
+}
+
+void Connection::shutdownOutput()
+{
+    shutdown(m_handle, SHUT_WR);
+}
+
+void Connection::setResetOnClose()
+{
+    struct linger option;
+    option.l_onoff = 1;
+    option.l_linger = 0;
+    setsockopt(m_handle, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+}
+
+int Connection::getPendingError()
+{
+    int err = 0;
+    socklen_t length = sizeof(err);
+    if (getsockopt(m_handle, SOL_SOCKET, SO_ERROR, &err, &length) < 0)
+    {
+        return errno;
+    }
+
+    return err;
+}
+
+void Connection::setProfile(const SocketProfile &profile)
+{
+    int one = 1;
+    // Unix-domain sockets have no Nagle's algorithm to disable.
+    bool tcp = m_family != SocketAddress::FamilyUnix;
+    if (tcp && profile.m_noDelay && setsockopt(m_handle, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0)
+    {
+        throw Exception(errno);
+    }
+
+    if (profile.m_sendBuffer > 0 &&
+        setsockopt(m_handle, SOL_SOCKET, SO_SNDBUF, &profile.m_sendBuffer, sizeof(profile.m_sendBuffer)) < 0)
+    {
+        throw Exception(errno);
+    }
+
+    if (profile.m_receiveBuffer > 0 &&
+        setsockopt(m_handle, SOL_SOCKET, SO_RCVBUF, &profile.m_receiveBuffer, sizeof(profile.m_receiveBuffer)) < 0)
+    {
+        throw Exception(errno);
+    }
+
+#ifdef SO_ZEROCOPY
+    // Accepted connections inherit the option (the OS refuses it for
+    // Unix-domain sockets).
+    if (tcp && profile.m_zeroCopy > 0 &&
+        setsockopt(m_handle, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+    {
+        throw Exception(errno);
+    }
+#endif
+
+#ifdef SO_BUSY_POLL
+    if (profile.m_busyPoll > 0 &&
+        setsockopt(m_handle, SOL_SOCKET, SO_BUSY_POLL, &profile.m_busyPoll, sizeof(profile.m_busyPoll)) < 0)
+    {
+        throw Exception(errno);
+    }
+#endif
+
+    m_profile = profile;
+}
+
+const SocketProfile &Connection::getProfile() const
+{
+    return m_profile;
+}
+
+long Connection::getDropCount() const
+{
+#if defined(SO_MEMINFO) && defined(SK_MEMINFO_DROPS)
+    // The OS counts the requests dropped by a listening socket along with
+    // the other drops of the socket.
+    unsigned int meminfo[SK_MEMINFO_VARS];
+    memset(meminfo, 0, sizeof(meminfo));
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(m_handle, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0 && len > SK_MEMINFO_DROPS * sizeof(meminfo[0]))
+    {
+        return meminfo[SK_MEMINFO_DROPS];
+    }
+#endif
+    return -1;
 }
 
 Handle Connection::getHandle() const
@@ -123,4 +552,39 @@ Handle Connection::getHandle() const
     return m_handle;
 }
 
+long Connection::raiseHandleLimit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+    {
+        throw Exception(errno);
+    }
+
+    // Unlimited is not allowed for descriptors, use the Linux default
+    // ceiling (fs.nr_open) instead.
+    static const rlim_t MAX_HANDLES = 1024 * 1024;
+    rlim_t max = (limit.rlim_max == RLIM_INFINITY) ? MAX_HANDLES : limit.rlim_max;
+
+    if (limit.rlim_cur != max)
+    {
+        limit.rlim_cur = max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) < 0)
+        {
+            throw Exception(errno);
+        }
+    }
+
+    return static_cast<long>(limit.rlim_cur);
+}
+
+void *Connection::operator new(size_t size)
+{
+    return m_pool.allocate(size);
+}
+
+void Connection::operator delete(void *block, size_t size)
+{
+    m_pool.deallocate(block, size);
+}
+
 } // namespace followermaze
@@ -6,7 +6,13 @@
 #define CONNECTION_H
 
 #include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include "exception.h"
+#include "buffer.h"
+#include "socketprofile.h"
+#include "socketaddress.h"
+#include "pool.h"
 
 using namespace std;
 
@@ -17,8 +23,8 @@ typedef int Handle;
 static const int INVALID_HANDLE = -1;
 
 /*
- * Connection wraps an OS specific TCP/IP network I/O resource represented
- * by a Handle. It provides a way to exchange information through this
+ * Connection wraps an OS specific stream socket (TCP/IP or Unix-domain)
+ * represented by a Handle. It provides a way to exchange information through this
  * resource synchronously or asynchronously (defined at construction time).
  * Connection can be created as a valid server (listening) connection or an
  * invalid one.
@@ -39,11 +45,33 @@ public:
         virtual const char* what() const throw() { return "Connection::Exception#"; }
     };
 
+public:
+    // Default length of the queue of pending connection requests.
+    static const int DEFAULT_BACKLOG = SOMAXCONN;
+
+    // Max amount of bytes read by one system call.
+    static const size_t READ_CHUNK = 16 * 1024;
+
+    // Amount of bytes read into an empty buffer without storage. Buffers
+    // grow (up to READ_CHUNK at a time) only when the data fills them up.
+    static const size_t FIRST_READ_CHUNK = 64;
+
+    // Max amount of buffers sent by one system call.
+    static const int MAX_GATHER = 256;
+
 public:
     // Creates server connection which listens on the port.
     // If async creates non-blocking connection.
+    // backlog limits the length of the queue of pending connection requests
+    // (the OS may silently cap it, e.g. net.core.somaxconn on Linux).
+    // If reusePort multiple connections can listen on the same port and the
+    // OS distributes incoming connection requests between them.
     // Will throw on initialization error.
-    Connection(int portno, bool async = false);
+    Connection(int portno, bool async = false, int backlog = DEFAULT_BACKLOG, bool reusePort = false);
+    // Same as above, but listens on the address. A Unix-domain socket left
+    // over by a listener which is gone is replaced and the socket is removed
+    // at destruction. Unix-domain sockets can't be reused.
+    Connection(const SocketAddress &address, bool async = false, int backlog = DEFAULT_BACKLOG, bool reusePort = false);
     // Creates invalid connection. Used by accept().
     Connection();
     virtual ~Connection();
@@ -61,23 +89,111 @@ public:
     // no client is queueing.
     virtual Connection* accept(bool async = false);
 
+    // Same as accept but returns NULL instead of throwing if the connection
+    // is non-blocking and no client is queueing. Skips clients which have
+    // aborted while queueing. Used to drain the queue in a loop.
+    Connection* acceptPending(bool async = false);
+
     // If connected returns received message.
     // If blocking will block until there is data.
-    // If non-blocking will throw if attempt to receive is made with no data waiting.
+    // If non-blocking returns empty message if there is no data waiting.
     virtual const char* receive();
 
-    // Sends the message.
+    // Appends received data to buffer until there is no more data waiting or
+    // budget bytes have been received. Returns the amount of bytes received.
+    // The data is received straight into the free space of the buffer.
+    // Should be used with non-blocking connections only.
+    // Will throw if the client has closed the connection (or an error
+    // occured) and there was no data to receive. Otherwise the data is
+    // returned and isPeerClosed tells whether the next call would throw.
+    virtual size_t receive(Buffer &buffer, size_t budget);
+
+    // Returns true if the client has closed the connection (detected by the
+    // last receive).
+    bool isPeerClosed() const;
+
+    // Sends the message. Returns the amount of bytes sent.
     // If blocking will block until data has been transferred to the transport layer.
-    // If non-blocking will throw if attempt to send data is made while transport
-    // layer is not accepting writes.
-    virtual void send(const string &message);
+    // If non-blocking sends as much as the transport layer accepts which can
+    // be less than the message (0 if it is not accepting writes).
+    // Will throw if the client has closed the connection or an error occured.
+    virtual size_t send(const string &message);
+
+    // Sends the data of count (up to MAX_GATHER) buffers by one system call.
+    // Returns the amount of bytes accepted by the transport layer which can
+    // be less than requested (0 if a non-blocking connection is not
+    // accepting writes).
+    // more tells that more data of the same batch follows right away (the
+    // transport layer holds back partial segments if the profile says cork).
+    // If the profile says zerocopy and the data is large enough the pages
+    // are handed to the transport layer without copying. The data must stay
+    // intact until the send is reported completed (see reapZeroCopy).
+    // Will throw if the client has closed the connection or an error occured.
+    virtual size_t send(const struct iovec *iov, int count, bool more = false);
+
+    // Returns the number of sends which have gone without copying so far.
+    // The n-th such send (counting from 0) is completed once reapZeroCopy
+    // returns more than n.
+    unsigned int getZeroCopySends() const;
+
+    // Collects the completions of zero-copy sends reported through the
+    // error queue. Returns the number of sends completed so far (in order).
+    // Stops sending without copying if the OS has reported it copied the
+    // data anyway (e.g. on loopback) as it only adds overhead then.
+    unsigned int reapZeroCopy();
+
+    // Stops sending: the data queued already is sent and followed by the end
+    // of the stream.
+    void shutdownOutput();
+
+    // Makes closing reset the connection (the data queued is dropped).
+    void setResetOnClose();
+
+    // Returns the pending error of the socket (0 if none) and clears it.
+    int getPendingError();
+
+    // Applies the socket options of the profile. If listening the accepted
+    // connections inherit the profile (Linux copies the options of the
+    // listening socket to the accepted ones so it takes no system calls per
+    // connection).
+    // Will throw on error.
+    void setProfile(const SocketProfile &profile);
+
+    // Returns the profile applied (or inherited from the listener).
+    const SocketProfile &getProfile() const;
+
+    // Returns the amount of connection requests the OS has dropped because
+    // the queue of pending requests was full (-1 if the OS doesn't tell).
+    long getDropCount() const;
 
     // Getter for the handle.
     Handle getHandle() const;
 
+    // Raises the limit on the number of Handles the process can open to the
+    // maximum allowed. Returns the new limit.
+    // Will throw on error.
+    static long raiseHandleLimit();
+
+    // Connections are allocated from a Pool (one is created per client).
+    static void *operator new(size_t size);
+    static void operator delete(void *block, size_t size);
+
+private:
+    // Creates the socket and listens on the address. Used by constructors.
+    void open(const SocketAddress &address, bool async, int backlog, bool reusePort);
+
 private:
     Handle m_handle;  // I/O handle.
     char m_buffer[1024]; // Internal buffer for incoming data.
+    bool m_peerClosed;
+    SocketProfile m_profile;
+    SocketAddress::Family m_family;
+    string m_path;    // Unix-domain socket to remove (if listening).
+    unsigned int m_zeroCopySends;
+    unsigned int m_zeroCopyCompleted;
+    bool m_zeroCopyOff; // The OS copies anyway (or refuses).
+
+    static Pool m_pool;
 };
 
 } // namespace followermaze
@@ -0,0 +1,253 @@
+#include <errno.h>
+#include <unistd.h>
+#include "demultiplexer.h"
+
+namespace followermaze
+{
+
+/*----------------------------------------------------------------------------*/
+
+const int Demultiplexer::WAKEUP_HINT;
+
+/*----------------------------------------------------------------------------*/
+
+void PollDemultiplexer::add(int hint, Handle handle, unsigned int interest)
+{
+    if (hint < WAKEUP_HINT)
+    {
+        throw Exception();
+    }
+
+    size_t index = toIndex(hint);
+    if (index >= m_pollfds.size())
+    {
+        struct pollfd unused;
+        unused.fd = -1;
+        unused.events = 0;
+        unused.revents = 0;
+        m_pollfds.resize(index + 1, unused);
+    }
+
+    m_pollfds[index].fd = handle;
+    m_pollfds[index].events = toPollEvents(interest);
+    m_pollfds[index].revents = 0;
+}
+
+void PollDemultiplexer::modify(int hint, Handle /*handle*/, unsigned int interest)
+{
+    if (hint < WAKEUP_HINT || toIndex(hint) >= m_pollfds.size())
+    {
+        throw Exception();
+    }
+
+    m_pollfds[toIndex(hint)].events = toPollEvents(interest);
+}
+
+void PollDemultiplexer::remove(int hint, Handle /*handle*/)
+{
+    if (hint < WAKEUP_HINT || toIndex(hint) >= m_pollfds.size())
+    {
+        throw Exception();
+    }
+
+    size_t index = toIndex(hint);
+    m_pollfds[index].fd = -1;
+    m_pollfds[index].events = 0;
+    m_pollfds[index].revents = 0;
+}
+
+void PollDemultiplexer::wait(EventList &ready, int timeout)
+{
+    ready.clear();
+
+    int nfds = static_cast<int>(m_pollfds.size());
+    int res = poll(nfds > 0 ? &m_pollfds[0] : NULL, nfds, timeout);
+
+    if  (res < 0)
+    {
+        if (errno == EINTR)
+        {
+            // Interrupted by a signal. Let the caller handle timeouts.
+            return;
+        }
+
+        throw Exception(errno);
+    }
+
+    for (int i = 0; i < nfds && static_cast<int>(ready.size()) < res; ++i)
+    {
+        short revents = m_pollfds[i].revents;
+        if (revents != 0)
+        {
+            m_pollfds[i].revents = 0;
+
+            Event event;
+            event.m_hint = i - toIndex(0);
+            event.m_ready = 0;
+            event.m_result = 0;
+            event.m_data = NULL;
+
+            if (revents & POLLIN)
+            {
+                event.m_ready |= ReadyIn;
+            }
+
+            if (revents & POLLOUT)
+            {
+                event.m_ready |= ReadyOut;
+            }
+
+            if (revents & POLLHUP)
+            {
+                event.m_ready |= ReadyHup;
+            }
+
+            if ((revents & POLLERR) || (revents & POLLNVAL))
+            {
+                event.m_ready |= ReadyErr;
+            }
+
+            ready.push_back(event);
+        }
+    }
+}
+
+size_t PollDemultiplexer::toIndex(int hint)
+{
+    // The array starts with WAKEUP_HINT.
+    return static_cast<size_t>(hint - WAKEUP_HINT);
+}
+
+short PollDemultiplexer::toPollEvents(unsigned int interest)
+{
+    short events = 0;
+
+    if (interest & InterestRead)
+    {
+        events |= POLLIN;
+    }
+
+    if (interest & InterestWrite)
+    {
+        events |= POLLOUT;
+    }
+
+    return events;
+}
+
+/*----------------------------------------------------------------------------*/
+
+const int EpollDemultiplexer::MAX_EVENTS;
+
+EpollDemultiplexer::EpollDemultiplexer()
+{
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollfd < 0)
+    {
+        throw Exception(errno);
+    }
+}
+
+EpollDemultiplexer::~EpollDemultiplexer()
+{
+    close(m_epollfd);
+}
+
+void EpollDemultiplexer::add(int hint, Handle handle, unsigned int interest)
+{
+    control(EPOLL_CTL_ADD, hint, handle, interest);
+}
+
+void EpollDemultiplexer::modify(int hint, Handle handle, unsigned int interest)
+{
+    control(EPOLL_CTL_MOD, hint, handle, interest);
+}
+
+void EpollDemultiplexer::remove(int /*hint*/, Handle handle)
+{
+    // Nothing to do if the handle has been closed already (the kernel removes
+    // closed descriptors from the interest list on its own).
+    struct epoll_event event;
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, handle, &event);
+}
+
+void EpollDemultiplexer::wait(EventList &ready, int timeout)
+{
+    ready.clear();
+
+    int res = epoll_wait(m_epollfd, m_events, MAX_EVENTS, timeout);
+
+    if (res < 0)
+    {
+        if (errno == EINTR)
+        {
+            // Interrupted by a signal. Let the caller handle timeouts.
+            return;
+        }
+
+        throw Exception(errno);
+    }
+
+    for (int i = 0; i < res; ++i)
+    {
+        unsigned int events = m_events[i].events;
+
+        Event event;
+        event.m_hint = static_cast<int>(m_events[i].data.u32);
+        event.m_ready = 0;
+        event.m_result = 0;
+        event.m_data = NULL;
+
+        if (events & EPOLLIN)
+        {
+            event.m_ready |= ReadyIn;
+        }
+
+        if (events & EPOLLOUT)
+        {
+            event.m_ready |= ReadyOut;
+        }
+
+        if (events & EPOLLHUP)
+        {
+            event.m_ready |= ReadyHup;
+        }
+
+        if (events & EPOLLERR)
+        {
+            event.m_ready |= ReadyErr;
+        }
+
+        ready.push_back(event);
+    }
+}
+
+void EpollDemultiplexer::control(int op, int hint, Handle handle, unsigned int interest)
+{
+    struct epoll_event event;
+    event.data.u64 = 0;
+    event.data.u32 = static_cast<unsigned int>(hint);
+    event.events = 0;
+
+    if (interest & InterestRead)
+    {
+        event.events |= EPOLLIN;
+    }
+
+    if (interest & InterestWrite)
+    {
+        event.events |= EPOLLOUT;
+    }
+
+    if (interest & InterestEdge)
+    {
+        event.events |= EPOLLET;
+    }
+
+    if (epoll_ctl(m_epollfd, op, handle, &event) < 0)
+    {
+        throw Exception(errno);
+    }
+}
+
+} // namespace followermaze
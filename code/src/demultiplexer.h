@@ -0,0 +1,169 @@
+/* This file declears Demultiplexer interface and its implementations.
+ */
+#ifndef DEMULTIPLEXER_H
+#define DEMULTIPLEXER_H
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <vector>
+#include "exception.h"
+#include "connection.h"
+
+namespace followermaze
+{
+
+/* Demultiplexer is a part of Reactor pattern which waits for I/O events on a
+ * set of Handles (synchronous event demultiplexer).
+ * Handles are registered together with a hint (Reactor's slot number) which
+ * is reported back when an event occures so Reactor can find the handler
+ * without searching. WAKEUP_HINT is reserved for Reactor's own Handle.
+ * Demultiplexer doesn't own the Handles. Implementations are expected to be
+ * used by a single Reactor only.
+ * Implementations may also send and receive on behalf of the caller (see
+ * send and receive) and report the results by wait along with the readiness.
+ */
+class Demultiplexer
+{
+public:
+    class Exception : public BaseException
+    {
+    public:
+        Exception(int err = BaseException::ErrGeneric) : BaseException(err) {}
+        virtual const char* what() const throw() { return "Demultiplexer::Exception#"; }
+    };
+
+    // Interest (can be OR-ed). InterestEdge asks to report the Handle only
+    // when it becomes ready (edge-triggered). Implementations which don't
+    // support it keep reporting the Handle while it's ready.
+    enum
+    {
+        InterestRead = 0x01,
+        InterestWrite = 0x02,
+        InterestEdge = 0x04
+    };
+
+    // Readiness reported by wait (can be OR-ed).
+    enum
+    {
+        ReadyIn = 0x01,
+        ReadyOut = 0x02,
+        ReadyHup = 0x04,
+        ReadyErr = 0x08,
+        ReadySent = 0x10,    // A send has been done (see send).
+        ReadyReceived = 0x20 // A receive has been done (see receive).
+    };
+
+    // A ready Handle identified by the hint it has been registered with.
+    // ReadySent and ReadyReceived are reported on their own with the result
+    // (the amount of bytes or -errno) and the data received.
+    struct Event
+    {
+        int m_hint;
+        unsigned int m_ready;
+        int m_result;
+        const char *m_data;
+    };
+
+    typedef std::vector< Event > EventList;
+
+    // Hint reserved for the Handle used to wake a Reactor up.
+    static const int WAKEUP_HINT = -1;
+
+public:
+    virtual ~Demultiplexer() {}
+
+    // Starts watching the handle for the interest. Will throw on error.
+    virtual void add(int hint, Handle handle, unsigned int interest) = 0;
+
+    // Changes the interest for an already watched handle. Setting the same
+    // edge-triggered interest again re-arms reporting of the handle if it's
+    // still ready. Will throw on error.
+    virtual void modify(int hint, Handle handle, unsigned int interest) = 0;
+
+    // Stops watching the handle. A send or receive in flight is cancelled
+    // and the call returns once it's done with the data.
+    virtual void remove(int hint, Handle handle) = 0;
+
+    // Waits for events for up to timeout milliseconds (-1 - forever) and
+    // fills in ready (previous content is discarded). May return early with
+    // no events (e.g. if interrupted by a signal).
+    // Will throw on error.
+    virtual void wait(EventList &ready, int timeout) = 0;
+
+    // Returns true if the implementation can send (see send).
+    virtual bool canSend() const
+    {
+        return false;
+    }
+
+    // Queues sending of message on the watched handle (one send in flight
+    // per handle). The send is reported by one of the next waits and
+    // message (and the data) must stay intact until then. Will throw if not
+    // supported or on error.
+    virtual void send(int /*hint*/, Handle /*handle*/, const struct msghdr * /*message*/)
+    {
+        throw Exception(ENOSYS);
+    }
+
+    // Queues receiving into a buffer of the implementation (one receive in
+    // flight per handle). Returns false if not supported or no buffer is
+    // free. Otherwise the data is reported by one of the next waits and
+    // stays valid until the wait after. Will throw on error.
+    virtual bool receive(int /*hint*/, Handle /*handle*/)
+    {
+        return false;
+    }
+};
+
+/* PollDemultiplexer is a Demultiplexer which uses poll and an array of
+ * pollfd structures indexed by hint (offset by one to fit WAKEUP_HINT in).
+ * The array grows on demand. Cost of a wait is linear in the number of
+ * slots.
+ */
+class PollDemultiplexer : public Demultiplexer
+{
+public:
+    virtual void add(int hint, Handle handle, unsigned int interest);
+    virtual void modify(int hint, Handle handle, unsigned int interest);
+    virtual void remove(int hint, Handle handle);
+    virtual void wait(EventList &ready, int timeout);
+
+protected:
+    static size_t toIndex(int hint);
+    static short toPollEvents(unsigned int interest);
+
+protected:
+    std::vector< struct pollfd > m_pollfds;
+};
+
+/* EpollDemultiplexer is a Demultiplexer which uses Linux epoll. Cost of a
+ * wait is linear in the number of ready Handles only. Supports edge-triggered
+ * interest (EPOLLET).
+ */
+class EpollDemultiplexer : public Demultiplexer
+{
+public:
+    EpollDemultiplexer();
+    virtual ~EpollDemultiplexer();
+
+    virtual void add(int hint, Handle handle, unsigned int interest);
+    virtual void modify(int hint, Handle handle, unsigned int interest);
+    virtual void remove(int hint, Handle handle);
+    virtual void wait(EventList &ready, int timeout);
+
+    // Max amount of events returned by one wait.
+    static const int MAX_EVENTS = 256;
+
+protected:
+    void control(int op, int hint, Handle handle, unsigned int interest);
+
+protected:
+    int m_epollfd;
+    struct epoll_event m_events[MAX_EVENTS];
+};
+
+} // namespace followermaze
+
+#endif // DEMULTIPLEXER_H
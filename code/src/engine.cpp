@@ -13,19 +13,33 @@ namespace followermaze
 namespace protocol
 {
 
+const size_t Engine::MIN_PAYLOAD_CAPACITY;
+
 Engine::Engine() :
-    m_nextEventSeqnum(Parser::FIRST_SEQNUM)
+    m_nextEventSeqnum(Parser::FIRST_SEQNUM),
+    m_reactor(NULL),
+    m_notification(NULL)
 {
 }
 
 Engine::~Engine()
 {
+    if (m_notification != NULL)
+    {
+        m_notification->release();
+    }
+
     // Dispose of Events
     for (EventQueue::iterator it = m_events.begin(); it != m_events.end(); ++it)
     {
         delete *it;
     }
 
+    for (EventQueue::iterator it = m_freeEvents.begin(); it != m_freeEvents.end(); ++it)
+    {
+        delete *it;
+    }
+
     // Dispose of Users
     for (UserMap::iterator userIt = m_users.begin();
                            userIt != m_users.end();
@@ -37,37 +51,104 @@ Engine::~Engine()
     }
 }
 
+void Engine::handleEvents(Buffer &events)
+{
+    events.consume(parseEvents(events.data(), events.size(), NULL));
+    processEvents();
+}
+
 void Engine::handleEvents(string& events)
 {
-    // Parse all the messages and push valid events into the queue.
-    size_t start = 0;
-    string message;
-    while (Parser::findMessage(events, start, message))
+    // Return the remainder which is not a message so the caller has a chance
+    // to complete the message and try again.
+    events.erase(0, parseEvents(events.data(), events.length(), NULL));
+    processEvents();
+}
+
+void Engine::handleEvents(Buffer &events, Framer &framer)
+{
+    events.consume(parseEvents(events.data(), events.size(), &framer));
+    processEvents();
+}
+
+size_t Engine::parseEvents(const char *data, size_t size, Framer *framer)
+{
+    // Find the complete messages (a framer doesn't scan the data it has
+    // scanned before again), parse them in place and push valid events into
+    // the queue. Only the payload of a valid event is copied.
+    m_messages.clear();
+    size_t consumed = framer != NULL ? framer->frame(data, size, m_messages) :
+                                       Parser::findMessages(data, size, m_messages);
+
+    for (SpanList::const_iterator it = m_messages.begin(); it != m_messages.end(); ++it)
     {
-        auto_ptr<Event> event(new Event);
-        event->m_payload = message;
+        const char *message = data + it->m_offset;
+        size_t length = it->m_length;
 
-        Parser::parseEvent(*event);
+        Event *event = allocateEvent();
+        Parser::parseEvent(*event, message, length);
 
-        if (Parser::isValidEvent(*event))
+        if (!Parser::isValidEvent(*event))
         {
-            m_events.push_back(event.get());
-            event.release();
+            recycleEvent(event);
+            continue;
         }
-    }
 
-    if (start != string::npos)
-    {
-        // Remainder of the input string is not a message. Return it so the
-        // caller has a chance to complete the message and try again.
-        events = events.substr(start);
+        // Leave room for encoding the notification in place. Reused payloads
+        // are kept large enough for common events to avoid regrowing them as
+        // the sequence numbers get longer.
+        event->m_payload.reserve(length + 1 > MIN_PAYLOAD_CAPACITY ? length + 1 : MIN_PAYLOAD_CAPACITY);
+        event->m_payload.assign(message, length);
+        m_events.push_back(event);
     }
-    else
+
+    return consumed;
+}
+
+bool Engine::handleRecords(Buffer &records)
+{
+    bool valid = true;
+    records.consume(parseRecords(records.data(), records.size(), valid));
+    processEvents();
+    return valid;
+}
+
+size_t Engine::parseRecords(const char *data, size_t size, bool &valid)
+{
+    m_messages.clear();
+    size_t consumed = Parser::findRecords(data, size, m_messages);
+
+    for (SpanList::const_iterator it = m_messages.begin(); it != m_messages.end(); ++it)
     {
-        // All events consumed.
-        events.clear();
+        Event *event = allocateEvent();
+        size_t length = Parser::parseRecord(*event, data + it->m_offset, it->m_length);
+
+        if (!Parser::isValidEvent(*event))
+        {
+            recycleEvent(event);
+            continue;
+        }
+
+        // The notification has to be the original text, so the formatted
+        // payload must match its length at least. Dropping the event would
+        // stall the sequence for good. The payload is left empty and
+        // formatted only if the event notifies someone (see notifyUser).
+        if (Parser::getPayloadLength(*event) != length)
+        {
+            recycleEvent(event);
+            valid = false;
+            return it->m_offset - Parser::RECORD_PREFIX_LENGTH;
+        }
+        event->m_payload.reserve(length + 1 > MIN_PAYLOAD_CAPACITY ? length + 1 : MIN_PAYLOAD_CAPACITY);
+
+        m_events.push_back(event);
     }
 
+    return consumed;
+}
+
+void Engine::processEvents()
+{
     SortEventQueue(m_events);
 
     // Process events in order starting with Parser::FIRST_SEQNUM.
@@ -97,41 +178,63 @@ void Engine::handleEvents(string& events)
             assert(0);
         }
 
+        if (m_notification != NULL)
+        {
+            m_notification->release();
+            m_notification = NULL;
+        }
+
         m_events.pop_back();
         m_nextEventSeqnum++;
-        delete event;
+        recycleEvent(event);
     }
 }
 
+Event *Engine::allocateEvent()
+{
+    if (m_freeEvents.empty())
+    {
+        return new Event;
+    }
+
+    Event *event = m_freeEvents.back();
+    m_freeEvents.pop_back();
+    return event;
+}
+
+void Engine::recycleEvent(Event *event)
+{
+    event->m_payload.clear();
+    m_freeEvents.push_back(event);
+}
+
 long Engine::registerUser(UserClient *userClient, const string& in)
 {
-    // Add client to an existing user or create new user.
-    string message;
-    size_t start = 0;
-    if (Parser::findMessage(in, start, message))
+    long id = Parser::parseUserId(in);
+    if (id != Parser::INVALID_LONG)
     {
-        long id = Parser::parseLong(message);
-        if (id != Parser::INVALID_LONG)
-        {
-            User *user = NULL;
-            UserMap::const_iterator userIt = m_users.find(id);
-            if (userIt != m_users.end())
-            {
-                user = userIt->second;
-            }
-            else
-            {
-                // Fisrt time. Create User.
-                user = addNewUser(id);
-            }
+        registerUser(userClient, id);
+    }
 
-            user->m_clients.push_back(userClient);
-        }
+    return id;
+}
 
-        return id;
+void Engine::registerUser(UserClient *userClient, long id)
+{
+    // Add client to an existing user or create new user.
+    User *user = NULL;
+    UserMap::const_iterator userIt = m_users.find(id);
+    if (userIt != m_users.end())
+    {
+        user = userIt->second;
+    }
+    else
+    {
+        // Fisrt time. Create User.
+        user = addNewUser(id);
     }
 
-    return Parser::INVALID_LONG;
+    user->m_clients.push_back(userClient);
 }
 
 void Engine::unregisterUser(long id, UserClient *userClient)
@@ -164,12 +267,12 @@ void Engine::unregisterUser(long id, UserClient *userClient)
 
 void Engine::resetEventQueue()
 {
-    // Dispose of Events.
-    // Dispose of Events
+    // Keep the Events for reuse.
     for (EventQueue::iterator it = m_events.begin(); it != m_events.end(); ++it)
     {
-        delete *it;
+        recycleEvent(*it);
     }
+    m_events.clear();
 
     // Reset the expected event to process.
     m_nextEventSeqnum = Parser::FIRST_SEQNUM;
@@ -199,7 +302,17 @@ void Engine::resetEventQueue()
     }
 }
 
-void Engine::handleFollow(const Event& event)
+void Engine::setReactor(Reactor *reactor)
+{
+    m_reactor = reactor;
+}
+
+Reactor *Engine::getReactor() const
+{
+    return m_reactor;
+}
+
+void Engine::handleFollow(Event& event)
 {
     // Notify toUser and make fromUser a follower of toUser.
     // Register toUser and fromUser if required to register the
@@ -213,7 +326,7 @@ void Engine::handleFollow(const Event& event)
     else
     {
         toUser = userIt->second;
-        notifyUser(toUser, event.m_payload);
+        notifyUser(toUser, event);
     }
 
     User *fromUser = NULL;
@@ -231,7 +344,7 @@ void Engine::handleFollow(const Event& event)
     fromUser->m_followees.insert(UserMap::value_type(event.m_toUserId, toUser));
 }
 
-void Engine::handleUnfollow(const Event& event)
+void Engine::handleUnfollow(Event& event)
 {
     // Make fromUser not to follow toUser anymore.
     UserMap::iterator toUserIt = m_users.find(event.m_toUserId);
@@ -265,28 +378,28 @@ void Engine::handleUnfollow(const Event& event)
     }
 }
 
-void Engine::handleBroadcast(const Event& event)
+void Engine::handleBroadcast(Event& event)
 {
     // Notify all connected clients for all Users.
     for (UserMap::const_iterator userIt = m_users.begin();
                                  userIt != m_users.end();
                                  ++userIt)
     {
-        notifyUser(userIt->second, event.m_payload);
+        notifyUser(userIt->second, event);
     }
 }
 
-void Engine::handlePrivate(const Event& event)
+void Engine::handlePrivate(Event& event)
 {
     // Notify toUser
     UserMap::iterator userIt = m_users.find(event.m_toUserId);
     if (userIt != m_users.end())
     {
-        notifyUser(userIt->second, event.m_payload);
+        notifyUser(userIt->second, event);
     }
 }
 
-void Engine::handleStatusUpdate(const Event& event)
+void Engine::handleStatusUpdate(Event& event)
 {
     // Notify fromUser's followers.
     UserMap::const_iterator userIt = m_users.find(event.m_fromUserId);
@@ -299,7 +412,7 @@ void Engine::handleStatusUpdate(const Event& event)
                                      followerIt != fromUser->m_followers.end();
                                      ++followerIt)
         {
-            notifyUser(followerIt->second, event.m_payload);
+            notifyUser(followerIt->second, event);
         }
     }
 }
@@ -312,18 +425,33 @@ User* Engine::addNewUser(long id)
     return newUser.release();
 }
 
-void Engine::notifyUser(User *user, const string &payload)
+void Engine::notifyUser(User *user, Event &event)
 {
     assert(user != NULL);
 
-    string message;
-    Parser::encodeMessage(payload, message);
+    if (user->m_clients.empty())
+    {
+        return;
+    }
+
+    // The event is done with once processed so the notification takes over
+    // its payload. All the clients share it.
+    if (m_notification == NULL)
+    {
+        if (event.m_payload.empty())
+        {
+            // Parsed from a binary record.
+            Parser::formatPayload(event, event.m_payload);
+        }
+        Parser::encodeMessage(event.m_payload);
+        m_notification = Message::create(event.m_payload);
+    }
 
     for (ClientList::const_iterator clientIt = user->m_clients.begin();
                                     clientIt != user->m_clients.end();
                                     ++clientIt)
     {
-        (*clientIt)->send(message);
+        (*clientIt)->send(m_notification);
     }
 }
 
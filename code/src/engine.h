@@ -18,7 +18,15 @@ namespace protocol
  * events according to the rules specified by the protocol.
  * Events are processed in batches. A batch gets sorted to ensure that the
  * users will get events in correct order.
- * Events can generate notifications which are delivered to the users.
+ * Events can generate notifications which are delivered to the users. The
+ * notification of an event is encoded once (taking over the payload of the
+ * event) and the same Message is shared by all the recipients.
+ * Processed Events are kept in a free list and reused with the storage of
+ * their payload, and notifications reuse released Messages (see
+ * Message::create), so the steady state takes no heap allocations per event.
+ * Engine is not thread safe. If Engine is used by clients handled by other
+ * Reactors (threads) it must be bound to the Reactor whose thread uses it so
+ * the clients can post their requests to it (see UserClient).
  */
 class Engine
 {
@@ -26,14 +34,32 @@ public:
     Engine();
     virtual ~Engine();
 
-    // Parses events, sorts them, processes in order.
+    // Parses the complete (CRLF terminated) events in place, sorts them,
+    // processes in order. The incomplete remainder is left in events, and
+    // the next call is expected to get it back with the new data appended.
+    void handleEvents(Buffer &events);
     void handleEvents(string &events);
 
+    // Same as above, but the remainder is not scanned again: framer keeps
+    // the state of the stream events come from (one per stream, see
+    // EventSource).
+    void handleEvents(Buffer &events, Framer &framer);
+
+    // Same as above for binary records (see Parser::findRecords). The
+    // payload of an event is formatted from the record when it's notified.
+    // Returns false if a record can't be notified as the original text (the
+    // formatted payload wouldn't be as long): it's a protocol error, and the
+    // record and the rest of the data are left in records.
+    bool handleRecords(Buffer &records);
+
     // Register the userClient to represent a user identified by
     // content of in.
     // Returns user ID if successful, Parser::INVALID_LONG otherwise.
     long registerUser(UserClient *userClient, const string &in);
 
+    // Register the userClient to represent a user identified by the id.
+    void registerUser(UserClient *userClient, long id);
+
     // Unregister the userClient for the user identified by the id.
     void unregisterUser(long id, UserClient *userClient);
 
@@ -41,27 +67,56 @@ public:
     // ready to start again. Doesn't affect registered users.
     void resetEventQueue();
 
+    // Binds the Engine to the Reactor whose thread uses the Engine.
+    void setReactor(Reactor *reactor);
+
+    // Returns the Reactor the Engine is bound to (NULL if not bound).
+    Reactor *getReactor() const;
+
 protected:
+    // Storage reserved for the payload of an Event at least.
+    static const size_t MIN_PAYLOAD_CAPACITY = 64;
+
+    // Parses the messages in size bytes of data and queues the valid events.
+    // Returns the amount of bytes consumed (complete messages). The data is
+    // scanned by framer if any, or all of it otherwise.
+    size_t parseEvents(const char *data, size_t size, Framer *framer);
+
+    // Same as above for binary records. Stops at a record which can't be
+    // notified as the original text (valid is set to false then).
+    size_t parseRecords(const char *data, size_t size, bool &valid);
+
+    // Sorts the queued events and processes them in order.
+    void processEvents();
+
+    // Returns an Event from the free list (or a new one if it is empty).
+    Event *allocateEvent();
+
+    // Puts the processed (or invalid) event into the free list.
+    void recycleEvent(Event *event);
+
     // Handle "Follow" event
-    void handleFollow(const Event& event);
+    void handleFollow(Event& event);
 
     // Handle "Unfollow" event
-    void handleUnfollow(const Event& event);
+    void handleUnfollow(Event& event);
 
     // Handle "Broadcast" event
-    void handleBroadcast(const Event& event);
+    void handleBroadcast(Event& event);
 
     // Handle "Private" event
-    void handlePrivate(const Event& event);
+    void handlePrivate(Event& event);
 
     // Handle "StatusUpdate" event
-    void handleStatusUpdate(const Event& event);
+    void handleStatusUpdate(Event& event);
 
     // Helper function which creates a new user and adds it to the m_users.
     User* addNewUser(long id);
 
-    // Helper function which sends a message to all the registered clients.
-    void notifyUser(User *user, const string &payload);
+    // Helper function which sends the notification of the event to all the
+    // registered clients of the user. The notification is created on first
+    // use and kept in m_notification until the event has been processed.
+    void notifyUser(User *user, Event &event);
 
     // Returns true if user has no clients, no followers, and no followees.
     bool isBlankUser(const User& user);
@@ -69,7 +124,11 @@ protected:
 protected:
     UserMap m_users;
     EventQueue m_events;
+    EventQueue m_freeEvents; // Processed Events kept for reuse.
+    SpanList m_messages;     // Of the data being parsed.
     long m_nextEventSeqnum;
+    Reactor *m_reactor;
+    Message *m_notification; // Of the event being processed (NULL if none).
 };
 
 } // namespace protocol
@@ -23,6 +23,13 @@ public:
     // Return Handle associated with this EventHandler.
     virtual Handle getHandle() = 0;
 
+    // Returns name of the kind of handler (a string literal). Used to
+    // collect statistics per kind.
+    virtual const char *getCategory() const
+    {
+        return "EventHandler";
+    }
+
     // Called if input is available on the Handle.
     // hint should be passed to methods of Reactor.
     virtual void handleInput(int /*hint*/)
@@ -52,6 +59,21 @@ public:
     virtual void handleError(int /*hint*/)
     {
     }
+
+    // Called when a send queued by Reactor::send is done. result is the
+    // amount of bytes sent or -errno.
+    // hint should be passed to methods of Reactor.
+    virtual void handleSent(int /*hint*/, int /*result*/)
+    {
+    }
+
+    // Called when a receive queued by Reactor::receive is done. result is
+    // the amount of bytes received (0 if the Handle has been closed) or
+    // -errno. data is valid during the call only.
+    // hint should be passed to methods of Reactor.
+    virtual void handleReceived(int /*hint*/, const char * /*data*/, int /*result*/)
+    {
+    }
 };
 
 class Reactor;
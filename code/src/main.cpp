@@ -1,4 +1,5 @@
 #include <iostream>
+#include <vector>
 #include <stdlib.h>
 #include "server.h"
 #include "acceptor.h"
@@ -8,7 +9,15 @@
 
 using namespace followermaze;
 
-// SimpleServer is a simple single threaded Reactor based server with CLI.
+#ifdef FOLLOWERMAZE_USE_EPOLL
+#define DEFAULT_BACKEND_NAME "epoll"
+#else
+#define DEFAULT_BACKEND_NAME "poll"
+#endif
+
+// SimpleServer is a simple Reactor based server with CLI. The Engine and the
+// event source are handled by the main thread. User clients can be handled by
+// the main thread or spread between worker threads.
 class SimpleServer : public Server
 {
 public:
@@ -20,63 +29,283 @@ public:
         static const int ADMIN_PORT = 9999;
         static const int DEFAULT_EVENT_PORT = 9090;
         static const int DEFAULT_USER_PORT = 9099;
+        static const int MAX_USER_REACTORS = 256;
 
     public:
         Config(int argc, char *argv[]) :
             m_stop(false),
+            m_stats(false),
             m_help(false),
             m_valid(false),
             m_adminPort(ADMIN_PORT),
             m_eventPort(DEFAULT_EVENT_PORT),
-            m_userPort(DEFAULT_USER_PORT)
+            m_userPort(DEFAULT_USER_PORT),
+            m_eventListen(false),
+            m_userListen(false),
+            m_backend(Reactor::BackendDefault),
+            m_userBacklog(Connection::DEFAULT_BACKLOG),
+            m_acceptLimit(Acceptor::DEFAULT_ACCEPT_LIMIT),
+            m_userReactors(0),
+            m_readBudget(Client::DEFAULT_READ_BUDGET),
+            m_outputLimit(OutputBudget::DEFAULT_CLIENT_LIMIT),
+            m_outputTotal(OutputBudget::DEFAULT_TOTAL_LIMIT),
+            m_slowConsumerPolicy(OutputBudget::PolicyDisconnect)
         {
-            if (argc > 3)
+            // Notifications are small and should be delivered right away.
+            m_userSocket.m_noDelay = true;
+
+            // Separate options (--name=value) from the positional arguments.
+            vector< string > args;
+            for (int i = 1; i < argc; ++i)
+            {
+                string arg(argv[i]);
+                if (arg.compare(0, 2, "--") == 0 && arg.compare("--help") != 0)
+                {
+                    if (!parseOption(arg))
+                    {
+                        return;
+                    }
+                }
+                else
+                {
+                    args.push_back(arg);
+                }
+            }
+
+            if (args.size() > 2)
             {
                 m_help = true;
                 return;
             }
 
-            if (argc == 2)
+            if (args.size() == 1)
             {
                 // We've got a command
-                if (string("-h").compare(argv[1]) == 0 ||
-                    string("--help").compare(argv[1]) == 0)
+                if (args[0].compare("-h") == 0 ||
+                    args[0].compare("--help") == 0)
                 {
                     m_help = true;
                 }
-                else if (string("stop").compare(argv[1]) == 0)
+                else if (args[0].compare("stop") == 0)
                 {
                     m_stop = true;
                 }
+                else if (args[0].compare("stats") == 0)
+                {
+                    m_stats = true;
+                }
                 else
                 {
-                    Logger::getInstance().error("Invalid command: ", argv[1]);
+                    Logger::getInstance().error("Invalid command: ", args[0]);
                     return;
                 }
             }
-            else if (argc == 3)
+            else if (args.size() == 2)
             {
-                // We've got options
-                m_eventPort = protocol::Parser::parseLong(argv[1]);
+                // We've got ports
+                m_eventPort = protocol::Parser::parseLong(args[0]);
                 if (m_eventPort == protocol::Parser::INVALID_LONG || m_eventPort <= 1024 || m_eventPort > 65535)
                 {
-                    Logger::getInstance().error("Invalid event_source_port: ", argv[1]);
+                    Logger::getInstance().error("Invalid event_source_port: ", args[0]);
                     return;
                 }
 
-                m_userPort = protocol::Parser::parseLong(argv[2]);
+                m_userPort = protocol::Parser::parseLong(args[1]);
                 if (m_userPort == protocol::Parser::INVALID_LONG || m_userPort <= 1024 || m_userPort > 65535)
                 {
-                    Logger::getInstance().error("Invalid user_client_port: ", argv[2]);
+                    Logger::getInstance().error("Invalid user_client_port: ", args[1]);
                     return;
                 }
             }
 
+            // Listen on the ports unless given the addresses.
+            if (!m_eventListen)
+            {
+                m_eventAddress = SocketAddress(m_eventPort);
+            }
+            if (!m_userListen)
+            {
+                m_userAddress = SocketAddress(m_userPort);
+            }
+
+            // Every user reactor needs a listener of its own.
+            if (m_userAddress.m_family == SocketAddress::FamilyUnix && m_userReactors > 0)
+            {
+                Logger::getInstance().error("Invalid user-listen with reactors: ", m_userAddress.toString());
+                return;
+            }
+
             m_valid = true;
         }
 
+    protected:
+        // Parses an option (--name=value). Returns false if invalid.
+        bool parseOption(const string &arg)
+        {
+            size_t pos = arg.find('=');
+            string name = arg.substr(2, pos == string::npos ? string::npos : pos - 2);
+            string value = pos == string::npos ? "" : arg.substr(pos + 1);
+
+            if (name.compare("reactor") == 0)
+            {
+                if (value.compare(Reactor::getBackendName(Reactor::BackendPoll)) == 0)
+                {
+                    m_backend = Reactor::BackendPoll;
+                }
+                else if (value.compare(Reactor::getBackendName(Reactor::BackendEpoll)) == 0)
+                {
+                    m_backend = Reactor::BackendEpoll;
+                }
+                else if (value.compare(Reactor::getBackendName(Reactor::BackendUring)) == 0)
+                {
+                    m_backend = Reactor::BackendUring;
+                }
+                else
+                {
+                    Logger::getInstance().error("Invalid reactor: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("backlog") == 0)
+            {
+                m_userBacklog = protocol::Parser::parseLong(value);
+                if (m_userBacklog == protocol::Parser::INVALID_LONG || m_userBacklog < 0)
+                {
+                    Logger::getInstance().error("Invalid backlog: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("event-listen") == 0 || name.compare("user-listen") == 0)
+            {
+                bool events = name.compare("event-listen") == 0;
+                if (!SocketAddress::parse(value, events ? m_eventAddress : m_userAddress))
+                {
+                    Logger::getInstance().error("Invalid " + name + ": ", value);
+                    return false;
+                }
+
+                (events ? m_eventListen : m_userListen) = true;
+                return true;
+            }
+
+            if (name.compare("accept-limit") == 0)
+            {
+                m_acceptLimit = protocol::Parser::parseLong(value);
+                if (m_acceptLimit == protocol::Parser::INVALID_LONG || m_acceptLimit <= 0)
+                {
+                    Logger::getInstance().error("Invalid accept-limit: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("reactors") == 0)
+            {
+                m_userReactors = value.compare("0") == 0 ? 0 : protocol::Parser::parseLong(value);
+                if (m_userReactors == protocol::Parser::INVALID_LONG || m_userReactors < 0 || m_userReactors > MAX_USER_REACTORS)
+                {
+                    Logger::getInstance().error("Invalid reactors: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("read-budget") == 0)
+            {
+                m_readBudget = protocol::Parser::parseLong(value);
+                if (m_readBudget == protocol::Parser::INVALID_LONG || m_readBudget <= 0)
+                {
+                    Logger::getInstance().error("Invalid read-budget: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("output-limit") == 0)
+            {
+                m_outputLimit = protocol::Parser::parseLong(value);
+                if (m_outputLimit == protocol::Parser::INVALID_LONG || m_outputLimit <= 0)
+                {
+                    Logger::getInstance().error("Invalid output-limit: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("output-total") == 0)
+            {
+                m_outputTotal = protocol::Parser::parseLong(value);
+                if (m_outputTotal == protocol::Parser::INVALID_LONG || m_outputTotal <= 0)
+                {
+                    Logger::getInstance().error("Invalid output-total: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("event-socket") == 0)
+            {
+                if (!SocketProfile::parse(value, m_eventSocket))
+                {
+                    Logger::getInstance().error("Invalid event-socket: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("user-socket") == 0)
+            {
+                if (!SocketProfile::parse(value, m_userSocket))
+                {
+                    Logger::getInstance().error("Invalid user-socket: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (name.compare("slow-consumer") == 0)
+            {
+                if (value.compare(OutputBudget::getPolicyName(OutputBudget::PolicyDisconnect)) == 0)
+                {
+                    m_slowConsumerPolicy = OutputBudget::PolicyDisconnect;
+                }
+                else if (value.compare(OutputBudget::getPolicyName(OutputBudget::PolicyDropOldest)) == 0)
+                {
+                    m_slowConsumerPolicy = OutputBudget::PolicyDropOldest;
+                }
+                else if (value.compare(OutputBudget::getPolicyName(OutputBudget::PolicyPause)) == 0)
+                {
+                    m_slowConsumerPolicy = OutputBudget::PolicyPause;
+                }
+                else
+                {
+                    Logger::getInstance().error("Invalid slow-consumer: ", value);
+                    return false;
+                }
+
+                return true;
+            }
+
+            Logger::getInstance().error("Invalid option: ", arg);
+            return false;
+        }
+
     public:
         bool m_stop;
+        bool m_stats;
         bool m_help;
         bool m_valid;
 
@@ -84,34 +313,88 @@ public:
         int m_adminPort;
         int m_eventPort;
         int m_userPort;
+        SocketAddress m_eventAddress;
+        SocketAddress m_userAddress;
+        bool m_eventListen; // m_eventAddress given.
+        bool m_userListen;  // m_userAddress given.
+        Reactor::Backend m_backend;
+        int m_userBacklog;
+        int m_acceptLimit;
+        int m_userReactors;
+        long m_readBudget;
+        long m_outputLimit;
+        long m_outputTotal;
+        OutputBudget::Policy m_slowConsumerPolicy;
+        SocketProfile m_eventSocket;
+        SocketProfile m_userSocket;
     };
 
     SimpleServer(const Config& config) :
+        Server(config.m_backend, config.m_userReactors),
         m_config(config),
+        m_outputBudget(config.m_outputLimit, config.m_outputTotal, config.m_slowConsumerPolicy),
+        m_userAccepts("users"),
         m_eventSourceFactory(m_engine),
         m_userClientFactory(m_engine)
     {
+        // User clients handled by the workers need to know where the Engine
+        // runs.
+        m_engine.setReactor(&m_reactor);
+        m_eventSourceFactory.setReadBudget(config.m_readBudget);
+        m_adminFactory.setReactors(&getReactors());
+        m_adminFactory.setReportedBudget(&m_outputBudget);
+        m_adminFactory.setReportedAccepts(&m_userAccepts);
+        m_userClientFactory.setOutputBudget(&m_outputBudget);
     }
 
     virtual void initReactor()
     {
+        Logger::getInstance().info("Using reactor backend: ", Reactor::getBackendName(m_reactor.getBackend()));
+
         auto_ptr<EventHandler> adminAcceptor(new Acceptor(m_config.m_adminPort, m_reactor, m_adminFactory));
         m_reactor.addHandler(adminAcceptor, Reactor::EvntAccept);
         Logger::getInstance().info("Listening for admins on port ", m_config.m_adminPort);
 
-        auto_ptr<EventHandler> eventAcceptor(new Acceptor(m_config.m_eventPort, m_reactor, m_eventSourceFactory));
+        // The event source is drained on every wakeup (up to the read budget).
+        Acceptor *acceptor = new Acceptor(m_config.m_eventAddress, m_reactor, m_eventSourceFactory);
+        auto_ptr<EventHandler> eventAcceptor(acceptor);
+        acceptor->setClientEvent(Reactor::EvntRead | Reactor::EvntEdge);
+        acceptor->setSocketProfile(m_config.m_eventSocket);
         m_reactor.addHandler(eventAcceptor, Reactor::EvntAccept);
-        Logger::getInstance().info("Listening for events on port ", m_config.m_eventPort);
+        Logger::getInstance().info("Listening for events on ", m_config.m_eventAddress.toString());
 
-        auto_ptr<EventHandler> userAcceptor(new Acceptor(m_config.m_userPort, m_reactor, m_userClientFactory));
-        m_reactor.addHandler(userAcceptor, Reactor::EvntAccept);
-        Logger::getInstance().info("Listening for users on port ", m_config.m_userPort);
+        if (m_workers.empty())
+        {
+            Acceptor *acceptor = new Acceptor(m_config.m_userAddress, m_reactor, m_userClientFactory, m_config.m_userBacklog);
+            auto_ptr<EventHandler> userAcceptor(acceptor);
+            acceptor->setSocketProfile(m_config.m_userSocket);
+            acceptor->setAcceptLimit(m_config.m_acceptLimit);
+            acceptor->setStats(&m_userAccepts);
+            m_reactor.addHandler(userAcceptor, Reactor::EvntAccept);
+            Logger::getInstance().info("Listening for users on ", m_config.m_userAddress.toString());
+        }
+    }
+
+    virtual void initWorker(Reactor &reactor, int index)
+    {
+        // Each worker listens on the user port. The kernel balances the users
+        // between them.
+        Acceptor *acceptor = new Acceptor(m_config.m_userAddress, reactor, m_userClientFactory, m_config.m_userBacklog, true);
+        auto_ptr<EventHandler> userAcceptor(acceptor);
+        acceptor->setSocketProfile(m_config.m_userSocket);
+        acceptor->setAcceptLimit(m_config.m_acceptLimit);
+        acceptor->setStats(&m_userAccepts);
+        reactor.addHandler(userAcceptor, Reactor::EvntAccept);
+        Logger::getInstance().info("Listening for users on ", m_config.m_userAddress.toString());
+        Logger::getInstance().debug("Started user reactor ", index);
     }
 
 protected:
     Config  m_config;
+    OutputBudget m_outputBudget;
+    AcceptStats m_userAccepts;
     protocol::Engine m_engine;
-    ClientFactory<Admin> m_adminFactory;
+    AdminFactory m_adminFactory;
     protocol::EngineDrivenClientFactory<protocol::EventSource> m_eventSourceFactory;
     protocol::EngineDrivenClientFactory<protocol::UserClient> m_userClientFactory;
 };
@@ -125,14 +408,33 @@ int main(int argc, char *argv[])
         static const char *usage = "followermaze is a server which expects event source and user clients on given ports.\n" \
                                    "Port 9999 is reserved.\n" \
                                    "Usage(1): followermaze -h|--help\n" \
-                                   "Usage(2): followermaze [event_source_port user_client_port]\n" \
-                                   "Usage(3): followermaze stop\n" \
+                                   "Usage(2): followermaze [options] [event_source_port user_client_port]\n" \
+                                   "Usage(3): followermaze stop|stats\n" \
                                    "Options:\n" \
                                    "  -h, --help - print usage\n" \
                                    "  event_source_port - port to expect the event source on. Default 9090.\n" \
                                    "  user_client_port - port to expect the user clients on. Default 9099.\n" \
+                                   "  --reactor=poll|epoll|io_uring - event demultiplexing backend. Default " DEFAULT_BACKEND_NAME ".\n" \
+                                   "    io_uring falls back to epoll if not supported by the kernel.\n" \
+                                   "  --backlog=N - max length of the queue of user clients waiting to be accepted.\n" \
+                                   "  --event-listen=SPEC, --user-listen=SPEC - addresses to listen on instead of the\n" \
+                                   "    ports. SPEC is [tcp4:][HOST:]PORT, tcp6:[[HOST]:]PORT, or unix:PATH (users only\n" \
+                                   "    without --reactors).\n" \
+                                   "  --accept-limit=N - max number of user clients accepted per wakeup. Default 256.\n" \
+                                   "  --reactors=N - number of threads (each with own reactor) to handle user clients.\n" \
+                                   "    Default 0 (user clients are handled by the main thread).\n" \
+                                   "  --read-budget=BYTES - max amount of bytes received from the event source per wakeup.\n" \
+                                   "  --output-limit=BYTES - max amount of bytes queued for a user client. Default 64 MiB.\n" \
+                                   "  --output-total=BYTES - max amount of bytes queued for all user clients. Default 1 GiB.\n" \
+                                   "  --slow-consumer=disconnect|drop-oldest|pause - what to do with a user client\n" \
+                                   "    exceeding the limits. Default disconnect.\n" \
+                                   "  --event-socket=SPEC, --user-socket=SPEC - socket options of the event source and\n" \
+                                   "    the user clients. SPEC is \"default\" or a comma separated list of: nodelay, cork,\n" \
+                                   "    sndbuf=BYTES, rcvbuf=BYTES, busy-poll=USEC, zerocopy=BYTES (min batch sent without\n" \
+                                   "    copying). Defaults: default, nodelay.\n" \
                                    "Commands:\n"
-                                   "  stop - stops the server\n";
+                                   "  stop - stops the server\n"
+                                   "  stats - prints event loop statistics of the server (times in microseconds)\n";
         cout << usage;
         return config.m_valid ? 0 : 1;
     }
@@ -148,6 +450,23 @@ int main(int argc, char *argv[])
         return system(STOP_COMMAND);
     }
 
+    if (config.m_stats)
+    {
+        static const char *STATS_COMMAND = "echo stats | nc -w 1 localhost 9999";
+        return system(STATS_COMMAND);
+    }
+
+    try
+    {
+        // Allow as many clients as the system permits.
+        long handleLimit = Connection::raiseHandleLimit();
+        Logger::getInstance().info("Max open files: ", static_cast<int>(handleLimit));
+    }
+    catch (BaseException &e)
+    {
+        Logger::getInstance().error("Failed to raise max open files. Error: ", e.what(), e.getErr());
+    }
+
     try
     {
         SimpleServer server(config);
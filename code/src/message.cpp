@@ -0,0 +1,277 @@
+#include <assert.h>
+#include "message.h"
+
+namespace followermaze
+{
+
+SpinLock Message::m_recycleLock;
+Message *Message::m_recycled[MAX_RECYCLED];
+size_t Message::m_recycledCount = 0;
+unsigned long Message::m_reuses = 0;
+
+Message::Message(const char *data, size_t length) :
+    m_data(data, length),
+    m_refs(1),
+    m_recyclable(false)
+{
+}
+
+Message::Message(string &data) :
+    m_refs(1),
+    m_recyclable(false)
+{
+    m_data.swap(data);
+}
+
+Message *Message::create(string &data)
+{
+    Message *message = NULL;
+    m_recycleLock.lock();
+    if (m_recycledCount > 0)
+    {
+        message = m_recycled[--m_recycledCount];
+    }
+    m_recycleLock.unlock();
+
+    if (message == NULL)
+    {
+        message = new Message(data);
+        message->m_recyclable = true;
+        return message;
+    }
+
+    __atomic_add_fetch(&m_reuses, 1, __ATOMIC_RELAXED);
+    message->m_refs = 1;
+    message->m_data.swap(data);
+    return message;
+}
+
+unsigned long Message::getReuses()
+{
+    return __atomic_load_n(&m_reuses, __ATOMIC_RELAXED);
+}
+
+bool Message::recycle(Message *message)
+{
+    if (message->m_data.capacity() > MAX_RECYCLED_CAPACITY)
+    {
+        return false;
+    }
+
+    message->m_data.clear();
+
+    bool kept = false;
+    m_recycleLock.lock();
+    if (m_recycledCount < MAX_RECYCLED)
+    {
+        m_recycled[m_recycledCount++] = message;
+        kept = true;
+    }
+    m_recycleLock.unlock();
+
+    return kept;
+}
+
+Message::~Message()
+{
+}
+
+void Message::acquire()
+{
+    __atomic_add_fetch(&m_refs, 1, __ATOMIC_RELAXED);
+}
+
+void Message::release()
+{
+    if (__atomic_sub_fetch(&m_refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (!m_recyclable || !recycle(this))
+        {
+            delete this;
+        }
+    }
+}
+
+const char *Message::data() const
+{
+    return m_data.data();
+}
+
+size_t Message::size() const
+{
+    return m_data.size();
+}
+
+/*----------------------------------------------------------------------------*/
+
+MessageQueue::MessageQueue() :
+    m_head(0),
+    m_count(0),
+    m_offset(0),
+    m_size(0)
+{
+}
+
+MessageQueue::~MessageQueue()
+{
+    clear();
+}
+
+void MessageQueue::push(Message *message)
+{
+    assert(message != NULL);
+
+    if (message->size() == 0)
+    {
+        // Nothing to send.
+        return;
+    }
+
+    if (m_count == m_ring.size())
+    {
+        // Grow and unwrap the ring.
+        vector< Message* > ring(m_ring.empty() ? static_cast<size_t>(MIN_CAPACITY) : 2 * m_ring.size());
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            ring[i] = at(i);
+        }
+        m_ring.swap(ring);
+        m_head = 0;
+    }
+
+    message->acquire();
+    at(m_count++) = message;
+    m_size += message->size();
+}
+
+int MessageQueue::gather(struct iovec *iov, int max, Message **held) const
+{
+    int count = 0;
+    size_t offset = m_offset;
+    for (size_t i = 0; i < m_count && count < max; ++i)
+    {
+        Message *message = at(i);
+        iov[count].iov_base = const_cast<char*>(message->data() + offset);
+        iov[count].iov_len = message->size() - offset;
+        if (held != NULL)
+        {
+            message->acquire();
+            held[count] = message;
+        }
+        offset = 0;
+        ++count;
+    }
+
+    return count;
+}
+
+void MessageQueue::retain(size_t length, vector< Message* > &held) const
+{
+    assert(length <= m_size);
+    length += m_offset;
+
+    for (size_t i = 0; i < m_count && length > 0; ++i)
+    {
+        Message *message = at(i);
+        message->acquire();
+        held.push_back(message);
+        length -= length < message->size() ? length : message->size();
+    }
+}
+
+void MessageQueue::consume(size_t length)
+{
+    assert(length <= m_size);
+    m_size -= length;
+    length += m_offset;
+
+    size_t count = 0;
+    while (count < m_count && length >= at(count)->size())
+    {
+        length -= at(count)->size();
+        at(count)->release();
+        ++count;
+    }
+
+    popFront(count);
+    m_offset = length;
+}
+
+size_t MessageQueue::dropOldest(size_t length, size_t &count, size_t busy)
+{
+    // Messages which have started to be sent must be completed.
+    size_t first = 0;
+    for (size_t started = 0; first < m_count && started < m_offset + busy; ++first)
+    {
+        started += at(first)->size();
+    }
+
+    size_t dropped = 0;
+    count = 0;
+    while (first + count < m_count && dropped < length)
+    {
+        Message *message = at(first + count);
+        dropped += message->size();
+        ++count;
+        message->release();
+    }
+
+    if (first > 0 && count > 0)
+    {
+        // Move the started Messages next to the ones left.
+        for (size_t i = first; i-- > 0; )
+        {
+            at(count + i) = at(i);
+        }
+    }
+
+    popFront(count);
+    m_size -= dropped;
+    return dropped;
+}
+
+void MessageQueue::clear()
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        at(i)->release();
+    }
+
+    popFront(m_count);
+    m_offset = 0;
+    m_size = 0;
+}
+
+bool MessageQueue::empty() const
+{
+    return m_size == 0;
+}
+
+size_t MessageQueue::size() const
+{
+    return m_size;
+}
+
+Message *&MessageQueue::at(size_t index)
+{
+    return m_ring[(m_head + index) & (m_ring.size() - 1)];
+}
+
+Message *MessageQueue::at(size_t index) const
+{
+    return m_ring[(m_head + index) & (m_ring.size() - 1)];
+}
+
+void MessageQueue::popFront(size_t count)
+{
+    assert(count <= m_count);
+    m_count -= count;
+    m_head = m_count > 0 ? (m_head + count) & (m_ring.size() - 1) : 0;
+
+    if (m_count == 0 && m_ring.size() > SHRINK_CAPACITY)
+    {
+        vector< Message* >().swap(m_ring);
+    }
+}
+
+} // namespace followermaze
@@ -0,0 +1,157 @@
+/* This file declears Message and MessageQueue classes.
+ */
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include "pool.h"
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* Message is an immutable chunk of data which can be queued for sending to
+ * many clients (possibly handled by different threads) without copying.
+ * Message is reference counted. The creator holds the first reference and
+ * every holder releases its reference when done. The last release disposes of
+ * the Message, or keeps it for reuse if it has been created by create.
+ * Counting references and reusing are thread safe.
+ */
+class Message
+{
+public:
+    // Creates a Message holding a copy of length bytes of data.
+    Message(const char *data, size_t length);
+
+    // Creates a Message taking over the content of data (data is left empty).
+    explicit Message(string &data);
+
+    // Same as above, but reuses a Message which has been released (if any)
+    // and hands its storage back in data (empty) so neither the Message nor
+    // the data has to be allocated in the steady state.
+    static Message *create(string &data);
+
+    // Returns the number of Messages reused by create so far.
+    static unsigned long getReuses();
+
+    // Adds a reference.
+    void acquire();
+
+    // Drops a reference. Disposes of the Message (or keeps it for reuse) if
+    // it was the last one.
+    void release();
+
+    const char *data() const;
+    size_t size() const;
+
+protected:
+    // Ensure dynamic allocation.
+    virtual ~Message();
+
+    // Keeps the released message for create. Returns false if it can't be
+    // kept (it's disposed of then).
+    static bool recycle(Message *message);
+
+protected:
+    enum
+    {
+        MAX_RECYCLED = 1024,         // Messages kept for reuse.
+        MAX_RECYCLED_CAPACITY = 4096 // Larger data is not worth keeping.
+    };
+
+    string m_data;
+    int m_refs; // Number of references (atomic).
+    bool m_recyclable; // Created by create.
+
+    static SpinLock m_recycleLock;
+    static Message *m_recycled[MAX_RECYCLED];
+    static size_t m_recycledCount;
+    static unsigned long m_reuses; // Updated atomically.
+
+private:
+    // Make non-copyable.
+    Message(const Message&);
+    Message& operator=(const Message&);
+};
+
+/* MessageQueue is a queue of Messages waiting to be sent. The Messages are
+ * referenced, not copied. Pending data can be gathered into an iovec array to
+ * be sent by one system call, and the Messages are released as soon as all of
+ * their bytes have been sent.
+ * The Messages are kept in a ring which grows on demand and keeps its storage
+ * so queueing takes no heap allocations in the steady state. A ring larger
+ * than SHRINK_CAPACITY is given back once the queue empties (e.g. after a
+ * slow consumer has caught up).
+ * MessageQueue is not thread safe.
+ */
+class MessageQueue
+{
+public:
+    MessageQueue();
+    ~MessageQueue();
+
+    // Queues the message (acquires a reference).
+    void push(Message *message);
+
+    // Fills up to max entries of iov with the pending data (in order).
+    // Returns the number of entries filled in. If held is not NULL the
+    // Messages of the entries are acquired and stored in it, too.
+    int gather(struct iovec *iov, int max, Message **held = NULL) const;
+
+    // Drops length bytes of the pending data from the front.
+    void consume(size_t length);
+
+    // Acquires the Messages holding the first length bytes of the pending
+    // data and appends them to held. Used to keep data which has been sent
+    // without copying intact until the transport layer is done with it.
+    void retain(size_t length, vector< Message* > &held) const;
+
+    // Drops whole Messages (oldest first) which have not started to be sent
+    // until at least length bytes are dropped or there is nothing more to
+    // drop. The first busy bytes of the pending data count as started (e.g.
+    // being sent by the Reactor). Returns the amount of bytes dropped and the
+    // number of Messages.
+    size_t dropOldest(size_t length, size_t &count, size_t busy = 0);
+
+    // Drops all the pending data.
+    void clear();
+
+    bool empty() const;
+
+    // Returns the amount of pending bytes.
+    size_t size() const;
+
+protected:
+    enum
+    {
+        MIN_CAPACITY = 16,
+        SHRINK_CAPACITY = 1024
+    };
+
+    // Returns the index-th Message from the front.
+    Message *&at(size_t index);
+    Message *at(size_t index) const;
+
+    // Drops the first count Messages (already released).
+    void popFront(size_t count);
+
+protected:
+    vector< Message* > m_ring; // Capacity is a power of 2.
+    size_t m_head;   // Index of the first Message in m_ring.
+    size_t m_count;  // Number of queued Messages.
+    size_t m_offset; // Bytes of the first Message sent already.
+    size_t m_size;
+
+private:
+    // Make non-copyable.
+    MessageQueue(const MessageQueue&);
+    MessageQueue& operator=(const MessageQueue&);
+};
+
+} // namespace followermaze
+
+#endif // MESSAGE_H
@@ -0,0 +1,134 @@
+#include "outputbudget.h"
+
+namespace followermaze
+{
+
+const size_t OutputBudget::DEFAULT_CLIENT_LIMIT;
+const size_t OutputBudget::DEFAULT_TOTAL_LIMIT;
+
+OutputBudget::OutputBudget(size_t clientLimit, size_t totalLimit, Policy policy) :
+    m_clientLimit(clientLimit),
+    m_totalLimit(totalLimit),
+    m_policy(policy),
+    m_pending(0),
+    m_stalled(0),
+    m_overflows(0),
+    m_dropped(0),
+    m_disconnected(0)
+{
+}
+
+void OutputBudget::setClientLimit(size_t limit)
+{
+    m_clientLimit = limit;
+}
+
+void OutputBudget::setTotalLimit(size_t limit)
+{
+    m_totalLimit = limit;
+}
+
+void OutputBudget::setPolicy(Policy policy)
+{
+    m_policy = policy;
+}
+
+OutputBudget::Policy OutputBudget::getPolicy() const
+{
+    return m_policy;
+}
+
+bool OutputBudget::fits(size_t pending, size_t length) const
+{
+    return pending + length <= m_clientLimit && getPending() + length <= m_totalLimit;
+}
+
+void OutputBudget::acquire(size_t length)
+{
+    __atomic_add_fetch(&m_pending, length, __ATOMIC_RELAXED);
+}
+
+void OutputBudget::release(size_t length)
+{
+    __atomic_sub_fetch(&m_pending, length, __ATOMIC_RELAXED);
+}
+
+void OutputBudget::countStalled(bool stalled)
+{
+    if (stalled)
+    {
+        __atomic_add_fetch(&m_stalled, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_sub_fetch(&m_stalled, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void OutputBudget::countOverflow()
+{
+    __atomic_add_fetch(&m_overflows, 1, __ATOMIC_RELAXED);
+}
+
+void OutputBudget::countDropped(size_t messages)
+{
+    __atomic_add_fetch(&m_dropped, messages, __ATOMIC_RELAXED);
+}
+
+void OutputBudget::countDisconnected()
+{
+    __atomic_add_fetch(&m_disconnected, 1, __ATOMIC_RELAXED);
+}
+
+size_t OutputBudget::getPending() const
+{
+    return __atomic_load_n(&m_pending, __ATOMIC_RELAXED);
+}
+
+unsigned long OutputBudget::getStalled() const
+{
+    return __atomic_load_n(&m_stalled, __ATOMIC_RELAXED);
+}
+
+unsigned long OutputBudget::getOverflows() const
+{
+    return __atomic_load_n(&m_overflows, __ATOMIC_RELAXED);
+}
+
+unsigned long OutputBudget::getDropped() const
+{
+    return __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+}
+
+unsigned long OutputBudget::getDisconnected() const
+{
+    return __atomic_load_n(&m_disconnected, __ATOMIC_RELAXED);
+}
+
+void OutputBudget::format(ostream &out) const
+{
+    out << "output pending=" << getPending()
+        << " client_limit=" << m_clientLimit
+        << " total_limit=" << m_totalLimit
+        << " policy=" << getPolicyName(m_policy)
+        << " stalled=" << getStalled()
+        << " overflows=" << getOverflows()
+        << " dropped=" << getDropped()
+        << " disconnected=" << getDisconnected() << "\n";
+}
+
+const char *OutputBudget::getPolicyName(Policy policy)
+{
+    switch (policy)
+    {
+    case PolicyDropOldest:
+        return "drop-oldest";
+    case PolicyPause:
+        return "pause";
+    case PolicyDisconnect:
+    default:
+        return "disconnect";
+    }
+}
+
+} // namespace followermaze
@@ -0,0 +1,100 @@
+/* This file declears OutputBudget class.
+ */
+#ifndef OUTPUTBUDGET_H
+#define OUTPUTBUDGET_H
+
+#include <cstddef>
+#include <ostream>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* OutputBudget bounds the memory used by the output queues of Clients (see
+ * Client::queueOutput): every Client can queue up to the client limit and all
+ * the Clients together up to the total limit. A message which doesn't fit
+ * overflows the Client and the policy decides what happens:
+ *  - disconnect: the Client is closed (its queue is dropped),
+ *  - drop-oldest: the oldest queued messages (not started to be sent) are
+ *    dropped to make room,
+ *  - pause: the Client gets no new messages until its queue drains below
+ *    the low watermark (the messages in between are dropped).
+ * OutputBudget also counts stalled (backpressured) Clients, overflows,
+ * dropped messages, and disconnected Clients.
+ * OutputBudget is shared by the Clients of all the Reactors. Accounting and
+ * counting are thread safe, configuration is not (should be done before the
+ * Clients are created).
+ */
+class OutputBudget
+{
+public:
+    enum Policy
+    {
+        PolicyDisconnect,
+        PolicyDropOldest,
+        PolicyPause
+    };
+
+    // Defaults.
+    static const size_t DEFAULT_CLIENT_LIMIT = 64 * 1024 * 1024;
+    static const size_t DEFAULT_TOTAL_LIMIT = 1024 * 1024 * 1024;
+
+public:
+    OutputBudget(size_t clientLimit = DEFAULT_CLIENT_LIMIT,
+                 size_t totalLimit = DEFAULT_TOTAL_LIMIT,
+                 Policy policy = PolicyDisconnect);
+
+    void setClientLimit(size_t limit);
+    void setTotalLimit(size_t limit);
+    void setPolicy(Policy policy);
+    Policy getPolicy() const;
+
+    // Returns true if length more bytes fit into the budget of a Client which
+    // has pending bytes queued already.
+    bool fits(size_t pending, size_t length) const;
+
+    // Accounts for bytes queued and released (sent or dropped) by a Client.
+    void acquire(size_t length);
+    void release(size_t length);
+
+    // Counting.
+    void countStalled(bool stalled);
+    void countOverflow();
+    void countDropped(size_t messages);
+    void countDisconnected();
+
+    // Getters.
+    size_t getPending() const;
+    unsigned long getStalled() const;
+    unsigned long getOverflows() const;
+    unsigned long getDropped() const;
+    unsigned long getDisconnected() const;
+
+    // Writes the limits and counters in one line ("output ...").
+    void format(ostream &out) const;
+
+    // Returns name of the policy ("disconnect", "drop-oldest", or "pause").
+    static const char *getPolicyName(Policy policy);
+
+protected:
+    size_t m_clientLimit;
+    size_t m_totalLimit;
+    Policy m_policy;
+
+    // Updated atomically.
+    size_t m_pending;
+    unsigned long m_stalled;
+    unsigned long m_overflows;
+    unsigned long m_dropped;
+    unsigned long m_disconnected;
+
+private:
+    // Make non-copyable.
+    OutputBudget(const OutputBudget&);
+    OutputBudget& operator=(const OutputBudget&);
+};
+
+} // namespace followermaze
+
+#endif // OUTPUTBUDGET_H
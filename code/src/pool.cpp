@@ -0,0 +1,181 @@
+#include <new>
+#include <sched.h>
+#include "pool.h"
+
+namespace followermaze
+{
+
+SpinLock::SpinLock() :
+    m_locked(0)
+{
+}
+
+void SpinLock::lock()
+{
+    while (__atomic_exchange_n(&m_locked, 1, __ATOMIC_ACQUIRE) != 0)
+    {
+        while (__atomic_load_n(&m_locked, __ATOMIC_RELAXED) != 0)
+        {
+            sched_yield();
+        }
+    }
+}
+
+void SpinLock::unlock()
+{
+    __atomic_store_n(&m_locked, 0, __ATOMIC_RELEASE);
+}
+
+/*----------------------------------------------------------------------------*/
+
+const size_t Pool::DEFAULT_SLAB_BLOCKS;
+Pool *Pool::m_pools = NULL;
+
+Pool::Pool(const char *name, size_t blockSize, size_t slabBlocks) :
+    m_name(name),
+    m_blockSize(blockSize),
+    m_slabBlocks(slabBlocks > 0 ? slabBlocks : 1),
+    m_free(NULL),
+    m_slabs(NULL),
+    m_allocations(0),
+    m_heapAllocations(0),
+    m_inUse(0),
+    m_nextPool(m_pools)
+{
+    // Keep the blocks aligned like the heap does.
+    const size_t alignment = 2 * sizeof(void*);
+    if (m_blockSize < sizeof(Block))
+    {
+        m_blockSize = sizeof(Block);
+    }
+    m_blockSize = (m_blockSize + alignment - 1) / alignment * alignment;
+
+    // Pools are static so they are constructed by one thread.
+    m_pools = this;
+}
+
+Pool::~Pool()
+{
+    for (Pool **pool = &m_pools; *pool != NULL; pool = &(*pool)->m_nextPool)
+    {
+        if (*pool == this)
+        {
+            *pool = m_nextPool;
+            break;
+        }
+    }
+
+    // Blocks still in use (e.g. by static objects destroyed later) must stay
+    // valid.
+    if (getInUse() > 0)
+    {
+        return;
+    }
+
+    while (m_slabs != NULL)
+    {
+        Block *slab = m_slabs;
+        m_slabs = slab->m_next;
+        ::operator delete(slab);
+    }
+}
+
+void *Pool::allocate(size_t size)
+{
+    if (size > m_blockSize)
+    {
+        __atomic_add_fetch(&m_heapAllocations, 1, __ATOMIC_RELAXED);
+        return ::operator new(size);
+    }
+
+    m_lock.lock();
+    if (m_free == NULL)
+    {
+        try
+        {
+            grow();
+        }
+        catch (...)
+        {
+            m_lock.unlock();
+            throw;
+        }
+    }
+
+    Block *block = m_free;
+    m_free = block->m_next;
+    __atomic_add_fetch(&m_allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&m_inUse, 1, __ATOMIC_RELAXED);
+    m_lock.unlock();
+
+    return block;
+}
+
+void Pool::deallocate(void *block, size_t size)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+
+    if (size > m_blockSize)
+    {
+        ::operator delete(block);
+        return;
+    }
+
+    m_lock.lock();
+    static_cast<Block*>(block)->m_next = m_free;
+    m_free = static_cast<Block*>(block);
+    __atomic_sub_fetch(&m_inUse, 1, __ATOMIC_RELAXED);
+    m_lock.unlock();
+}
+
+unsigned long Pool::getAllocations() const
+{
+    return __atomic_load_n(&m_allocations, __ATOMIC_RELAXED);
+}
+
+unsigned long Pool::getHeapAllocations() const
+{
+    return __atomic_load_n(&m_heapAllocations, __ATOMIC_RELAXED);
+}
+
+unsigned long Pool::getInUse() const
+{
+    return __atomic_load_n(&m_inUse, __ATOMIC_RELAXED);
+}
+
+void Pool::format(ostream &out) const
+{
+    out << "pool " << m_name
+        << " allocations=" << getAllocations()
+        << " heap=" << getHeapAllocations()
+        << " in_use=" << getInUse() << "\n";
+}
+
+void Pool::formatAll(ostream &out)
+{
+    for (const Pool *pool = m_pools; pool != NULL; pool = pool->m_nextPool)
+    {
+        pool->format(out);
+    }
+}
+
+void Pool::grow()
+{
+    // The first block links the slab.
+    char *slab = static_cast<char*>(::operator new(m_blockSize * (m_slabBlocks + 1)));
+    __atomic_add_fetch(&m_heapAllocations, 1, __ATOMIC_RELAXED);
+    reinterpret_cast<Block*>(slab)->m_next = m_slabs;
+    m_slabs = reinterpret_cast<Block*>(slab);
+
+    for (size_t i = m_slabBlocks; i > 0; --i)
+    {
+        Block *block = reinterpret_cast<Block*>(slab + i * m_blockSize);
+        block->m_next = m_free;
+        m_free = block;
+    }
+}
+
+} // namespace followermaze
@@ -0,0 +1,110 @@
+/* This file declears SpinLock and Pool classes.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <ostream>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* SpinLock is a minimal lock for critical sections which take a few
+ * instructions (e.g. taking a block off a free list). Waiting threads spin
+ * and yield the CPU.
+ */
+class SpinLock
+{
+public:
+    SpinLock();
+
+    void lock();
+    void unlock();
+
+private:
+    int m_locked; // Accessed atomically.
+
+private:
+    // Make non-copyable.
+    SpinLock(const SpinLock&);
+    SpinLock& operator=(const SpinLock&);
+};
+
+/* Pool is a free list of memory blocks of one size carved out of slabs of
+ * many blocks. It backs class specific operator new and delete of the
+ * objects created and disposed of per connection (or per notification) so
+ * they don't go to the heap in the steady state. Requests for more than the
+ * block size (e.g. for a subclass of the pooled class) are passed to the
+ * heap.
+ * Slabs are not returned to the heap until the Pool is destroyed (and only if
+ * all of its blocks have been taken back): a Pool is expected to be static
+ * and keep the blocks for reuse as long as the process runs. All the Pools
+ * are listed so their counters can be reported (see formatAll).
+ * Pool is thread safe: blocks can be allocated and deallocated by
+ * different threads.
+ */
+class Pool
+{
+public:
+    // Default number of blocks per slab.
+    static const size_t DEFAULT_SLAB_BLOCKS = 64;
+
+public:
+    // name tells what the blocks are used for (e.g. "connections").
+    Pool(const char *name, size_t blockSize, size_t slabBlocks = DEFAULT_SLAB_BLOCKS);
+    ~Pool();
+
+    // Returns a block of size bytes. Throws bad_alloc if out of memory.
+    void *allocate(size_t size);
+
+    // Takes back the block of size bytes returned by allocate.
+    void deallocate(void *block, size_t size);
+
+    // Counters.
+    unsigned long getAllocations() const;     // Blocks handed out so far.
+    unsigned long getHeapAllocations() const; // Slabs and blocks of other sizes.
+    unsigned long getInUse() const;           // Pooled blocks handed out and not taken back.
+
+    // Writes the counters in one line ("pool <name> ...").
+    void format(ostream &out) const;
+
+    // Writes the counters of all the Pools.
+    static void formatAll(ostream &out);
+
+protected:
+    // Block is a free block linked into the free list.
+    struct Block
+    {
+        Block *m_next;
+    };
+
+    // Links a new slab of blocks into the free list (the lock must be held).
+    void grow();
+
+protected:
+    const char *m_name;
+    size_t m_blockSize;
+    size_t m_slabBlocks;
+    SpinLock m_lock;
+    Block *m_free;
+    Block *m_slabs; // Each slab starts with a Block linking it.
+
+    // Updated atomically.
+    unsigned long m_allocations;
+    unsigned long m_heapAllocations;
+    unsigned long m_inUse;
+
+    Pool *m_nextPool; // Next in the list of all the Pools.
+    static Pool *m_pools;
+
+private:
+    // Make non-copyable.
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+};
+
+} // namespace followermaze
+
+#endif // POOL_H
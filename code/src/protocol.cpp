@@ -1,7 +1,9 @@
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
 #include <climits>
-#include <sstream>
 #include <algorithm>
+#include <assert.h>
 #include "protocol.h"
 #include "reactor.h"
 #include "engine.h"
@@ -15,10 +17,334 @@ namespace protocol
 
 /*----------------------------------------------------------------------------*/
 
+namespace
+{
+
+/* RegisterUserTask registers a UserClient with the Engine in the Engine's
+ * thread.
+ */
+class RegisterUserTask : public Task
+{
+public:
+    RegisterUserTask(Engine &engine, UserClient *userClient, long id) :
+        m_engine(engine),
+        m_userClient(userClient),
+        m_id(id)
+    {
+    }
+
+    virtual void run()
+    {
+        m_engine.registerUser(m_userClient, m_id);
+    }
+
+protected:
+    Engine &m_engine;
+    UserClient *m_userClient;
+    long m_id;
+};
+
+/* DisposeTask disposes of a detouched Client in its Reactor's thread (the
+ * connection lingers if zero-copy sends haven't completed, see
+ * Client::linger). Takes ownership of the Client, so it is disposed of even
+ * if the task is never run.
+ */
+class DisposeTask : public Task
+{
+public:
+    DisposeTask(Client *client) :
+        m_client(client)
+    {
+    }
+
+    virtual ~DisposeTask()
+    {
+        delete static_cast<EventHandler*>(m_client);
+    }
+
+    virtual void run()
+    {
+        m_client->linger();
+        delete static_cast<EventHandler*>(m_client);
+        m_client = NULL;
+    }
+
+protected:
+    Client *m_client;
+};
+
+/* UnregisterUserTask unregisters a detouched UserClient in the Engine's
+ * thread and sends it back to its Reactor to be disposed of. Takes ownership
+ * of the UserClient.
+ */
+class UnregisterUserTask : public Task
+{
+public:
+    UnregisterUserTask(Engine &engine, UserClient *userClient, long id, Reactor &reactor) :
+        m_engine(engine),
+        m_userClient(userClient),
+        m_id(id),
+        m_reactor(reactor)
+    {
+    }
+
+    virtual ~UnregisterUserTask()
+    {
+        delete static_cast<EventHandler*>(m_userClient);
+    }
+
+    virtual void run()
+    {
+        m_engine.unregisterUser(m_id, m_userClient);
+
+        // Messages which have been sent to the UserClient are queued in front
+        // of this task.
+        auto_ptr<Task> dispose(new DisposeTask(m_userClient));
+        m_userClient = NULL;
+        m_reactor.post(dispose);
+    }
+
+protected:
+    Engine &m_engine;
+    UserClient *m_userClient;
+    long m_id;
+    Reactor &m_reactor;
+};
+
+/* Splits the input into CRLF terminated messages.
+ */
+const DelimiterScanner crlfScanner(Parser::CR, Parser::LF);
+
+// Digits of the largest long (more significant digits are out of range). Up
+// to this many fit in an unsigned long long.
+const long MAX_DIGITS = 19;
+
+/* Parses a long from pos up to end by the rules of strtol (base 10) and
+ * stores it in value, or INVALID_LONG if it's 0, out of range or LONG_MIN or
+ * LONG_MAX. Returns where the number ends.
+ */
+const char *parseNumber(const char *pos, const char *end, long &value)
+{
+    // Numbers normally start with a digit right away, so the checks for
+    // leading spaces and sign are skipped.
+    bool negative = false;
+    if (pos < end && (*pos < '0' || *pos > '9'))
+    {
+        while (pos < end && isspace(static_cast<unsigned char>(*pos)))
+        {
+            pos++;
+        }
+
+        if (pos < end && (*pos == '+' || *pos == '-'))
+        {
+            negative = (*pos == '-');
+            pos++;
+        }
+    }
+
+    while (pos < end && *pos == '0')
+    {
+        pos++;
+    }
+
+    // Accumulate the magnitude without checking for overflow on every digit,
+    // the number of digits tells if it's out of range.
+    const char *digits = pos;
+    unsigned long long magnitude = 0;
+    for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+    {
+        magnitude = magnitude * 10 + (*pos - '0');
+    }
+
+    const unsigned long long max = static_cast<unsigned long long>(LONG_MAX);
+    if (pos - digits > MAX_DIGITS || magnitude == 0 || (negative ? magnitude > max : magnitude >= max))
+    {
+        value = Parser::INVALID_LONG;
+    }
+    else
+    {
+        value = negative ? -static_cast<long>(magnitude) : static_cast<long>(magnitude);
+    }
+
+    return pos;
+}
+
+/* Moves pos past the next DELIMITER. Returns false if there is no token after
+ * it (a trailing DELIMITER starts no token).
+ */
+bool nextToken(const char *&pos, const char *end)
+{
+    // Numbers are normally followed by the DELIMITER right away.
+    const char *delimiter = pos;
+    if (delimiter == end || *delimiter != Parser::DELIMITER)
+    {
+        delimiter = static_cast<const char*>(memchr(pos, Parser::DELIMITER, end - pos));
+    }
+
+    if (delimiter == NULL || delimiter + 1 == end)
+    {
+        return false;
+    }
+
+    pos = delimiter + 1;
+    return true;
+}
+
+/* Reads an unsigned big endian integer of 64 and 16 bits.
+ */
+unsigned long long readBigEndian64(const char *data)
+{
+    unsigned long long value = 0;
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+unsigned int readBigEndian16(const char *data)
+{
+    return static_cast<unsigned int>(static_cast<unsigned char>(data[0])) << 8 |
+           static_cast<unsigned char>(data[1]);
+}
+
+/* Appends value as a big endian integer of size bytes.
+ */
+void appendBigEndian(string &out, unsigned long long value, size_t size)
+{
+    for (size_t i = size; i > 0; --i)
+    {
+        out.push_back(static_cast<char>((value >> (8 * (i - 1))) & 0xff));
+    }
+}
+
+/* Turns a 64 bit field of a record into a long by the same rules as the text
+ * (0, out of range, LONG_MIN, and LONG_MAX are invalid).
+ */
+long toLong(unsigned long long field)
+{
+    long long value = static_cast<long long>(field);
+    if (value == 0 || value >= LONG_MAX || value <= LONG_MIN)
+    {
+        return Parser::INVALID_LONG;
+    }
+
+    return static_cast<long>(value);
+}
+
+// Enough room for the text of a long.
+const size_t MAX_LONG_TEXT = 24;
+
+/* Returns the length of the text of value.
+ */
+size_t getLongLength(long value)
+{
+    // Compares instead of dividing. A long has fewer digits than the largest
+    // power of 10 an unsigned long long holds, so the power doesn't overflow.
+    size_t length = value < 0 ? 2 : 1;
+    unsigned long long magnitude = value < 0 ? 0ull - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+    for (unsigned long long power = 10; magnitude >= power; power *= 10)
+    {
+        ++length;
+    }
+
+    return length;
+}
+
+/* Writes the decimal digits of value at out. Returns where they end.
+ */
+char *formatLong(char *out, long value)
+{
+    static const char PAIRS[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // Two digits at a time.
+    char digits[MAX_LONG_TEXT];
+    char *pos = digits + sizeof(digits);
+    unsigned long magnitude = value < 0 ? 0ul - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
+    while (magnitude >= 100)
+    {
+        pos -= 2;
+        memcpy(pos, PAIRS + 2 * (magnitude % 100), 2);
+        magnitude /= 100;
+    }
+
+    if (magnitude >= 10)
+    {
+        pos -= 2;
+        memcpy(pos, PAIRS + 2 * magnitude, 2);
+    }
+    else
+    {
+        *--pos = static_cast<char>('0' + magnitude);
+    }
+
+    if (value < 0)
+    {
+        *--pos = '-';
+    }
+
+    size_t length = digits + sizeof(digits) - pos;
+    memcpy(out, pos, length);
+    return out + length;
+}
+
+/* SendTask sends a message to a UserClient in the UserClient's thread.
+ * One is posted per notified user so SendTasks are allocated from a Pool.
+ */
+class SendTask : public Task
+{
+public:
+    SendTask(UserClient *userClient, Message *message) :
+        m_userClient(userClient),
+        m_message(message)
+    {
+        m_message->acquire();
+    }
+
+    virtual ~SendTask()
+    {
+        m_message->release();
+    }
+
+    virtual void run()
+    {
+        m_userClient->send(m_message);
+    }
+
+    static void *operator new(size_t size)
+    {
+        return m_pool.allocate(size);
+    }
+
+    static void operator delete(void *block, size_t size)
+    {
+        m_pool.deallocate(block, size);
+    }
+
+protected:
+    UserClient *m_userClient;
+    Message *m_message;
+
+    static Pool m_pool;
+};
+
+Pool SendTask::m_pool("sends", sizeof(SendTask));
+
+} // namespace
+
+/*----------------------------------------------------------------------------*/
+
 EventSource::EventSource(auto_ptr<Connection> connection, Reactor &reactor, Engine &engine) :
     Client(connection, reactor),
-    m_engine(engine)
+    m_engine(engine),
+    m_framer(Parser::CR, Parser::LF),
+    m_framing(FramingUnknown)
 {
+    // Events come in bulk, have them read into the Reactor's buffers.
+    setAsyncInput(true);
     Logger::getInstance().info("EventSource connected.");
 }
 
@@ -27,6 +353,11 @@ EventSource::~EventSource()
     Logger::getInstance().info("EventSource disconnected.");
 }
 
+const char *EventSource::getCategory() const
+{
+    return "EventSource";
+}
+
 void EventSource::handleClose(int hint)
 {
     Logger::getInstance().info("EventSource closed.");
@@ -36,19 +367,79 @@ void EventSource::handleClose(int hint)
 
 void EventSource::handleError(int hint)
 {
-    Logger::getInstance().error("EventSource error.");
-    m_engine.resetEventQueue();
-    Client::handleError(hint);
+    // Completions of zero-copy sends are reported as errors, too.
+    if (!handleCompletions())
+    {
+        Logger::getInstance().error("EventSource error.");
+        m_engine.resetEventQueue();
+        dispose(hint);
+    }
 }
 
-void EventSource::doHandleInput(int /*hint*/)
+void EventSource::doHandleInput(int hint)
 {
-    m_buffer += m_connection->receive();
-    m_engine.handleEvents(m_buffer);
+    receive(m_buffer);
+    if (m_framing == FramingUnknown && !negotiate(hint))
+    {
+        return;
+    }
+
+    if (m_framing == FramingBinary)
+    {
+        if (!m_engine.handleRecords(m_buffer))
+        {
+            // Closed like a disconnect (see Client::handleInput).
+            Logger::getInstance().error("EventSource sent a record with a wrong payload length.");
+            throw Connection::Exception(Connection::Exception::ErrClientDisconnect);
+        }
+    }
+    else
+    {
+        m_engine.handleEvents(m_buffer, m_framer);
+    }
+}
+
+bool EventSource::negotiate(int hint)
+{
+    if (m_buffer.empty())
+    {
+        return false;
+    }
+
+    const char *magic = Parser::BINARY_MAGIC;
+    if (m_buffer.data()[0] != magic[0])
+    {
+        m_framing = FramingText;
+        return true;
+    }
+
+    if (m_buffer.size() < Parser::BINARY_MAGIC_LENGTH)
+    {
+        return false;
+    }
+
+    if (memcmp(m_buffer.data(), magic, Parser::BINARY_MAGIC_LENGTH) != 0)
+    {
+        // Not a text event either, it's going to be dropped as invalid.
+        m_framing = FramingText;
+        return true;
+    }
+
+    m_buffer.consume(Parser::BINARY_MAGIC_LENGTH);
+    m_framing = FramingBinary;
+    Logger::getInstance().info("EventSource sends binary records.");
+
+    Message *ack = new Message(magic, Parser::BINARY_MAGIC_LENGTH);
+    queueOutput(hint, ack);
+    ack->release();
+    return true;
 }
 
 /*----------------------------------------------------------------------------*/
 
+const size_t UserClient::MAX_ID_MESSAGE_LENGTH;
+Pool UserClient::m_pool("users", sizeof(UserClient));
+
 UserClient::UserClient(auto_ptr<Connection> connection, Reactor &reactor, Engine &engine) :
     Client(connection, reactor),
     m_engine(engine),
@@ -58,10 +449,21 @@ UserClient::UserClient(auto_ptr<Connection> connection, Reactor &reactor, Engine
     Logger::getInstance().info("UserClient connected.");
 }
 
-void UserClient::send(const string& message)
+void UserClient::send(Message *message)
 {
-    m_messageOut += message;
-    m_reactor.resetHandler(m_hint, Reactor::EvntWrite);
+    if (!m_reactor.isInLoopThread())
+    {
+        m_reactor.post(auto_ptr<Task>(new SendTask(this, message)));
+        return;
+    }
+
+    if (m_hint < 0)
+    {
+        // Not handled by the Reactor (anymore).
+        return;
+    }
+
+    queueOutput(m_hint, message);
 }
 
 UserClient::~UserClient()
@@ -69,43 +471,109 @@ UserClient::~UserClient()
     Logger::getInstance().info("UserClient disconnected.");
 }
 
+void *UserClient::operator new(size_t size)
+{
+    return m_pool.allocate(size);
+}
+
+void UserClient::operator delete(void *block, size_t size)
+{
+    m_pool.deallocate(block, size);
+}
+
 void UserClient::doHandleInput(int hint)
 {
     m_hint = hint;
-    m_messageIn += m_connection->receive();
-    m_userId = m_engine.registerUser(this, m_messageIn);
-    if (m_userId != protocol::Parser::INVALID_LONG)
+    receive(m_messageIn, MAX_ID_MESSAGE_LENGTH - m_messageIn.size());
+
+    long id = Parser::parseUserId(m_messageIn.data(), m_messageIn.size());
+    if (id == Parser::INVALID_LONG)
     {
+        if (m_messageIn.size() >= MAX_ID_MESSAGE_LENGTH)
+        {
+            Logger::getInstance().info("Invalid user ID dropped.");
+            m_messageIn.release();
+        }
+    }
+    else
+    {
+        m_userId = id;
+
+        if (isEngineLocal())
+        {
+            m_engine.registerUser(this, id);
+        }
+        else
+        {
+            m_engine.getReactor()->post(auto_ptr<Task>(new RegisterUserTask(m_engine, this, id)));
+        }
+
         Logger::getInstance().info("User authenticated: ", m_userId);
-        m_messageIn.clear();
+
+        // Nothing else is read from a user: free the storage.
+        m_messageIn.release();
     }
 }
 
-void UserClient::doHandleOutput(int hint)
+const char *UserClient::getCategory() const
 {
-    m_connection->send(m_messageOut);
-    m_messageOut.clear();
-    m_reactor.resetHandler(hint, Reactor::EvntRead);
+    return "UserClient";
 }
 
 void UserClient::handleClose(int hint)
 {
-    reset(hint);
-    Client::handleClose(hint);
+    release(hint);
 }
 
 void UserClient::handleError(int hint)
 {
-    reset(hint);
-    Client::handleError(hint);
+    if (!handleCompletions())
+    {
+        release(hint);
+    }
 }
 
 void UserClient::reset(int /*hint*/)
 {
     m_engine.unregisterUser(m_userId, this);
     m_userId = Parser::INVALID_LONG;
-    m_messageOut.clear();
-    m_messageIn.clear();
+    clearOutput();
+    m_messageIn.release();
+}
+
+void UserClient::release(int hint)
+{
+    if (isEngineLocal())
+    {
+        reset(hint);
+        dispose(hint);
+        return;
+    }
+
+    if (m_userId == Parser::INVALID_LONG)
+    {
+        // The Engine doesn't know about this.
+        dispose(hint);
+        return;
+    }
+
+    // The Engine may be sending messages to this from its thread. Stop
+    // handling I/O and let the Engine unregister the user and dispose of this.
+    EventHandler* self = m_reactor.detouchHandler(hint);
+    assert(self == (EventHandler*)this);
+    m_hint = -1;
+    clearOutput();
+    m_messageIn.release();
+
+    auto_ptr<Task> unregister(new UnregisterUserTask(m_engine, this, m_userId, m_reactor));
+    m_userId = Parser::INVALID_LONG;
+    m_engine.getReactor()->post(unregister);
+}
+
+bool UserClient::isEngineLocal() const
+{
+    Reactor *engineReactor = m_engine.getReactor();
+    return engineReactor == NULL || engineReactor == &m_reactor;
 }
 
 void SortEventQueue(EventQueue &eventQueue)
@@ -126,77 +594,145 @@ const char Parser::TYPE_BROADCAST;
 const char Parser::TYPE_PRIVATE;
 const char Parser::TYPE_STATUSUPDATE;
 const char Parser::TYPE_INVALID;
+const char *Parser::BINARY_MAGIC = "\0FM\1";
+const size_t Parser::BINARY_MAGIC_LENGTH;
+const size_t Parser::RECORD_PREFIX_LENGTH;
+const size_t Parser::RECORD_LENGTH;
 
 bool Parser::findMessage(const string &str, size_t &start, string &message)
 {
+    const char *found = NULL;
+    size_t length = 0;
+    size_t next = start;
+
+    if (findMessage(str.data(), str.length(), next, found, length))
+    {
+        message.assign(found, length);
+        start = next;
+        return true;
+    }
+
+    return false;
+}
+
+bool Parser::findMessage(const char *data, size_t size, size_t &start, const char *&message, size_t &length)
+{
+    if (start >= size)
+    {
+        return false;
+    }
+
     // Find CRLF (any of them)
-    size_t pos = str.find_first_of(CRLF, start);
+    size_t pos = start;
+    while (pos < size && data[pos] != CR && data[pos] != LF)
+    {
+        pos++;
+    }
 
-    if (pos != string::npos)
+    if (pos == size)
     {
-        message = str.substr(start, pos - start);
-        start = pos;
+        return false;
+    }
 
-        // Skip CRLF.
-        while (start < str.length() && (str[start] == CR || str[start] == LF))
-        {
-            start++;
-        }
+    message = data + start;
+    length = pos - start;
+    start = pos;
 
-        if (start >= str.length())
-        {
-            // Indicate that there is no next message.
-            start = string::npos;
-        }
+    // Skip CRLF.
+    while (start < size && (data[start] == CR || data[start] == LF))
+    {
+        start++;
+    }
 
-        return true;
+    if (start >= size)
+    {
+        // Indicate that there is no next message.
+        start = string::npos;
     }
 
-    return false;
+    return true;
+}
+
+size_t Parser::findMessages(const char *data, size_t size, SpanList &spans)
+{
+    return crlfScanner.scan(data, size, spans);
 }
 
 long Parser::parseLong(const string &str)
 {
-    long res = strtol(str.c_str(), NULL, 10);
-    if (res == 0 || res == LONG_MAX || res == LONG_MIN)
+    return parseLong(str.data(), str.length());
+}
+
+long Parser::parseLong(const char *str, size_t length)
+{
+    long res = INVALID_LONG;
+    parseNumber(str, str + length, res);
+    return res;
+}
+
+long Parser::parseUserId(const string &str)
+{
+    return parseUserId(str.data(), str.length());
+}
+
+long Parser::parseUserId(const char *data, size_t size)
+{
+    const char *message = NULL;
+    size_t length = 0;
+    size_t start = 0;
+    if (findMessage(data, size, start, message, length))
     {
-        res = INVALID_LONG;
+        return parseLong(message, length);
     }
 
-    return res;
+    return INVALID_LONG;
 }
 
 void Parser::parseEvent(Event &event)
+{
+    parseEvent(event, event.m_payload.data(), event.m_payload.length());
+}
+
+void Parser::parseEvent(Event &event, const char *message, size_t length)
 {
     event.m_seqnum = INVALID_LONG;
     event.m_type = TYPE_INVALID;
     event.m_fromUserId = INVALID_LONG;
     event.m_toUserId = INVALID_LONG;
 
-    stringstream ss(event.m_payload);
-    string token;
-    unsigned int tokenNum = 0;
+    // One pass over the message: each field is parsed where its token starts
+    // and the rest of the token (normally nothing) is skipped up to the next
+    // DELIMITER. Tokens after the fourth are ignored.
+    const char *pos = message;
+    const char *end = message + length;
+    if (pos == end)
+    {
+        return;
+    }
 
-    while (getline(ss, token, DELIMITER) && tokenNum < 4)
+    pos = parseNumber(pos, end, event.m_seqnum);
+    if (!nextToken(pos, end))
     {
-        switch (tokenNum++)
-        {
-        case 0:
-            event.m_seqnum = parseLong(token);
-            break;
-        case 1:
-            event.m_type = token.empty() ? TYPE_INVALID : token[0];
-            break;
-        case 2:
-            event.m_fromUserId = parseLong(token);
-            break;
-        case 3:
-            event.m_toUserId = parseLong(token);
-            break;
-        default:
-            break;
-        }
+        return;
+    }
+
+    if (*pos != DELIMITER)
+    {
+        event.m_type = *pos++;
     }
+
+    if (!nextToken(pos, end))
+    {
+        return;
+    }
+
+    pos = parseNumber(pos, end, event.m_fromUserId);
+    if (!nextToken(pos, end))
+    {
+        return;
+    }
+
+    parseNumber(pos, end, event.m_toUserId);
 }
 
 bool Parser::isValidEvent(const Event &event)
@@ -247,12 +783,107 @@ bool Parser::isValidEvent(const Event &event)
     return true;
 }
 
+size_t Parser::findRecords(const char *data, size_t size, SpanList &spans)
+{
+    size_t pos = 0;
+    while (size - pos >= RECORD_PREFIX_LENGTH)
+    {
+        size_t length = readBigEndian16(data + pos);
+        if (size - pos - RECORD_PREFIX_LENGTH < length)
+        {
+            break;
+        }
+
+        Span span;
+        span.m_offset = pos + RECORD_PREFIX_LENGTH;
+        span.m_length = length;
+        spans.push_back(span);
+        pos += RECORD_PREFIX_LENGTH + length;
+    }
+
+    return pos;
+}
+
+size_t Parser::parseRecord(Event &event, const char *record, size_t length)
+{
+    event.m_seqnum = INVALID_LONG;
+    event.m_type = TYPE_INVALID;
+    event.m_fromUserId = INVALID_LONG;
+    event.m_toUserId = INVALID_LONG;
+
+    if (length < RECORD_LENGTH)
+    {
+        return 0;
+    }
+
+    event.m_seqnum = toLong(readBigEndian64(record));
+    event.m_type = record[8] != 0 ? record[8] : TYPE_INVALID;
+    event.m_fromUserId = toLong(readBigEndian64(record + 9));
+    event.m_toUserId = toLong(readBigEndian64(record + 17));
+    return readBigEndian16(record + 25);
+}
+
+void Parser::encodeRecord(const Event &event, string &record)
+{
+    size_t payloadLength = event.m_payload.length() < 0xffff ? event.m_payload.length() : 0xffff;
+
+    appendBigEndian(record, RECORD_LENGTH, RECORD_PREFIX_LENGTH);
+    appendBigEndian(record, event.m_seqnum != INVALID_LONG ? event.m_seqnum : 0, 8);
+    record.push_back(event.m_type != TYPE_INVALID ? event.m_type : 0);
+    appendBigEndian(record, event.m_fromUserId != INVALID_LONG ? event.m_fromUserId : 0, 8);
+    appendBigEndian(record, event.m_toUserId != INVALID_LONG ? event.m_toUserId : 0, 8);
+    appendBigEndian(record, payloadLength, 2);
+}
+
+void Parser::formatPayload(const Event &event, string &payload)
+{
+    // Formatted on the stack and assigned at once.
+    char text[3 * (MAX_LONG_TEXT + 1) + 1];
+    char *end = formatLong(text, event.m_seqnum);
+    *end++ = DELIMITER;
+    *end++ = event.m_type;
+    if (event.m_fromUserId != INVALID_LONG)
+    {
+        *end++ = DELIMITER;
+        end = formatLong(end, event.m_fromUserId);
+    }
+
+    if (event.m_toUserId != INVALID_LONG)
+    {
+        *end++ = DELIMITER;
+        end = formatLong(end, event.m_toUserId);
+    }
+
+    payload.assign(text, end - text);
+}
+
+size_t Parser::getPayloadLength(const Event &event)
+{
+    size_t length = getLongLength(event.m_seqnum) + 2;
+    if (event.m_fromUserId != INVALID_LONG)
+    {
+        length += getLongLength(event.m_fromUserId) + 1;
+    }
+
+    if (event.m_toUserId != INVALID_LONG)
+    {
+        length += getLongLength(event.m_toUserId) + 1;
+    }
+
+    return length;
+}
+
 void Parser::encodeMessage(const string &payload, string &message)
 {
     message = payload;
     message.push_back(LF);
 }
 
+void Parser::encodeMessage(string &payload)
+{
+    payload.push_back(LF);
+}
+
 } // namespace protocol
 
 } // namespace followerspace
@@ -19,6 +19,8 @@
 #include <list>
 #include <vector>
 #include "client.h"
+#include "message.h"
+#include "scanner.h"
 
 using namespace std;
 
@@ -58,6 +60,10 @@ struct Event
 /* EventSource is a client which receives events and uses Engine
  * to process them. It adds a part (event processing) of followermaze business
  * logic to the Reactor pattern.
+ * The events are CRLF terminated text unless the event source opts in to
+ * binary records by starting with Parser::BINARY_MAGIC (which no text event
+ * starts with). The magic is echoed back so the event source knows binary
+ * records are understood.
  */
 class EventSource : public Client
 {
@@ -66,20 +72,36 @@ public:
     EventSource(auto_ptr<Connection> connection, Reactor &reactor, Engine &engine);
 
     // Implement EventHandler interface.
+    virtual const char *getCategory() const;
     virtual void handleClose(int hint);
     virtual void handleError(int hint);
 
+protected:
+    // Framings of the incoming data.
+    enum Framing
+    {
+        FramingUnknown, // Nothing received yet.
+        FramingText,
+        FramingBinary
+    };
+
 protected:
     // Implement event source specific input processing.
     virtual void doHandleInput(int hint);
 
+    // Picks the framing by the start of the data. Returns false if there is
+    // not enough data yet.
+    bool negotiate(int hint);
+
 protected:
     // Ensure dynamic allocation.
     virtual ~EventSource();
 
 protected:
     Engine &m_engine;
-    string m_buffer; // internal buffer for the incoming data
+    Buffer m_buffer; // internal buffer for the incoming data
+    Framer m_framer; // of the text in m_buffer
+    Framing m_framing;
 };
 
 /* User map maps user ID to the pointer to a User instance.
@@ -107,37 +129,62 @@ struct User
  * used to send messages to the user. It adds a part (user
  * registering/unregistering, and notification) of followermaze business logic
  * to the Reactor pattern.
+ * UserClient can be handled by a Reactor other than the one the Engine is
+ * bound to. Then requests to the Engine are posted to the Engine's Reactor
+ * and messages sent from the Engine's thread are posted to the UserClient's
+ * Reactor. When such a UserClient is closed it stops handling I/O and is
+ * disposed of only after the Engine has unregistered it so there are no
+ * messages on the way to it.
  */
 class UserClient : public Client
 {
+public:
+    // Max length of the authentication message (a user ID and CRLF). Longer
+    // input is dropped.
+    static const size_t MAX_ID_MESSAGE_LENGTH = 32;
+
 public:
     // Creates a user client. Takes ownership over connection.
     UserClient(auto_ptr<Connection> connection, Reactor &reactor, Engine &engine);
 
     // Implement EventHandler interface.
+    virtual const char *getCategory() const;
     virtual void handleClose(int hint);
     virtual void handleError(int hint);
 
     // Sends a message to the user on the other end of the connection.
-    virtual void send(const string& message);
+    // The message is queued by reference (see Client::queueOutput).
+    // Can be called from the thread of the Reactor the Engine is bound to.
+    virtual void send(Message *message);
+
+    // UserClients are allocated from a Pool (one is created per user
+    // connection).
+    static void *operator new(size_t size);
+    static void operator delete(void *block, size_t size);
 
 protected:
-    // Implement user client specific input/output processing.
+    // Implement user client specific input processing.
     virtual void doHandleInput(int hint);
-    virtual void doHandleOutput(int hint);
 
     // Unregister already registered user and cleanup the state.
     void reset(int hint);
 
+    // Unregister already registered user and dispose of this.
+    void release(int hint);
+
+    // Returns true if the Engine is used by the thread handling this.
+    bool isEngineLocal() const;
+
 protected:
     virtual ~UserClient();
 
 protected:
     Engine &m_engine;
-    string m_messageIn;  // internal buffer for the incoming message
-    string m_messageOut; // internal buffer for the outgoing message
+    Buffer m_messageIn;  // internal buffer for the incoming message
     long m_userId;       // cached registered user ID
     int m_hint;          // cached Reactor hint to notify user outside EventHandler callbacks.
+
+    static Pool m_pool;
 };
 
 /* EventQueue is a vector of events which should be sorted using
@@ -156,20 +203,64 @@ struct Parser
     // message (string::npos if no more messages).
     static bool findMessage(const string &str, size_t &start, string &message);
 
+    // Same as above for size bytes of data. The message is returned as a
+    // pointer into the data and its length (no copying).
+    static bool findMessage(const char *data, size_t size, size_t &start, const char *&message, size_t &length);
+
+    // Finds all the messages in size bytes of data in one pass (by the same
+    // rules as findMessage) and appends their spans to spans. Returns the
+    // amount of bytes consumed (up to the incomplete message at the end).
+    static size_t findMessages(const char *data, size_t size, SpanList &spans);
+
     // Parses long from the string.
     // Returns INVALID_LONG if unsecsessful.
     // WARNING! 0 is an invalid long in followermaze.
     static long parseLong(const string &str);
 
+    // Same as above for length bytes of str (needs no terminating zero).
+    static long parseLong(const char *str, size_t length);
+
+    // Parses user ID from the first message in the string.
+    // Returns INVALID_LONG if there is no message or the ID is invalid.
+    static long parseUserId(const string &str);
+
+    // Same as above for size bytes of data.
+    static long parseUserId(const char *data, size_t size);
+
     // Parses event.m_payload and fills in the event.
     static void parseEvent(Event &event);
 
+    // Parses length bytes of message and fills in the event except for the
+    // payload. The message is parsed in one pass without allocating.
+    static void parseEvent(Event &event, const char *message, size_t length);
+
     // Returns true if event is valid according to the followermaze protocol.
     static bool isValidEvent(const Event &event);
 
+    // Finds the binary records in size bytes of data and appends their
+    // spans (without the length prefix) to spans. Returns the amount of bytes
+    // consumed (up to the incomplete record at the end).
+    static size_t findRecords(const char *data, size_t size, SpanList &spans);
+
+    // Parses length bytes of a binary record and fills in the event except
+    // for the payload. Returns the length of the original payload.
+    static size_t parseRecord(Event &event, const char *record, size_t length);
+
+    // Appends the binary record (with the length prefix) of the event.
+    static void encodeRecord(const Event &event, string &record);
+
+    // Formats the payload of a valid event (e.g. "5|P|1|2") into payload.
+    static void formatPayload(const Event &event, string &payload);
+
+    // Returns the length of the payload formatted by formatPayload.
+    static size_t getPayloadLength(const Event &event);
+
     // Turns payload into a message (LF terminated) which can be sent to a user.
     static void encodeMessage(const string &payload, string &message);
 
+    // Same as above, but turns the payload into the message in place.
+    static void encodeMessage(string &payload);
+
     // Some constants for parsing.
     static const long FIRST_SEQNUM = 1l;
     static const long INVALID_LONG = -1l;
@@ -183,6 +274,16 @@ struct Parser
     static const char TYPE_PRIVATE = 'P';
     static const char TYPE_STATUSUPDATE = 'S';
     static const char TYPE_INVALID = '.';
+
+    // Binary records follow BINARY_MAGIC. A record is prefixed by its length
+    // (16 bits) and holds (big endian) a 64 bit sequence #, the type (8
+    // bits), 64 bit from and to user IDs (0 if none), and the length of the
+    // text payload of the event (16 bits). Bytes beyond RECORD_LENGTH are
+    // ignored.
+    static const char *BINARY_MAGIC;
+    static const size_t BINARY_MAGIC_LENGTH = 4;
+    static const size_t RECORD_PREFIX_LENGTH = 2;
+    static const size_t RECORD_LENGTH = 27;
 };
 
 /*
@@ -201,17 +302,37 @@ public:
     // Should be initialized with a reference to Engine to be able to create
     // Engine driven clients.
     EngineDrivenClientFactory(Engine &engine) :
-        m_engine(engine)
+        m_engine(engine),
+        m_readBudget(Client::DEFAULT_READ_BUDGET),
+        m_outputBudget(NULL)
     {
     }
 
     virtual EventHandler *createEventHandler(auto_ptr<Connection> connection, Reactor &reactor)
     {
-        return new ClientType(connection, reactor, m_engine);
+        ClientType *client = new ClientType(connection, reactor, m_engine);
+        client->setReadBudget(m_readBudget);
+        client->setOutputBudget(m_outputBudget);
+        return client;
+    }
+
+    // Sets max amount of bytes the created clients receive per call back.
+    void setReadBudget(size_t budget)
+    {
+        m_readBudget = budget;
+    }
+
+    // Sets the budget bounding output of the created clients (must outlive
+    // them).
+    void setOutputBudget(OutputBudget *budget)
+    {
+        m_outputBudget = budget;
     }
 
 private:
     Engine &m_engine;
+    size_t m_readBudget;
+    OutputBudget *m_outputBudget;
 };
 
 } // namespace protocol
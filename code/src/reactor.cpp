@@ -1,145 +1,573 @@
 #include <errno.h>
+#include <climits>
 #include <assert.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/eventfd.h>
 #include "reactor.h"
+#ifdef FOLLOWERMAZE_HAVE_IO_URING
+#include "uringdemultiplexer.h"
+#endif
 
 namespace followermaze
 {
 
-Reactor::Reactor()
+Reactor::Reactor(Backend backend) :
+    m_backend(backend),
+    m_demultiplexer(createDemultiplexer(m_backend)),
+    m_round(0),
+    m_timers(now()),
+    m_thread(pthread_self()),
+    m_wakeupPending(0)
 {
-    for (unsigned int i = 0; i < MAX_FDS; ++i)
+    m_wakeupHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeupHandle < 0)
     {
-        m_pollfds[i].fd = -1;
-        m_pollfds[i].events = 0;
-        m_pollfds[i].revents = 0;
-        m_handlers[i] = NULL;
+        throw Exception(errno);
+    }
+
+    try
+    {
+        m_demultiplexer->add(Demultiplexer::WAKEUP_HINT, m_wakeupHandle, Demultiplexer::InterestRead);
+    }
+    catch (...)
+    {
+        close(m_wakeupHandle);
+        throw;
     }
 }
 
 Reactor::~Reactor()
 {
-    for (unsigned int i = 0; i < MAX_FDS; ++i)
+    for (size_t i = 0; i < m_slots.size(); ++i)
     {
-        delete m_handlers[i];
+        if (m_slots[i].m_handler == NULL)
+        {
+            continue;
+        }
+
+        // No send or receive may be in flight once the data is gone.
+        try
+        {
+            m_demultiplexer->remove(static_cast<int>(i), m_slots[i].m_handle);
+        }
+        catch (...)
+        {
+        }
+
+        delete m_slots[i].m_handler;
     }
+
+    // Not run tasks are disposed of by m_tasks.
+    close(m_wakeupHandle);
 }
 
-void Reactor::addHandler(auto_ptr<EventHandler> handler, EventType event)
+int Reactor::addHandler(auto_ptr<EventHandler> handler, EventType event)
 {
     if (handler.get() == NULL)
     {
         throw Exception();
     }
 
-    int handle = static_cast<int>(handler->getHandle());
-    int freeSlot = MAX_FDS;
-
-    // Find a free slot.
-    for (unsigned int i = 0; i < MAX_FDS; ++i)
+    Handle handle = handler->getHandle();
+    if (handle < 0)
     {
-        if (m_pollfds[i].fd < 0)
-        {
-            freeSlot = i;
-            break;
-        }
+        throw Exception();
+    }
 
-        if (m_pollfds[i].fd == handle)
-        {
-            // Trying to register same handle twice.
-            throw Exception(Exception::ErrHandleDuplicate);
-        }
+    if (static_cast<size_t>(handle) >= m_slotByHandle.size())
+    {
+        m_slotByHandle.resize(handle + 1, -1);
+    }
+    else if (m_slotByHandle[handle] >= 0)
+    {
+        // Trying to register same handle twice.
+        throw Exception(Exception::ErrHandleDuplicate);
     }
 
-    if (freeSlot == MAX_FDS)
+    // Take a free slot or grow the table.
+    int freeSlot = m_freeSlots.empty() ? static_cast<int>(m_slots.size()) : m_freeSlots.back();
+
+    m_demultiplexer->add(freeSlot, handle, toInterest(event));
+
+    if (m_freeSlots.empty())
+    {
+        Slot unused;
+        unused.m_handler = NULL;
+        unused.m_handle = INVALID_HANDLE;
+        unused.m_event = 0;
+        unused.m_round = 0;
+        unused.m_outputDeferred = false;
+        m_slots.push_back(unused);
+    }
+    else
     {
-        // No more room.
-        throw Exception(Exception::ErrBusy);
+        m_freeSlots.pop_back();
     }
 
-    m_pollfds[freeSlot].fd = handle;
-    m_handlers[freeSlot] = handler.release();
-    m_pollfds[freeSlot].revents = 0;
-    resetHandler(freeSlot, event);
+    Slot &slot = m_slots[freeSlot];
+    slot.m_handler = handler.release();
+    slot.m_handle = handle;
+    slot.m_event = event;
+    slot.m_round = m_round;
+    slot.m_outputDeferred = false;
+    m_slotByHandle[handle] = freeSlot;
+
+    return freeSlot;
 }
 
 void Reactor::resetHandler(int hint, EventType event)
 {
-    if (hint < 0 || hint >= MAX_FDS)
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL)
     {
         throw Exception();
     }
 
-    m_pollfds[hint].events = 0;
+    Slot &slot = m_slots[hint];
+    if (slot.m_event != event)
+    {
+        m_demultiplexer->modify(hint, slot.m_handle, toInterest(event));
+        slot.m_event = event;
+    }
+}
 
-    if ((event & EvntAccept) || (event & EvntRead))
+Reactor::EventType Reactor::getEvent(int hint) const
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL)
     {
-        m_pollfds[hint].events |= POLLIN;
+        throw Exception();
     }
 
-    if (event & EvntWrite)
+    return m_slots[hint].m_event;
+}
+
+void Reactor::resumeHandler(int hint)
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL)
+    {
+        throw Exception();
+    }
+
+    Slot &slot = m_slots[hint];
+    if (slot.m_event & EvntEdge)
     {
-        m_pollfds[hint].events |= POLLOUT;
+        m_demultiplexer->modify(hint, slot.m_handle, toInterest(slot.m_event));
     }
 }
 
 EventHandler* Reactor::detouchHandler(int hint)
 {
-    if (hint < 0 || hint >= MAX_FDS)
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()))
     {
         throw Exception();
     }
 
-    m_pollfds[hint].fd = -1;
-    m_pollfds[hint].events = 0;
-    m_pollfds[hint].revents = 0;
+    Slot &slot = m_slots[hint];
+    if (slot.m_handle < 0)
+    {
+        // Not in use.
+        return NULL;
+    }
+
+    m_demultiplexer->remove(hint, slot.m_handle);
+    m_timers.cancel(hint);
+    m_slotByHandle[slot.m_handle] = -1;
+    m_freeSlots.push_back(hint);
 
-    EventHandler *handler = m_handlers[hint];
-    m_handlers[hint] = NULL;
+    EventHandler *handler = slot.m_handler;
+    slot.m_handler = NULL;
+    slot.m_handle = INVALID_HANDLE;
+    slot.m_event = 0;
+    slot.m_outputDeferred = false;
 
     return handler;
 }
 
+void Reactor::scheduleTimeout(int hint, long timeout)
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL || timeout < 0)
+    {
+        throw Exception();
+    }
+
+    // The wheel isn't advanced while there are no timers.
+    TimerWheel::Tick current = now();
+    m_timers.advance(current);
+    m_timers.schedule(hint, current + timeout);
+}
+
+void Reactor::cancelTimeout(int hint)
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()))
+    {
+        throw Exception();
+    }
+
+    m_timers.cancel(hint);
+}
+
+void Reactor::deferOutput(int hint)
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL)
+    {
+        throw Exception();
+    }
+
+    Slot &slot = m_slots[hint];
+    if (!slot.m_outputDeferred)
+    {
+        slot.m_outputDeferred = true;
+        m_deferred.push_back(hint);
+    }
+}
+
+bool Reactor::canSend() const
+{
+    return m_demultiplexer->canSend();
+}
+
+void Reactor::send(int hint, const struct msghdr *message)
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL)
+    {
+        throw Exception();
+    }
+
+    m_demultiplexer->send(hint, m_slots[hint].m_handle, message);
+}
+
+bool Reactor::receive(int hint)
+{
+    if (hint < 0 || hint >= static_cast<int>(m_slots.size()) || m_slots[hint].m_handler == NULL)
+    {
+        throw Exception();
+    }
+
+    return m_demultiplexer->receive(hint, m_slots[hint].m_handle);
+}
+
 void Reactor::handleEvents()
 {
-    int res = poll(m_pollfds, MAX_FDS, -1);
+    handleDeferredOutput();
+
+    long timeout = m_timers.nextTimeout(now());
+
+    unsigned long started = LoopStats::now();
+    m_demultiplexer->wait(m_ready, timeout > INT_MAX ? INT_MAX : static_cast<int>(timeout));
+    unsigned long woken = LoopStats::now();
 
-    if  (res < 0)
+    // Handlers registered from now on can't be the subject of the events
+    // being dispatched (even if they reuse a slot freed in this round).
+    ++m_round;
+
+    for (Demultiplexer::EventList::const_iterator it = m_ready.begin();
+                                                  it != m_ready.end();
+                                                  ++it)
     {
-        throw Exception(errno);
+        int i = it->m_hint;
+
+        if (i == Demultiplexer::WAKEUP_HINT)
+        {
+            // Tasks have been posted. Reset the eventfd counter.
+            uint64_t counter;
+            ssize_t res = read(m_wakeupHandle, &counter, sizeof(counter));
+            (void)res;
+            continue;
+        }
+
+        EventHandler *handler = m_slots[i].m_handler;
+        if (!isDispatchable(i, handler))
+        {
+            // The handler has been disposed of while handling previous
+            // events of this round.
+            continue;
+        }
+
+        // The handler may be gone after the call backs.
+        const char *category = handler->getCategory();
+        unsigned long dispatched = LoopStats::now();
+
+        dispatch(i, handler, *it);
+
+        m_stats.recordCallback(category, LoopStats::now() - dispatched);
+    }
+
+    handleTimeouts();
+    runTasks();
+
+    m_stats.recordIteration(woken - started, LoopStats::now() - woken, m_ready.size());
+}
+
+void Reactor::dispatch(int hint, EventHandler *handler, const Demultiplexer::Event &event)
+{
+    unsigned int ready = event.m_ready;
+
+    if (ready & Demultiplexer::ReadySent)
+    {
+        handler->handleSent(hint, event.m_result);
+        return;
     }
 
-    int handledEvents = 0;
-    for (int i = 0; i < MAX_FDS && handledEvents < res; ++i)
+    if (ready & Demultiplexer::ReadyReceived)
     {
-        if (m_pollfds[i].revents != 0)
+        handler->handleReceived(hint, event.m_data, event.m_result);
+        return;
+    }
+
+    if (ready & Demultiplexer::ReadyErr)
+    {
+        // Usually nothing else can be done with the Handle and the handler
+        // disposes of itself. A handler which finds the error harmless
+        // (e.g. completions of zero-copy sends in the error queue) stays and
+        // gets the rest of the readiness.
+        handler->handleError(hint);
+        if (!isDispatchable(hint, handler))
         {
-            assert(m_handlers[i] != NULL);
+            return;
+        }
+    }
 
-            short revents = m_pollfds[i].revents;
-            m_pollfds[i].revents = 0;
+    // All the readiness is handled in one go: input, output, and close.
+    // Input is handled before close so the data which arrived before
+    // hangup is not lost. Each call back may dispose of the handler.
+    if (ready & Demultiplexer::ReadyIn)
+    {
+        handler->handleInput(hint);
+    }
 
-            EventHandler *handler = m_handlers[i];
+    if ((ready & Demultiplexer::ReadyOut) && isDispatchable(hint, handler))
+    {
+        handler->handleOutput(hint);
+    }
 
-            if ((revents & POLLERR) || (revents & POLLNVAL))
-            {
-                handler->handleError(i);
-            }
-            else if (revents & POLLHUP)
-            {
-                handler->handleClose(i);
-            }
-            else if (revents & POLLIN)
-            {
-                handler->handleInput(i);
-            }
-            else if (revents & POLLOUT)
+    if ((ready & Demultiplexer::ReadyHup) && isDispatchable(hint, handler))
+    {
+        handler->handleClose(hint);
+    }
+}
+
+void Reactor::post(auto_ptr<Task> task)
+{
+    if (task.get() == NULL)
+    {
+        throw Exception();
+    }
+
+    m_tasks.push(task);
+    wakeup();
+}
+
+void Reactor::wakeup()
+{
+    // Signal unless it has been signalled already and the thread hasn't run
+    // the tasks yet (it will find the new ones then).
+    if (__atomic_exchange_n(&m_wakeupPending, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        uint64_t counter = 1;
+        ssize_t res = write(m_wakeupHandle, &counter, sizeof(counter));
+        (void)res;
+    }
+}
+
+void Reactor::attachThread()
+{
+    m_thread = pthread_self();
+}
+
+bool Reactor::isInLoopThread() const
+{
+    return pthread_equal(m_thread, pthread_self()) != 0;
+}
+
+void Reactor::runTasks()
+{
+    // Nothing has been posted since the last run unless a wakeup has been
+    // signalled. Clear the signal before popping so that tasks posted from
+    // now on signal again (the exchange is a full barrier).
+    if (__atomic_load_n(&m_wakeupPending, __ATOMIC_RELAXED) == 0 ||
+        __atomic_exchange_n(&m_wakeupPending, 0, __ATOMIC_SEQ_CST) == 0)
+    {
+        return;
+    }
+
+    Task *task;
+    while ((task = m_tasks.pop()) != NULL)
+    {
+        auto_ptr<Task> owned(task);
+
+        try
+        {
+            owned->run();
+        }
+        catch (...)
+        {
+            // The rest stays in the queue. Make sure it is run next time.
+            wakeup();
+            throw;
+        }
+    }
+}
+
+bool Reactor::isDispatchable(int hint, EventHandler *handler) const
+{
+    // The slot may have been reused by a handler added in this round (even
+    // at the same address).
+    const Slot &slot = m_slots[hint];
+    return handler != NULL && slot.m_handler == handler && slot.m_round != m_round;
+}
+
+void Reactor::handleTimeouts()
+{
+    if (m_timers.size() == 0)
+    {
+        return;
+    }
+
+    // Handlers registered from now on can't be the subject of the expired
+    // timeouts.
+    ++m_round;
+
+    m_expired.clear();
+    m_timers.expire(now(), m_expired);
+
+    for (TimerWheel::IdList::const_iterator it = m_expired.begin(); it != m_expired.end(); ++it)
+    {
+        int i = *it;
+        Slot &slot = m_slots[i];
+
+        // Skip handlers disposed of, added, or rescheduled by the callbacks
+        // called before.
+        if (slot.m_handler == NULL || slot.m_round == m_round || m_timers.isScheduled(i))
+        {
+            continue;
+        }
+
+        EventHandler *handler = slot.m_handler;
+        const char *category = handler->getCategory();
+        unsigned long started = LoopStats::now();
+
+        handler->handleTimeout(i);
+
+        m_stats.recordCallback(category, LoopStats::now() - started);
+    }
+}
+
+void Reactor::handleDeferredOutput()
+{
+    // The list may grow while the handlers are called back. A slot may have
+    // been detouched (and reused) meanwhile, then it's not deferred anymore
+    // (or listed again).
+    size_t i = 0;
+    try
+    {
+        for (; i < m_deferred.size(); ++i)
+        {
+            Slot &slot = m_slots[m_deferred[i]];
+            if (!slot.m_outputDeferred)
             {
-                handler->handleOutput(i);
+                continue;
             }
 
-            handledEvents++;
+            slot.m_outputDeferred = false;
+
+            EventHandler *handler = slot.m_handler;
+            const char *category = handler->getCategory();
+            unsigned long started = LoopStats::now();
+
+            handler->handleOutput(m_deferred[i]);
+
+            m_stats.recordCallback(category, LoopStats::now() - started);
+        }
+    }
+    catch (...)
+    {
+        // The rest is called back next time.
+        m_deferred.erase(m_deferred.begin(), m_deferred.begin() + i + 1);
+        throw;
+    }
+
+    m_deferred.clear();
+}
+
+TimerWheel::Tick Reactor::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<TimerWheel::Tick>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+const LoopStats &Reactor::getStats() const
+{
+    return m_stats;
+}
+
+Reactor::Backend Reactor::getBackend() const
+{
+    return m_backend;
+}
+
+const char *Reactor::getBackendName(Backend backend)
+{
+    switch (backend)
+    {
+    case BackendPoll:
+        return "poll";
+    case BackendEpoll:
+        return "epoll";
+    case BackendUring:
+        return "io_uring";
+    default:
+        return "unknown";
+    }
+}
+
+Demultiplexer *Reactor::createDemultiplexer(Backend &backend)
+{
+    switch (backend)
+    {
+    case BackendPoll:
+        return new PollDemultiplexer();
+    case BackendEpoll:
+        return new EpollDemultiplexer();
+    case BackendUring:
+#ifdef FOLLOWERMAZE_HAVE_IO_URING
+        try
+        {
+            return new UringDemultiplexer();
         }
+        catch (const Demultiplexer::Exception&)
+        {
+            // Not supported by the kernel (or disabled).
+        }
+#endif
+        backend = BackendEpoll;
+        return new EpollDemultiplexer();
+    default:
+        throw Exception();
+    }
+}
+
+unsigned int Reactor::toInterest(EventType event)
+{
+    unsigned int interest = 0;
+
+    if ((event & EvntAccept) || (event & EvntRead))
+    {
+        interest |= Demultiplexer::InterestRead;
+    }
+
+    if (event & EvntWrite)
+    {
+        interest |= Demultiplexer::InterestWrite;
     }
+
+    if (event & EvntEdge)
+    {
+        interest |= Demultiplexer::InterestEdge;
+    }
+
+    return interest;
 }
 
 } // namespace followermaze
@@ -3,10 +3,15 @@
 #ifndef REACTOR_H
 #define REACTOR_H
 
-#include <poll.h>
 #include <memory>
+#include <vector>
+#include <pthread.h>
 #include "exception.h"
 #include "eventhandler.h"
+#include "demultiplexer.h"
+#include "timerwheel.h"
+#include "task.h"
+#include "stats.h"
 
 namespace followermaze
 {
@@ -15,16 +20,33 @@ namespace followermaze
  * demultiplexing.
  * Reactor owns event handlers and disposes of them at destruction unless
  * disposed of as a reaction to an event.
- * This implementation uses poll mechanism and hard-coded (1024) amount of
- * descriptors. Obviously, implementations using single instance of this
- * Reactor will be limited to 1024 files (sockets). This is probably a
- * reasonable limitation for a poll based implementation. poll is relatively
- * slow and gets slower linearly with the number of descriptors.
- * Implementations aiming at handling thousands of concurrent connections
- * could use multiple server threads each using its own Reactor. This would
- * require Reactor to be made thread safe.
- * Better option would be to use event based dispatching (e.g. epoll, kqueue),
- * but it's less portable and makes code more compicated.
+ * Waiting for events is delegated to a Demultiplexer. Three backends are
+ * available:
+ *  - poll: portable, but the cost of every wakeup is linear in the number of
+ *    slots.
+ *  - epoll: Linux only, the cost of a wakeup is linear in the number of ready
+ *    descriptors.
+ *  - io_uring: Linux 5.11+, one system call per wakeup. Handlers can also
+ *    have their sends and receives done by the backend (see send and
+ *    receive) in the same system call.
+ * The backend is chosen at construction time. The default one is chosen at
+ * build time (see FOLLOWERMAZE_USE_EPOLL).
+ * The table of handlers grows on demand so the amount of handlers is limited
+ * by the amount of descriptors the process is allowed to open only (see
+ * Connection::raiseHandleLimit). Free slots are kept in a list and slots are
+ * indexed by Handle so adding, resetting and detouching a handler take
+ * constant time.
+ * Each handler can have a timeout scheduled (see scheduleTimeout). Timeouts
+ * are kept in a TimerWheel with one millisecond ticks so scheduling and
+ * cancelling take constant time, and waiting for events is limited by the
+ * nearest timeout.
+ * Reactor keeps statistics of the event loop (see LoopStats) which can be
+ * read from any thread.
+ * Reactor is not thread safe except for post which can be used to hand work
+ * (Tasks) over to the thread handling events from other threads. Posting is
+ * lock-free (see TaskQueue) and wakes the thread up through an eventfd
+ * watched along with the handlers. This allows to run multiple server
+ * threads each using its own Reactor.
  */
 class Reactor
 {
@@ -34,8 +56,7 @@ public:
     public:
         enum
         {
-            ErrBusy = BaseException::ErrGeneric + 1, // No more slots
-            ErrHandleDuplicate, // Trying to register the same handle twice
+            ErrHandleDuplicate = BaseException::ErrGeneric + 1, // Trying to register the same handle twice
             ErrStop // Stop the reaction (should be thrown by an EventHandler)!
         };
 
@@ -43,39 +64,191 @@ public:
         virtual const char* what() const throw() { return "Reactor::Exception#"; }
     };
 
-    // Supported event types (can be OR-ed)
+    // Supported event types (can be OR-ed). With EvntEdge the handler is
+    // called back only when the Handle becomes ready (edge-triggered) so it
+    // has to read until there is no more data or call resumeHandler. Backends
+    // which don't support it (poll, io_uring) stay level-triggered.
     typedef unsigned int EventType;
     enum
     {
         EvntAccept = 0x01,
         EvntRead = 0x01,
-        EvntWrite = 0x02
+        EvntWrite = 0x02,
+        EvntEdge = 0x04
+    };
+
+    // Supported demultiplexing backends.
+    enum Backend
+    {
+        BackendPoll,
+        BackendEpoll,
+        BackendUring,
+#ifdef FOLLOWERMAZE_USE_EPOLL
+        BackendDefault = BackendEpoll
+#else
+        BackendDefault = BackendPoll
+#endif
     };
 
 public:
-    Reactor();
+    // Falls back to epoll if io_uring is requested but not available.
+    Reactor(Backend backend = BackendDefault);
     virtual ~Reactor();
 
-    // Registers the handler (takes ownership) to handle event.
-    // Will throw if handler is NULL, a handler with the same Handle
-    // has been already registered, or out of room.
-    void addHandler(auto_ptr<EventHandler> handler, EventType event);
+    // Registers the handler (takes ownership) to handle event. Returns the
+    // hint the handler will be called back with.
+    // Will throw if handler is NULL, or a handler with the same Handle
+    // has been already registered.
+    int addHandler(auto_ptr<EventHandler> handler, EventType event);
 
     // Makes a handler which has been called back with the hint to handle event.
     void resetHandler(int hint, EventType event);
 
+    // Returns the event a handler which has been called back with the hint
+    // is registered to handle.
+    EventType getEvent(int hint) const;
+
+    // Makes an edge-triggered handler which has been called back with the
+    // hint to be called back again in one of the next rounds if its Handle
+    // is still ready. Used by handlers which stop handling input before
+    // there is no more data (e.g. for fairness). Does nothing for level-
+    // triggered handlers.
+    void resumeHandler(int hint);
+
     // Deregister an event handler which has been called back with the hint.
     // Ownership is passed to the caller.
     EventHandler* detouchHandler(int hint);
 
-    // Waits for events and dispatches them to the EventHandler's callbacks.
-    // Throws on poll error. Passes through all exceptions from EventHandlers.
+    // Schedules a call to handleTimeout of the handler which has been called
+    // back with the hint in timeout milliseconds. Replaces the timeout
+    // scheduled before (if any). Timeouts are one-shot.
+    void scheduleTimeout(int hint, long timeout);
+
+    // Cancels the timeout of the handler which has been called back with the
+    // hint. Detouching the handler cancels it, too.
+    void cancelTimeout(int hint);
+
+    // Makes the handler which has been called back with the hint be called
+    // back by handleOutput right before the next wait (once, however many
+    // times asked). Lets a handler hand all the output it gets in a round
+    // over at once (see send).
+    void deferOutput(int hint);
+
+    // Returns true if the backend can send on behalf of the handlers
+    // (io_uring). Otherwise handlers wait for EvntWrite and send themselves.
+    bool canSend() const;
+
+    // Queues sending of message on the Handle of the handler which has been
+    // called back with the hint (see canSend). The send goes to the kernel
+    // with the next wait and handleSent is called back when it's done.
+    // message and the data must stay intact until then or until the handler
+    // is detouched.
+    void send(int hint, const struct msghdr *message);
+
+    // Queues receiving from the Handle of the handler which has been called
+    // back with the hint into a buffer of the backend (io_uring). Returns
+    // false if not supported or no buffer is free. Otherwise handleReceived
+    // is called back with the data.
+    bool receive(int hint);
+
+    // Waits for events (or the nearest timeout) and dispatches them to the
+    // EventHandler's callbacks. If an error is reported for a Handle
+    // handleError is called first. Then handleInput, handleOutput, and
+    // handleClose are called (in this order) for what is ready until the
+    // handler is disposed of. Done sends and receives are dispatched on
+    // their own (handleSent and handleReceived).
+    // Throws on demultiplexing error. Passes through all exceptions from
+    // EventHandlers.
     void handleEvents();
 
+    // Queues the task (takes ownership) to be run by the thread handling
+    // events after dispatching the events of a round and wakes the thread up.
+    // Tasks posted by a thread are run in the order they have been posted.
+    // The only method which can be called from any thread.
+    void post(auto_ptr<Task> task);
+
+    // Makes the calling thread the one handling events. Should be called
+    // before handling events in a thread other than the one which has
+    // created the Reactor.
+    void attachThread();
+
+    // Returns true if called by the thread handling events.
+    bool isInLoopThread() const;
+
+    // Returns statistics of the event loop. Can be called from any thread.
+    const LoopStats &getStats() const;
+
+    // Returns the backend used by this Reactor.
+    Backend getBackend() const;
+
+    // Returns name of the backend ("poll", "epoll", or "io_uring").
+    static const char *getBackendName(Backend backend);
+
 protected:
-    static const int MAX_FDS = 1024;
-    struct pollfd m_pollfds[MAX_FDS];
-    EventHandler *m_handlers[MAX_FDS];
+    // Creates Demultiplexer for the backend. Updates the backend if had to
+    // fall back to other one.
+    static Demultiplexer *createDemultiplexer(Backend &backend);
+
+    // Translates EventType into Demultiplexer's interest.
+    static unsigned int toInterest(EventType event);
+
+    // Runs the posted tasks.
+    void runTasks();
+
+    // Wakes the thread handling events up to run the posted tasks.
+    void wakeup();
+
+    // Calls back the handler for the event reported for the hint.
+    void dispatch(int hint, EventHandler *handler, const Demultiplexer::Event &event);
+
+    // Returns true if the handler still handles the slot and can be called
+    // back in the current round.
+    bool isDispatchable(int hint, EventHandler *handler) const;
+
+    // Calls back the handlers which have timed out.
+    void handleTimeouts();
+
+    // Calls back the handlers which have deferred output.
+    void handleDeferredOutput();
+
+    // Returns monotonic time in milliseconds.
+    static TimerWheel::Tick now();
+
+protected:
+    // Slot keeps a registered handler and its state.
+    struct Slot
+    {
+        EventHandler *m_handler;
+        Handle m_handle;
+        EventType m_event;
+        unsigned long m_round; // Dispatch round the handler was added in.
+        bool m_outputDeferred; // Listed in m_deferred.
+    };
+
+    typedef vector< Slot > SlotTable;
+    typedef vector< int > SlotList;
+
+    Backend m_backend;
+    auto_ptr<Demultiplexer> m_demultiplexer;
+    SlotTable m_slots;
+    SlotList m_freeSlots;     // Unused slots (most recently freed in the back).
+    SlotList m_slotByHandle;  // Slot used by a Handle (-1 if not registered).
+    Demultiplexer::EventList m_ready;
+    unsigned long m_round; // Current dispatch round.
+    TimerWheel m_timers;   // Timeouts by slot.
+    TimerWheel::IdList m_expired;
+    SlotList m_deferred;   // Slots which have deferred output.
+    LoopStats m_stats;
+
+    pthread_t m_thread;        // Thread handling events.
+    Handle m_wakeupHandle;     // eventfd used to interrupt waiting.
+    int m_wakeupPending;       // Wakeup has been signalled (atomic).
+    TaskQueue m_tasks;         // Posted tasks.
+
+private:
+    // Make non-copyable.
+    Reactor(const Reactor&);
+    Reactor& operator=(const Reactor&);
 };
 
 } // namespace followermaze
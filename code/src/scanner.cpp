@@ -0,0 +1,264 @@
+#include <assert.h>
+#include "scanner.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FOLLOWERMAZE_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace followermaze
+{
+
+const size_t DelimiterScanner::BLOCK;
+
+DelimiterScanner::DelimiterScanner(char first, char second, Isa isa) :
+    m_first(first),
+    m_second(second),
+    m_isa(isa)
+{
+    if (m_isa == IsaBest || !isSupported(m_isa))
+    {
+        m_isa = isSupported(IsaAvx2) ? IsaAvx2 : isSupported(IsaSse2) ? IsaSse2 : IsaScalar;
+    }
+
+    switch (m_isa)
+    {
+    case IsaAvx2:
+        m_classify = classifyAvx2;
+        break;
+    case IsaSse2:
+        m_classify = classifySse2;
+        break;
+    default:
+        m_classify = classifyScalar;
+        break;
+    }
+}
+
+size_t DelimiterScanner::scan(const char *data, size_t size, SpanList &spans) const
+{
+    size_t start = 0;      // Of the current message.
+    bool inMessage = true; // Looking for the end of the message (or the start of the next one).
+    Mask carry = 0;        // The last byte of the previous block is a delimiter.
+
+    for (size_t base = 0; base < size; base += BLOCK)
+    {
+        Mask delimiters = 0;
+        Mask valid = ~static_cast<Mask>(0);
+        if (size - base >= BLOCK)
+        {
+            delimiters = m_classify(data + base, m_first, m_second);
+        }
+        else
+        {
+            delimiters = classify(data + base, size - base, m_first, m_second);
+            valid = (static_cast<Mask>(1) << (size - base)) - 1;
+        }
+
+        // Messages end where runs of delimiters start and start where they
+        // end, so the edges alternate between the two.
+        Mask edges = (delimiters ^ (delimiters << 1 | carry)) & valid;
+        carry = delimiters >> (BLOCK - 1);
+
+        for (; edges != 0; edges &= edges - 1)
+        {
+            size_t offset = base + __builtin_ctzll(edges);
+            if (inMessage)
+            {
+                Span span;
+                span.m_offset = start;
+                span.m_length = offset - start;
+                spans.push_back(span);
+            }
+            else
+            {
+                start = offset;
+            }
+
+            inMessage = !inMessage;
+        }
+    }
+
+    // Delimiters up to the end leave nothing to wait for.
+    return inMessage ? start : size;
+}
+
+DelimiterScanner::Isa DelimiterScanner::getIsa() const
+{
+    return m_isa;
+}
+
+bool DelimiterScanner::isSupported(Isa isa)
+{
+    switch (isa)
+    {
+    case IsaScalar:
+        return true;
+#ifdef FOLLOWERMAZE_SCANNER_X86
+    case IsaSse2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case IsaAvx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char *DelimiterScanner::getIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case IsaScalar:
+        return "scalar";
+    case IsaSse2:
+        return "sse2";
+    case IsaAvx2:
+        return "avx2";
+    default:
+        return "best";
+    }
+}
+
+DelimiterScanner::Mask DelimiterScanner::classify(const char *data, size_t length, char first, char second)
+{
+    Mask mask = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (data[i] == first || data[i] == second)
+        {
+            mask |= static_cast<Mask>(1) << i;
+        }
+    }
+
+    return mask;
+}
+
+DelimiterScanner::Mask DelimiterScanner::classifyScalar(const char *block, char first, char second)
+{
+    return classify(block, BLOCK, first, second);
+}
+
+#ifdef FOLLOWERMAZE_SCANNER_X86
+
+__attribute__((target("sse2")))
+DelimiterScanner::Mask DelimiterScanner::classifySse2(const char *block, char first, char second)
+{
+    const __m128i firsts = _mm_set1_epi8(first);
+    const __m128i seconds = _mm_set1_epi8(second);
+
+    Mask mask = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, firsts), _mm_cmpeq_epi8(bytes, seconds));
+        mask |= static_cast<Mask>(static_cast<unsigned int>(_mm_movemask_epi8(matches))) << (16 * i);
+    }
+
+    return mask;
+}
+
+__attribute__((target("avx2")))
+DelimiterScanner::Mask DelimiterScanner::classifyAvx2(const char *block, char first, char second)
+{
+    const __m256i firsts = _mm256_set1_epi8(first);
+    const __m256i seconds = _mm256_set1_epi8(second);
+
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    __m256i lowMatches = _mm256_or_si256(_mm256_cmpeq_epi8(low, firsts), _mm256_cmpeq_epi8(low, seconds));
+    __m256i highMatches = _mm256_or_si256(_mm256_cmpeq_epi8(high, firsts), _mm256_cmpeq_epi8(high, seconds));
+
+    return static_cast<Mask>(static_cast<unsigned int>(_mm256_movemask_epi8(lowMatches))) |
+           static_cast<Mask>(static_cast<unsigned int>(_mm256_movemask_epi8(highMatches))) << 32;
+}
+
+#else
+
+// Never picked (see isSupported).
+DelimiterScanner::Mask DelimiterScanner::classifySse2(const char *block, char first, char second)
+{
+    return classifyScalar(block, first, second);
+}
+
+DelimiterScanner::Mask DelimiterScanner::classifyAvx2(const char *block, char first, char second)
+{
+    return classifyScalar(block, first, second);
+}
+
+#endif // FOLLOWERMAZE_SCANNER_X86
+
+/*----------------------------------------------------------------------------*/
+
+Framer::Framer(char first, char second, DelimiterScanner::Isa isa) :
+    m_scanner(first, second, isa),
+    m_scanned(0),
+    m_delimiting(false)
+{
+}
+
+size_t Framer::frame(const char *data, size_t size, SpanList &spans)
+{
+    assert(size >= m_scanned);
+    if (size == m_scanned)
+    {
+        return 0;
+    }
+
+    // Resume where the last scan stopped: the incomplete message at the front
+    // (if any) has no delimiter up to m_scanned.
+    size_t first = spans.size();
+    size_t resumed = m_scanner.scan(data + m_scanned, size - m_scanned, spans);
+    bool ended = (resumed == size - m_scanned);
+    bool found = (first < spans.size());
+
+    for (size_t i = first; i < spans.size(); ++i)
+    {
+        spans[i].m_offset += m_scanned;
+    }
+
+    if (found)
+    {
+        if (m_scanned > 0)
+        {
+            // The first message started before the resumed scan.
+            spans[first].m_offset = 0;
+            spans[first].m_length += m_scanned;
+        }
+        else if (m_delimiting && spans[first].m_length == 0)
+        {
+            // The rest of the run of delimiters which ended the data consumed
+            // before, not an empty message.
+            spans.erase(spans.begin() + first);
+        }
+    }
+
+    size_t consumed = 0;
+    if (ended)
+    {
+        consumed = size;
+    }
+    else if (found)
+    {
+        consumed = m_scanned + resumed;
+    }
+
+    m_delimiting = ended;
+    m_scanned = size - consumed;
+    return consumed;
+}
+
+void Framer::reset()
+{
+    m_scanned = 0;
+    m_delimiting = false;
+}
+
+size_t Framer::getScanned() const
+{
+    return m_scanned;
+}
+
+} // namespace followermaze
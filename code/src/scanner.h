@@ -0,0 +1,125 @@
+/* This file declears DelimiterScanner and Framer classes.
+ */
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* Span locates m_length bytes at m_offset of a chunk of data.
+ */
+struct Span
+{
+    size_t m_offset;
+    size_t m_length;
+};
+
+typedef vector< Span > SpanList;
+
+/* DelimiterScanner splits a chunk of data into messages terminated by runs of
+ * delimiters (either of two bytes, e.g. CR and LF) in one pass.
+ * The data is classified 64 bytes at a time into a bitmask of delimiters
+ * (using SSE2 or AVX2 if the CPU supports it, a scalar loop otherwise) and
+ * the message boundaries are taken off the mask by bit scans, so the cost per
+ * byte doesn't depend on the length of the messages. The instruction set is
+ * picked at construction time.
+ * DelimiterScanner doesn't change once constructed so it is thread safe.
+ */
+class DelimiterScanner
+{
+public:
+    // Instruction sets used to classify the data.
+    enum Isa
+    {
+        IsaScalar,
+        IsaSse2,
+        IsaAvx2,
+        IsaBest // The best one supported by the CPU.
+    };
+
+public:
+    // Falls back to the best supported instruction set if isa is not
+    // supported.
+    DelimiterScanner(char first, char second, Isa isa = IsaBest);
+
+    // Appends the spans of the complete messages in size bytes of data to
+    // spans. A message ends at the first delimiter after its start and the
+    // next one starts after the run of delimiters, so only data starting with
+    // a delimiter yields an empty message.
+    // Returns the amount of bytes consumed (all but the incomplete message
+    // at the end, if any).
+    size_t scan(const char *data, size_t size, SpanList &spans) const;
+
+    // Returns the instruction set used.
+    Isa getIsa() const;
+
+    // Returns true if the CPU supports the instruction set.
+    static bool isSupported(Isa isa);
+
+    // Returns name of the instruction set ("scalar", "sse2", or "avx2").
+    static const char *getIsaName(Isa isa);
+
+protected:
+    typedef unsigned long long Mask; // Bit per byte of a block.
+
+    static const size_t BLOCK = 64;
+
+    // Returns the mask of delimiters in a block.
+    typedef Mask (*Classifier)(const char *block, char first, char second);
+
+    // Returns the mask of delimiters in length (up to BLOCK) bytes of data.
+    static Mask classify(const char *data, size_t length, char first, char second);
+
+    // Classifiers of each instruction set.
+    static Mask classifyScalar(const char *block, char first, char second);
+    static Mask classifySse2(const char *block, char first, char second);
+    static Mask classifyAvx2(const char *block, char first, char second);
+
+protected:
+    char m_first;
+    char m_second;
+    Isa m_isa;
+    Classifier m_classify;
+};
+
+/* Framer splits a stream of data into messages (by the rules of
+ * DelimiterScanner) as it arrives. The data passed to frame is expected to be
+ * the data left unconsumed by the previous call with new data appended, and
+ * Framer remembers how far it has scanned it: the bytes of an incomplete
+ * message are not scanned again when the rest of the message arrives, so the
+ * cost per byte stays the same however finely the stream is fragmented. A run
+ * of delimiters split between two calls doesn't yield an empty message
+ * either. The state belongs to one stream, so each stream needs a Framer of
+ * its own.
+ * Framer is not thread safe.
+ */
+class Framer
+{
+public:
+    Framer(char first, char second, DelimiterScanner::Isa isa = DelimiterScanner::IsaBest);
+
+    // Appends the spans of the complete messages in size bytes of data to
+    // spans. Returns the amount of bytes consumed, which the data of the next
+    // call must not include.
+    size_t frame(const char *data, size_t size, SpanList &spans);
+
+    // Forgets the state of the stream (e.g. when a new one starts).
+    void reset();
+
+    // Returns the amount of bytes of an incomplete message scanned so far.
+    size_t getScanned() const;
+
+protected:
+    DelimiterScanner m_scanner;
+    size_t m_scanned;   // Bytes at the front of the data known to hold no delimiter.
+    bool m_delimiting;  // The consumed data ended with a delimiter.
+};
+
+} // namespace followermaze
+
+#endif // SCANNER_H
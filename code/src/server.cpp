@@ -5,8 +5,58 @@
 namespace followermaze
 {
 
+namespace
+{
+
+/* StopTask stops the reaction of the Reactor it is posted to.
+ */
+class StopTask : public Task
+{
+public:
+    virtual void run()
+    {
+        throw Reactor::Exception(Reactor::Exception::ErrStop);
+    }
+};
+
+} // namespace
+
+Server::Server(Reactor::Backend backend, int workers) :
+    m_reactor(backend)
+{
+    try
+    {
+        for (int i = 0; i < workers; ++i)
+        {
+            m_workers.push_back(new Reactor(backend));
+        }
+
+        m_reactors.push_back(&m_reactor);
+        m_reactors.insert(m_reactors.end(), m_workers.begin(), m_workers.end());
+    }
+    catch (...)
+    {
+        for (std::vector< Reactor* >::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+        {
+            delete *it;
+        }
+        throw;
+    }
+}
+
 Server::~Server()
 {
+    assert(m_threads.empty());
+
+    for (std::vector< Reactor* >::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+    {
+        delete *it;
+    }
+}
+
+const std::vector< Reactor* > &Server::getReactors() const
+{
+    return m_reactors;
 }
 
 void Server::serve()
@@ -15,6 +65,13 @@ void Server::serve()
     {
         initReactor();
 
+        for (unsigned int i = 0; i < m_workers.size(); ++i)
+        {
+            initWorker(*m_workers[i], i);
+        }
+
+        startWorkers();
+
         for (;;)
         {
             m_reactor.handleEvents();
@@ -24,11 +81,79 @@ void Server::serve()
     }
     catch (Reactor::Exception e)
     {
+        stopWorkers();
+
         if (e.getErr() == Reactor::Exception::ErrStop)
         {
             Logger::getInstance().info("Reactor stopped.");
         }
     }
+    catch (...)
+    {
+        stopWorkers();
+        throw;
+    }
+}
+
+void Server::initWorker(Reactor &/*reactor*/, int /*index*/)
+{
+}
+
+void Server::startWorkers()
+{
+    for (std::vector< Reactor* >::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+    {
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, runWorker, *it);
+        if (err != 0)
+        {
+            throw Reactor::Exception(err);
+        }
+
+        m_threads.push_back(thread);
+    }
+}
+
+void Server::stopWorkers()
+{
+    for (unsigned int i = 0; i < m_threads.size(); ++i)
+    {
+        m_workers[i]->post(auto_ptr<Task>(new StopTask));
+    }
+
+    for (std::vector< pthread_t >::iterator it = m_threads.begin(); it != m_threads.end(); ++it)
+    {
+        pthread_join(*it, NULL);
+    }
+
+    m_threads.clear();
+}
+
+void *Server::runWorker(void *reactor)
+{
+    Reactor *worker = static_cast<Reactor*>(reactor);
+    worker->attachThread();
+
+    try
+    {
+        for (;;)
+        {
+            worker->handleEvents();
+        }
+    }
+    catch (Reactor::Exception &e)
+    {
+        if (e.getErr() != Reactor::Exception::ErrStop)
+        {
+            Logger::getInstance().error("Worker failed. Error: ", e.what(), e.getErr());
+        }
+    }
+    catch (BaseException &e)
+    {
+        Logger::getInstance().error("Worker failed. Error: ", e.what(), e.getErr());
+    }
+
+    return NULL;
 }
 
 } // namespace followermaze
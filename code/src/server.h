@@ -3,6 +3,8 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <vector>
+#include <pthread.h>
 #include "reactor.h"
 
 namespace followermaze
@@ -11,23 +13,55 @@ namespace followermaze
 /* Server is an abstract class which implements the reaction (an endless
  * loop calling Reactor to handle events).
  * Subclasses should implement initialization method to seed the reaction.
+ * Server can run additional worker Reactors each in its own thread. Workers
+ * are seeded separately (e.g. with Acceptors sharing a port) and are stopped
+ * when the main reaction stops.
  */
 class Server
 {
 public:
+    // Creates Server which uses Reactors with the backend. workers is the
+    // number of Reactors to run in separate threads in addition to the main
+    // one.
+    Server(Reactor::Backend backend = Reactor::BackendDefault, int workers = 0);
     virtual ~Server();
 
-    // Template method which calls initReactor and then starts the reaction.
+    // Template method which calls initReactor and initWorker, starts the
+    // workers and then starts the reaction.
     // Returns if Reactor::Exception(Reactor::ErrStop) was caught.
     virtual void serve();
 
+    // Returns all the Reactors (the main one first, then the workers).
+    const std::vector< Reactor* > &getReactors() const;
+
 protected:
     // Reactor initialization routine. Should be implemented by subclasses
     // to seed (e.g. by registering an Acceptor) the reaction.
     virtual void initReactor() = 0;
 
+    // Worker Reactor initialization routine. Called for each worker before
+    // the workers are started. Does nothing by default.
+    virtual void initWorker(Reactor &reactor, int index);
+
+    // Starts a thread for each worker.
+    void startWorkers();
+
+    // Stops the workers and waits for the threads to finish.
+    void stopWorkers();
+
+    // Thread routine running the reaction of a worker.
+    static void *runWorker(void *reactor);
+
+private:
+    // Make non-copyable.
+    Server(const Server&);
+    Server& operator=(const Server&);
+
 protected:
     Reactor m_reactor;
+    std::vector< Reactor* > m_workers;
+    std::vector< Reactor* > m_reactors; // All the Reactors (main one first).
+    std::vector< pthread_t > m_threads;
 };
 
 } // namespace followermaze
@@ -0,0 +1,134 @@
+#include <cstdlib>
+#include <sstream>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include "socketaddress.h"
+
+namespace followermaze
+{
+
+namespace
+{
+
+// Parses a port number. Returns false if invalid.
+bool parsePort(const string &value, int &port)
+{
+    char *end = NULL;
+    long res = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || res <= 0 || res > 65535)
+    {
+        return false;
+    }
+
+    port = static_cast<int>(res);
+    return true;
+}
+
+// Returns true if host is a valid address of the family (AF_INET or AF_INET6).
+bool isHost(int family, const string &host)
+{
+    unsigned char addr[sizeof(struct in6_addr)];
+    return inet_pton(family, host.c_str(), addr) == 1;
+}
+
+} // namespace
+
+SocketAddress::SocketAddress(int port) :
+    m_family(FamilyTcp4),
+    m_port(port)
+{
+}
+
+bool SocketAddress::parse(const string &spec, SocketAddress &address)
+{
+    SocketAddress res;
+
+    if (spec.compare(0, 5, "unix:") == 0)
+    {
+        res.m_family = FamilyUnix;
+        res.m_path = spec.substr(5);
+        if (res.m_path.empty() || res.m_path.length() >= sizeof(((struct sockaddr_un *)0)->sun_path))
+        {
+            return false;
+        }
+    }
+    else if (spec.compare(0, 5, "tcp6:") == 0)
+    {
+        res.m_family = FamilyTcp6;
+        string rest = spec.substr(5);
+        if (!rest.empty() && rest[0] == '[')
+        {
+            size_t close = rest.find("]:");
+            if (close == string::npos)
+            {
+                return false;
+            }
+
+            res.m_host = rest.substr(1, close - 1);
+            rest = rest.substr(close + 2);
+            if (!isHost(AF_INET6, res.m_host))
+            {
+                return false;
+            }
+        }
+
+        if (!parsePort(rest, res.m_port))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        string rest = spec.compare(0, 5, "tcp4:") == 0 ? spec.substr(5) : spec;
+        size_t colon = rest.rfind(':');
+        if (colon != string::npos)
+        {
+            res.m_host = rest.substr(0, colon);
+            rest = rest.substr(colon + 1);
+            if (!isHost(AF_INET, res.m_host))
+            {
+                return false;
+            }
+        }
+
+        if (!parsePort(rest, res.m_port))
+        {
+            return false;
+        }
+    }
+
+    address = res;
+    return true;
+}
+
+string SocketAddress::toString() const
+{
+    ostringstream out;
+    switch (m_family)
+    {
+    case FamilyUnix:
+        out << "unix:" << m_path;
+        break;
+    case FamilyTcp6:
+        out << "tcp6:";
+        if (!m_host.empty())
+        {
+            out << "[" << m_host << "]:";
+        }
+        out << m_port;
+        break;
+    case FamilyTcp4:
+    default:
+        out << "tcp4:";
+        if (!m_host.empty())
+        {
+            out << m_host << ":";
+        }
+        out << m_port;
+        break;
+    }
+
+    return out.str();
+}
+
+} // namespace followermaze
@@ -0,0 +1,48 @@
+/* This file declears SocketAddress structure.
+ */
+#ifndef SOCKETADDRESS_H
+#define SOCKETADDRESS_H
+
+#include <string>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* SocketAddress is the address a listener binds to (see Connection): an IPv4
+ * or IPv6 TCP port (on all interfaces unless a host is given) or the path of
+ * a Unix-domain stream socket. Unix-domain sockets skip the TCP stack so they
+ * suit clients running on the same host.
+ */
+struct SocketAddress
+{
+    enum Family
+    {
+        FamilyTcp4,
+        FamilyTcp6,
+        FamilyUnix
+    };
+
+    // Creates an IPv4 TCP address of the port on all interfaces.
+    SocketAddress(int port = 0);
+
+    // Parses the spec:
+    //  [tcp4:][HOST:]PORT - IPv4 TCP (HOST is a dotted address),
+    //  tcp6:[[HOST]:]PORT - IPv6 TCP (HOST in brackets, e.g. [::1]:9090),
+    //  unix:PATH - Unix-domain stream socket.
+    // Returns false if the spec is invalid (address is left unchanged then).
+    static bool parse(const string &spec, SocketAddress &address);
+
+    // Returns the spec of the address.
+    string toString() const;
+
+    Family m_family;
+    string m_host; // Empty - all interfaces.
+    int m_port;
+    string m_path;
+};
+
+} // namespace followermaze
+
+#endif // SOCKETADDRESS_H
@@ -0,0 +1,108 @@
+#include <cstdlib>
+#include <climits>
+#include "socketprofile.h"
+
+namespace followermaze
+{
+
+namespace
+{
+
+// Parses a positive int. Returns false if invalid.
+bool parseSize(const string &value, int &size)
+{
+    char *end = NULL;
+    long res = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || res <= 0 || res > INT_MAX)
+    {
+        return false;
+    }
+
+    size = static_cast<int>(res);
+    return true;
+}
+
+} // namespace
+
+SocketProfile::SocketProfile() :
+    m_noDelay(false),
+    m_cork(false),
+    m_sendBuffer(0),
+    m_receiveBuffer(0),
+    m_busyPoll(0),
+    m_zeroCopy(0)
+{
+}
+
+bool SocketProfile::parse(const string &spec, SocketProfile &profile)
+{
+    SocketProfile res;
+    if (spec.compare("default") == 0)
+    {
+        profile = res;
+        return true;
+    }
+
+    size_t start = 0;
+    while (start <= spec.length())
+    {
+        size_t end = spec.find(',', start);
+        if (end == string::npos)
+        {
+            end = spec.length();
+        }
+
+        string option = spec.substr(start, end - start);
+        size_t pos = option.find('=');
+        string name = option.substr(0, pos);
+        string value = pos == string::npos ? "" : option.substr(pos + 1);
+
+        if (name.compare("nodelay") == 0 && pos == string::npos)
+        {
+            res.m_noDelay = true;
+        }
+        else if (name.compare("cork") == 0 && pos == string::npos)
+        {
+            res.m_cork = true;
+        }
+        else if (name.compare("sndbuf") == 0)
+        {
+            if (!parseSize(value, res.m_sendBuffer))
+            {
+                return false;
+            }
+        }
+        else if (name.compare("rcvbuf") == 0)
+        {
+            if (!parseSize(value, res.m_receiveBuffer))
+            {
+                return false;
+            }
+        }
+        else if (name.compare("busy-poll") == 0)
+        {
+            if (!parseSize(value, res.m_busyPoll))
+            {
+                return false;
+            }
+        }
+        else if (name.compare("zerocopy") == 0)
+        {
+            if (!parseSize(value, res.m_zeroCopy))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        start = end + 1;
+    }
+
+    profile = res;
+    return true;
+}
+
+} // namespace followermaze
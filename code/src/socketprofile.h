@@ -0,0 +1,42 @@
+/* This file declears SocketProfile structure.
+ */
+#ifndef SOCKETPROFILE_H
+#define SOCKETPROFILE_H
+
+#include <string>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* SocketProfile is a set of socket options for the connections accepted by a
+ * listener (see Connection::setProfile).
+ */
+struct SocketProfile
+{
+    SocketProfile();
+
+    // Parses a comma separated list of options:
+    //  nodelay - disable Nagle's algorithm (TCP_NODELAY),
+    //  cork - hold back partial segments while more output of a batch is
+    //         being sent (MSG_MORE),
+    //  sndbuf=BYTES, rcvbuf=BYTES - socket buffer sizes (SO_SNDBUF/SO_RCVBUF),
+    //  busy-poll=USEC - busy poll the device queue on receive (SO_BUSY_POLL),
+    //  zerocopy=BYTES - send batches of at least BYTES without copying them
+    //                   into the kernel (SO_ZEROCOPY/MSG_ZEROCOPY, TCP only).
+    // "default" stands for no options. Returns false if the spec is invalid
+    // (profile is left unchanged then).
+    static bool parse(const string &spec, SocketProfile &profile);
+
+    bool m_noDelay;
+    bool m_cork;
+    int m_sendBuffer;    // 0 - system default.
+    int m_receiveBuffer; // 0 - system default.
+    int m_busyPoll;      // 0 - off.
+    int m_zeroCopy;      // Min batch size sent without copying (0 - off).
+};
+
+} // namespace followermaze
+
+#endif // SOCKETPROFILE_H
@@ -0,0 +1,171 @@
+#include <cstddef>
+#include <time.h>
+#include "stats.h"
+
+namespace followermaze
+{
+
+namespace
+{
+
+// Single writer increments readable from other threads.
+inline unsigned long load(const unsigned long &value)
+{
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+inline void store(unsigned long &value, unsigned long newValue)
+{
+    __atomic_store_n(&value, newValue, __ATOMIC_RELAXED);
+}
+
+const char *OTHER_CATEGORY = "other";
+
+} // anonymous namespace
+
+/*----------------------------------------------------------------------------*/
+
+Histogram::Histogram() :
+    m_count(0),
+    m_sum(0),
+    m_max(0)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+void Histogram::record(unsigned long value)
+{
+    int bucket = bucketOf(value);
+    store(m_buckets[bucket], m_buckets[bucket] + 1);
+    store(m_count, m_count + 1);
+    store(m_sum, m_sum + value);
+
+    if (value > m_max)
+    {
+        store(m_max, value);
+    }
+}
+
+unsigned long Histogram::getCount() const
+{
+    return load(m_count);
+}
+
+unsigned long Histogram::getSum() const
+{
+    return load(m_sum);
+}
+
+unsigned long Histogram::getMax() const
+{
+    return load(m_max);
+}
+
+unsigned long Histogram::getBucket(int bucket) const
+{
+    return bucket >= 0 && bucket < BUCKETS ? load(m_buckets[bucket]) : 0;
+}
+
+int Histogram::bucketOf(unsigned long value)
+{
+    return value == 0 ? 0 : static_cast<int>(sizeof(value) * 8) - __builtin_clzl(value);
+}
+
+void Histogram::format(ostream &out) const
+{
+    out << "count=" << getCount() << " sum=" << getSum() << " max=" << getMax();
+
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        unsigned long count = getBucket(i);
+        if (count > 0)
+        {
+            unsigned long lower = i == 0 ? 0 : 1UL << (i - 1);
+            out << " [" << lower << "]=" << count;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+LoopStats::LoopStats() :
+    m_categoryCount(0)
+{
+    for (int i = 0; i < MAX_CATEGORIES; ++i)
+    {
+        m_categories[i] = NULL;
+    }
+}
+
+void LoopStats::recordIteration(unsigned long blocked, unsigned long dispatch, unsigned long events)
+{
+    m_blocked.record(blocked);
+    m_dispatch.record(dispatch);
+    m_events.record(events);
+}
+
+void LoopStats::recordCallback(const char *category, unsigned long duration)
+{
+    // There are only a few categories. Linear search by address is the
+    // cheapest.
+    int i = 0;
+    for (; i < m_categoryCount; ++i)
+    {
+        if (m_categories[i] == category)
+        {
+            break;
+        }
+    }
+
+    if (i == m_categoryCount)
+    {
+        if (m_categoryCount >= MAX_CATEGORIES - 1)
+        {
+            // The last one is reserved.
+            category = OTHER_CATEGORY;
+            for (i = 0; i < m_categoryCount && m_categories[i] != category; ++i)
+            {
+            }
+        }
+
+        if (i == m_categoryCount)
+        {
+            // Publish the name before the readers can see it.
+            m_categories[i] = category;
+            __atomic_store_n(&m_categoryCount, m_categoryCount + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    m_callbacks[i].record(duration);
+}
+
+void LoopStats::format(ostream &out) const
+{
+    out << "blocked_us ";
+    m_blocked.format(out);
+    out << "\ndispatch_us ";
+    m_dispatch.format(out);
+    out << "\nevents ";
+    m_events.format(out);
+    out << "\n";
+
+    int count = __atomic_load_n(&m_categoryCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; ++i)
+    {
+        out << "callback_us " << m_categories[i] << " ";
+        m_callbacks[i].format(out);
+        out << "\n";
+    }
+}
+
+unsigned long LoopStats::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+} // namespace followermaze
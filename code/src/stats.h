@@ -0,0 +1,99 @@
+/* This file declears Histogram and LoopStats classes.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <ostream>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* Histogram counts values in logarithmic (power of two) buckets: bucket 0
+ * counts zeros, bucket i counts values in [2^(i-1), 2^i). It also keeps the
+ * count, sum, and max of the values.
+ * Recording is meant to be done by a single thread. It uses relaxed atomic
+ * loads and stores only (plain moves on common CPUs) so other threads can
+ * read a Histogram while it's being recorded (the snapshot may be slightly
+ * inconsistent).
+ */
+class Histogram
+{
+public:
+    enum
+    {
+        BUCKETS = 65
+    };
+
+public:
+    Histogram();
+
+    // Records the value. Must be called by the owning thread only.
+    void record(unsigned long value);
+
+    // Getters. Can be called from any thread.
+    unsigned long getCount() const;
+    unsigned long getSum() const;
+    unsigned long getMax() const;
+    unsigned long getBucket(int bucket) const;
+
+    // Returns the bucket for the value.
+    static int bucketOf(unsigned long value);
+
+    // Writes "count=N sum=N max=N [lower]=N ..." (non-empty buckets only)
+    // where lower is the smallest value which falls into the bucket.
+    void format(ostream &out) const;
+
+private:
+    unsigned long m_count;
+    unsigned long m_sum;
+    unsigned long m_max;
+    unsigned long m_buckets[BUCKETS];
+};
+
+/* LoopStats keeps event loop statistics of a Reactor: how long the loop is
+ * blocked waiting, how long it takes to dispatch the events (including
+ * timeouts and tasks), how many events every wakeup brings, and how long
+ * the call backs take per handler category (see EventHandler::getCategory).
+ * Times are in microseconds. Same threading rules as for Histogram apply.
+ */
+class LoopStats
+{
+public:
+    enum
+    {
+        MAX_CATEGORIES = 16
+    };
+
+public:
+    LoopStats();
+
+    // Records one loop iteration. Must be called by the owning thread only.
+    void recordIteration(unsigned long blocked, unsigned long dispatch, unsigned long events);
+
+    // Records one call back of a handler of the category (pointer to a
+    // string literal, compared by address). Categories which don't fit are
+    // recorded as "other". Must be called by the owning thread only.
+    void recordCallback(const char *category, unsigned long duration);
+
+    // Writes the statistics (one histogram per line). Can be called from any
+    // thread.
+    void format(ostream &out) const;
+
+    // Returns monotonic time in microseconds.
+    static unsigned long now();
+
+private:
+    Histogram m_blocked;
+    Histogram m_dispatch;
+    Histogram m_events;
+
+    const char *m_categories[MAX_CATEGORIES];
+    Histogram m_callbacks[MAX_CATEGORIES];
+    int m_categoryCount;
+};
+
+} // namespace followermaze
+
+#endif // STATS_H
@@ -0,0 +1,77 @@
+#include "task.h"
+
+namespace followermaze
+{
+
+TaskQueue::TaskQueue() :
+    m_head(&m_stub),
+    m_tail(&m_stub)
+{
+}
+
+TaskQueue::~TaskQueue()
+{
+    Task *task;
+    while ((task = pop()) != NULL)
+    {
+        delete task;
+    }
+}
+
+void TaskQueue::push(auto_ptr<Task> task)
+{
+    link(task.release());
+}
+
+Task *TaskQueue::pop()
+{
+    Task *tail = m_tail;
+    Task *next = __atomic_load_n(&tail->m_next, __ATOMIC_ACQUIRE);
+
+    if (tail == &m_stub)
+    {
+        if (next == NULL)
+        {
+            // Empty.
+            return NULL;
+        }
+
+        // Skip the stub.
+        m_tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->m_next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL)
+    {
+        m_tail = next;
+        return tail;
+    }
+
+    if (tail != __atomic_load_n(&m_head, __ATOMIC_ACQUIRE))
+    {
+        // A producer has swapped the head but not linked the task yet.
+        return NULL;
+    }
+
+    // tail is the last task. Put the stub behind it so it can be taken out.
+    link(&m_stub);
+
+    next = __atomic_load_n(&tail->m_next, __ATOMIC_ACQUIRE);
+    if (next != NULL)
+    {
+        m_tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+void TaskQueue::link(Task *task)
+{
+    __atomic_store_n(&task->m_next, static_cast<Task*>(NULL), __ATOMIC_RELAXED);
+    Task *prev = __atomic_exchange_n(&m_head, task, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->m_next, task, __ATOMIC_RELEASE);
+}
+
+} // namespace followermaze
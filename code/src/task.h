@@ -0,0 +1,77 @@
+/* This file declears Task and TaskQueue classes.
+ */
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <memory>
+
+using namespace std;
+
+namespace followermaze
+{
+
+/* Task is a unit of work which can be posted to a Reactor from any thread.
+ * It is run by the thread handling events of the Reactor.
+ */
+class Task
+{
+    friend class TaskQueue;
+
+public:
+    Task() : m_next(NULL) {}
+    virtual ~Task() {}
+
+    // Does the work.
+    virtual void run() = 0;
+
+private:
+    Task *m_next; // Link used by TaskQueue.
+};
+
+/* TaskQueue is a lock-free multiple producer single consumer FIFO queue of
+ * Tasks (D. Vyukov's intrusive MPSC queue). Tasks are linked through
+ * themselves so pushing doesn't allocate memory and costs one atomic
+ * exchange. Any thread can push, only one thread at a time can pop.
+ * A pop may miss a task which is being pushed at the same time. The pushing
+ * thread is expected to notify the consumer after push returns (see
+ * Reactor::post).
+ * TaskQueue owns the queued Tasks and disposes of them at destruction.
+ */
+class TaskQueue
+{
+public:
+    TaskQueue();
+    ~TaskQueue();
+
+    // Queues the task (takes ownership). Can be called from any thread.
+    void push(auto_ptr<Task> task);
+
+    // Returns the oldest task (ownership is passed to the caller) or NULL if
+    // the queue is empty. Must be called by the consumer thread only.
+    Task *pop();
+
+private:
+    // Make non-copyable.
+    TaskQueue(const TaskQueue&);
+    TaskQueue& operator=(const TaskQueue&);
+
+    // Links the task in as the newest one.
+    void link(Task *task);
+
+private:
+    // Stub is a placeholder which keeps the queue non-empty.
+    class Stub : public Task
+    {
+    public:
+        virtual void run() {}
+    };
+
+    Stub m_stub;
+    Task *m_head; // Newest task (producers' end).
+    Task *m_tail; // Oldest task (consumer's end).
+};
+
+} // namespace followermaze
+
+#endif // TASK_H
@@ -0,0 +1,205 @@
+#include "timerwheel.h"
+
+namespace followermaze
+{
+
+TimerWheel::TimerWheel(Tick now) :
+    m_current(now),
+    m_size(0)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        m_buckets[i] = -1;
+    }
+}
+
+void TimerWheel::schedule(int id, Tick expires)
+{
+    if (id < 0)
+    {
+        throw Exception();
+    }
+
+    if (static_cast<size_t>(id) >= m_timers.size())
+    {
+        Timer unused;
+        unused.m_expires = 0;
+        unused.m_bucket = -1;
+        unused.m_prev = -1;
+        unused.m_next = -1;
+        m_timers.resize(id + 1, unused);
+    }
+    else if (m_timers[id].m_bucket >= 0)
+    {
+        unlink(id);
+        --m_size;
+    }
+
+    m_timers[id].m_expires = expires;
+    insert(id);
+    ++m_size;
+}
+
+void TimerWheel::advance(Tick now)
+{
+    if (m_size == 0 && m_current < now)
+    {
+        m_current = now;
+    }
+}
+
+void TimerWheel::cancel(int id)
+{
+    if (isScheduled(id))
+    {
+        unlink(id);
+        --m_size;
+    }
+}
+
+bool TimerWheel::isScheduled(int id) const
+{
+    return id >= 0 && static_cast<size_t>(id) < m_timers.size() && m_timers[id].m_bucket >= 0;
+}
+
+std::size_t TimerWheel::size() const
+{
+    return m_size;
+}
+
+long TimerWheel::nextTimeout(Tick now) const
+{
+    if (m_size == 0)
+    {
+        return -1;
+    }
+
+    // Find the first tick which either has timers in the first level or
+    // requires cascading.
+    Tick tick = m_current;
+    while ((tick & (ROOT_SIZE - 1)) != 0 && m_buckets[bucketOf(0, tick)] < 0)
+    {
+        ++tick;
+    }
+
+    return tick > now ? static_cast<long>(tick - now) : 0;
+}
+
+void TimerWheel::expire(Tick now, IdList &expired)
+{
+    while (m_current <= now)
+    {
+        if (m_size == 0)
+        {
+            // Nothing to wait for. Jump ahead.
+            m_current = now + 1;
+            break;
+        }
+
+        if ((m_current & (ROOT_SIZE - 1)) == 0)
+        {
+            for (int level = 1; level < LEVELS && cascade(level) == 0; ++level)
+            {
+            }
+        }
+
+        int bucket = bucketOf(0, m_current);
+        while (m_buckets[bucket] >= 0)
+        {
+            int id = m_buckets[bucket];
+            unlink(id);
+            --m_size;
+            expired.push_back(id);
+        }
+
+        ++m_current;
+    }
+}
+
+void TimerWheel::insert(int id)
+{
+    Timer &timer = m_timers[id];
+    Tick expires = timer.m_expires;
+
+    // Overdue timers go to the bucket processed next.
+    Tick delta = expires > m_current ? expires - m_current : 0;
+    if (delta == 0)
+    {
+        expires = m_current;
+    }
+
+    int level = 0;
+    for (int bits = ROOT_BITS; level < LEVELS - 1 && delta >= (static_cast<Tick>(1) << bits); bits += LEVEL_BITS)
+    {
+        ++level;
+    }
+
+    // Park timers which are too far away in the farthest bucket.
+    Tick range = static_cast<Tick>(1) << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);
+    if (delta >= range)
+    {
+        expires = m_current + range - 1;
+    }
+
+    int bucket = bucketOf(level, expires);
+    timer.m_bucket = bucket;
+    timer.m_prev = -1;
+    timer.m_next = m_buckets[bucket];
+    if (timer.m_next >= 0)
+    {
+        m_timers[timer.m_next].m_prev = id;
+    }
+    m_buckets[bucket] = id;
+}
+
+void TimerWheel::unlink(int id)
+{
+    Timer &timer = m_timers[id];
+
+    if (timer.m_prev >= 0)
+    {
+        m_timers[timer.m_prev].m_next = timer.m_next;
+    }
+    else
+    {
+        m_buckets[timer.m_bucket] = timer.m_next;
+    }
+
+    if (timer.m_next >= 0)
+    {
+        m_timers[timer.m_next].m_prev = timer.m_prev;
+    }
+
+    timer.m_bucket = -1;
+    timer.m_prev = -1;
+    timer.m_next = -1;
+}
+
+int TimerWheel::cascade(int level)
+{
+    int bucket = bucketOf(level, m_current);
+    int id = m_buckets[bucket];
+    m_buckets[bucket] = -1;
+
+    while (id >= 0)
+    {
+        int next = m_timers[id].m_next;
+        insert(id);
+        id = next;
+    }
+
+    return bucket - bucketOf(level, 0);
+}
+
+int TimerWheel::bucketOf(int level, Tick tick)
+{
+    if (level == 0)
+    {
+        return static_cast<int>(tick & (ROOT_SIZE - 1));
+    }
+
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    return ROOT_SIZE + (level - 1) * LEVEL_SIZE + static_cast<int>((tick >> shift) & (LEVEL_SIZE - 1));
+}
+
+} // namespace followermaze
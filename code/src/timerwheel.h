@@ -0,0 +1,113 @@
+/* This file declears TimerWheel class.
+ */
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+#include <vector>
+#include "exception.h"
+
+namespace followermaze
+{
+
+/* TimerWheel is a hierarchical timing wheel (see Varghese and Lauck, "Hashed
+ * and Hierarchical Timing Wheels") keeping one timer per id.
+ * Time is measured in ticks. The first level has a bucket per tick for the
+ * next 256 ticks, each of the following three levels has 64 buckets covering
+ * 64 times the range of the previous level. Timers further away than the
+ * last level can hold are parked in its farthest bucket until they get
+ * closer. Timers move (cascade) to the lower level when the ticks pass the
+ * range of their bucket.
+ * Buckets are doubly linked lists threaded through a table indexed by id so
+ * scheduling and cancelling take constant time and no memory is allocated
+ * unless the table has to grow.
+ * TimerWheel is not thread safe.
+ */
+class TimerWheel
+{
+public:
+    class Exception : public BaseException
+    {
+    public:
+        Exception(int err = BaseException::ErrGeneric) : BaseException(err) {}
+        virtual const char* what() const throw() { return "TimerWheel::Exception#"; }
+    };
+
+    typedef unsigned long Tick;
+    typedef std::vector< int > IdList;
+
+public:
+    // now is the current tick.
+    TimerWheel(Tick now = 0);
+
+    // Schedules the timer with the id (non-negative) to expire at the tick.
+    // Reschedules the timer if it has been scheduled already. Call advance
+    // first if the wheel may have been idle.
+    void schedule(int id, Tick expires);
+
+    // Moves the wheel ahead to now if no timers are scheduled, so that the
+    // first timer scheduled after idling doesn't have the idle ticks walked
+    // by expire. Takes constant time.
+    void advance(Tick now);
+
+    // Cancels the timer. Does nothing if the timer is not scheduled.
+    void cancel(int id);
+
+    // Returns true if the timer is scheduled.
+    bool isScheduled(int id) const;
+
+    // Returns the number of scheduled timers.
+    std::size_t size() const;
+
+    // Returns the number of ticks from now to wait before calling expire
+    // (0 - call now, -1 - no timers scheduled). May be earlier than the
+    // nearest timer (at most 256 ticks) if the timers have to cascade.
+    long nextTimeout(Tick now) const;
+
+    // Advances the wheel to now and appends ids of expired timers to expired
+    // (in order of expiry). Expired timers are no longer scheduled.
+    void expire(Tick now, IdList &expired);
+
+protected:
+    enum
+    {
+        ROOT_BITS = 8,
+        LEVEL_BITS = 6,
+        LEVELS = 4,
+        ROOT_SIZE = 1 << ROOT_BITS,
+        LEVEL_SIZE = 1 << LEVEL_BITS,
+        BUCKETS = ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE
+    };
+
+    // Timer is a node of a bucket list.
+    struct Timer
+    {
+        Tick m_expires;
+        int m_bucket; // -1 if not scheduled.
+        int m_prev;
+        int m_next;
+    };
+
+    // Puts the timer into the bucket matching its expiry.
+    void insert(int id);
+
+    // Takes the timer out of its bucket.
+    void unlink(int id);
+
+    // Re-inserts the timers of the bucket of the level for m_current.
+    // Returns index of the bucket.
+    int cascade(int level);
+
+    // Returns bucket number for the level and tick.
+    static int bucketOf(int level, Tick tick);
+
+protected:
+    std::vector< Timer > m_timers; // Indexed by id.
+    int m_buckets[BUCKETS];        // Heads of the bucket lists (-1 if empty).
+    Tick m_current;                // Next tick to be processed.
+    std::size_t m_size;
+};
+
+} // namespace followermaze
+
+#endif // TIMERWHEEL_H
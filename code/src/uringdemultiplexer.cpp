@@ -0,0 +1,622 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+#include "uringdemultiplexer.h"
+
+namespace followermaze
+{
+
+namespace
+{
+
+// Marks completions of cancel requests (these carry no events).
+const uint64_t CANCEL_FLAG = 1ULL << 63;
+
+// Kind of the request is kept below CANCEL_FLAG.
+const int KIND_SHIFT = 61;
+const uint64_t KIND_MASK = 3;
+
+// Generations are kept clear of the kind and CANCEL_FLAG.
+const uint32_t GENERATION_MASK = 0x1fffffff;
+
+// Completion ring is made large so that every watched Handle can have a
+// completion pending (the kernel keeps overflowing ones anyway, see NODROP).
+const unsigned int CQ_ENTRIES = 65536;
+
+int ringSetup(unsigned int entries, struct io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ringRegister(int ringfd, unsigned int opcode, void *arg, unsigned int count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ringfd, opcode, arg, count));
+}
+
+int ringEnter(int ringfd, unsigned int toSubmit, unsigned int minComplete,
+          unsigned int flags, void *arg, size_t argSize)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringfd, toSubmit,
+                                    minComplete, flags, arg, argSize));
+}
+
+unsigned int *at(void *base, unsigned int offset)
+{
+    return reinterpret_cast<unsigned int*>(static_cast<char*>(base) + offset);
+}
+
+} // anonymous namespace
+
+const unsigned int UringDemultiplexer::DEFAULT_ENTRIES;
+const unsigned int UringDemultiplexer::RECEIVE_BUFFERS;
+const size_t UringDemultiplexer::RECEIVE_BUFFER_SIZE;
+
+UringDemultiplexer::UringDemultiplexer(unsigned int entries) :
+    m_ringfd(-1),
+    m_features(0),
+    m_sqRing(MAP_FAILED),
+    m_sqRingSize(0),
+    m_sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+    m_sqesSize(0),
+    m_sqLocalTail(0),
+    m_cqRing(MAP_FAILED),
+    m_cqRingSize(0),
+    m_buffers(NULL),
+    m_buffersRefused(false)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = CQ_ENTRIES;
+
+    m_ringfd = ringSetup(entries, &params);
+    if (m_ringfd < 0)
+    {
+        throw Exception(errno);
+    }
+
+    m_features = params.features;
+    if (!(m_features & IORING_FEAT_EXT_ARG) || !(m_features & IORING_FEAT_NODROP))
+    {
+        close(m_ringfd);
+        throw Exception(ENOSYS);
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (m_features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && m_cqRingSize > m_sqRingSize)
+    {
+        m_sqRingSize = m_cqRingSize;
+    }
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQ_RING);
+    if (m_sqRing != MAP_FAILED)
+    {
+        m_cqRing = single ? m_sqRing : mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_CQ_RING);
+    }
+
+    if (m_cqRing != MAP_FAILED)
+    {
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        m_sqes = static_cast<struct io_uring_sqe*>(mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE,
+                                                        MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQES));
+    }
+
+    if (m_sqes == MAP_FAILED)
+    {
+        int err = errno;
+        unmap();
+        close(m_ringfd);
+        throw Exception(err);
+    }
+
+    m_sqHead = at(m_sqRing, params.sq_off.head);
+    m_sqTail = at(m_sqRing, params.sq_off.tail);
+    m_sqMask = at(m_sqRing, params.sq_off.ring_mask);
+    m_sqEntries = at(m_sqRing, params.sq_off.ring_entries);
+    m_sqLocalTail = *m_sqTail;
+
+    // Submission entries are used in order so the indirection array is set
+    // up once.
+    unsigned int *array = at(m_sqRing, params.sq_off.array);
+    for (unsigned int i = 0; i < params.sq_entries; ++i)
+    {
+        array[i] = i;
+    }
+
+    m_cqHead = at(m_cqRing, params.cq_off.head);
+    m_cqTail = at(m_cqRing, params.cq_off.tail);
+    m_cqMask = at(m_cqRing, params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe*>(static_cast<char*>(m_cqRing) + params.cq_off.cqes);
+}
+
+UringDemultiplexer::~UringDemultiplexer()
+{
+    unmap();
+    close(m_ringfd);
+
+    if (m_buffers != NULL)
+    {
+        munmap(m_buffers, RECEIVE_BUFFERS * RECEIVE_BUFFER_SIZE);
+    }
+}
+
+void UringDemultiplexer::unmap()
+{
+    if (m_sqes != MAP_FAILED)
+    {
+        munmap(m_sqes, m_sqesSize);
+    }
+
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+    {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+
+    if (m_sqRing != MAP_FAILED)
+    {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+}
+
+void UringDemultiplexer::add(int hint, Handle handle, unsigned int interest)
+{
+    Watch &watch = getWatch(hint, true);
+    if (watch.m_active)
+    {
+        throw Exception();
+    }
+
+    watch.m_handle = handle;
+    watch.m_interest = interest;
+    watch.m_active = true;
+    watch.m_generation = (watch.m_generation + 1) & GENERATION_MASK;
+    watch.m_serial = (watch.m_serial + 1) & GENERATION_MASK;
+    queuePoll(hint);
+}
+
+void UringDemultiplexer::modify(int hint, Handle /*handle*/, unsigned int interest)
+{
+    Watch &watch = getWatch(hint);
+    if (!watch.m_active)
+    {
+        throw Exception();
+    }
+
+    if (watch.m_interest == interest)
+    {
+        return;
+    }
+
+    if (watch.m_armed)
+    {
+        queueCancel(hint);
+    }
+
+    watch.m_interest = interest;
+    watch.m_generation = (watch.m_generation + 1) & GENERATION_MASK;
+    queuePoll(hint);
+}
+
+void UringDemultiplexer::remove(int hint, Handle /*handle*/)
+{
+    Watch &watch = getWatch(hint);
+    if (watch.m_armed)
+    {
+        queueCancel(hint);
+    }
+
+    if (watch.m_sending || watch.m_receiving)
+    {
+        finishTransfers(hint);
+    }
+
+    watch.m_handle = INVALID_HANDLE;
+    watch.m_active = false;
+    watch.m_armed = false;
+    watch.m_generation = (watch.m_generation + 1) & GENERATION_MASK;
+    watch.m_serial = (watch.m_serial + 1) & GENERATION_MASK;
+}
+
+void UringDemultiplexer::wait(EventList &ready, int timeout)
+{
+    ready.clear();
+
+    // The data reported last time has been handled.
+    m_freeBuffers.insert(m_freeBuffers.end(), m_reportedBuffers.begin(), m_reportedBuffers.end());
+    m_reportedBuffers.clear();
+
+    // Re-arm the polls which completed last time (unless the interest has
+    // been changed or the Handle removed in the meantime).
+    for (std::vector< int >::const_iterator it = m_rearm.begin(); it != m_rearm.end(); ++it)
+    {
+        Watch &watch = getWatch(*it);
+        if (watch.m_active && !watch.m_armed)
+        {
+            queuePoll(*it);
+        }
+    }
+    m_rearm.clear();
+
+    enter(completionsReady() > 0 || timeout == 0 ? 0 : 1, timeout);
+
+    unsigned int head = *m_cqHead;
+    unsigned int tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head)
+    {
+        const struct io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+
+        if (cqe.user_data & CANCEL_FLAG)
+        {
+            continue;
+        }
+
+        int hint = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+        uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32) & GENERATION_MASK;
+        Kind kind = static_cast<Kind>((cqe.user_data >> KIND_SHIFT) & KIND_MASK);
+        Watch &watch = getWatch(hint);
+
+        Event event;
+        event.m_hint = hint;
+        event.m_ready = 0;
+        event.m_result = cqe.res;
+        event.m_data = NULL;
+
+        if (kind != KindPoll)
+        {
+            if (!watch.m_active || watch.m_serial != generation)
+            {
+                // Stale (finished by remove).
+                continue;
+            }
+
+            if (kind == KindSend)
+            {
+                watch.m_sending = false;
+                event.m_ready = ReadySent;
+            }
+            else
+            {
+                watch.m_receiving = false;
+                event.m_ready = ReadyReceived;
+                event.m_data = m_buffers + watch.m_buffer * RECEIVE_BUFFER_SIZE;
+                m_reportedBuffers.push_back(watch.m_buffer);
+                watch.m_buffer = -1;
+            }
+
+            ready.push_back(event);
+            continue;
+        }
+
+        if (!watch.m_active || watch.m_generation != generation)
+        {
+            // Stale (cancelled) request.
+            continue;
+        }
+
+        watch.m_armed = false;
+        m_rearm.push_back(hint);
+
+        if (cqe.res < 0)
+        {
+            event.m_ready |= ReadyErr;
+        }
+        else
+        {
+            if (cqe.res & POLLIN)
+            {
+                event.m_ready |= ReadyIn;
+            }
+
+            if (cqe.res & POLLOUT)
+            {
+                event.m_ready |= ReadyOut;
+            }
+
+            if (cqe.res & POLLHUP)
+            {
+                event.m_ready |= ReadyHup;
+            }
+
+            if ((cqe.res & POLLERR) || (cqe.res & POLLNVAL))
+            {
+                event.m_ready |= ReadyErr;
+            }
+        }
+
+        ready.push_back(event);
+    }
+
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+UringDemultiplexer::Watch &UringDemultiplexer::getWatch(int hint, bool grow)
+{
+    // The table starts with WAKEUP_HINT.
+    if (hint < WAKEUP_HINT)
+    {
+        throw Exception();
+    }
+
+    size_t index = static_cast<size_t>(hint - WAKEUP_HINT);
+    if (index >= m_watches.size())
+    {
+        if (!grow)
+        {
+            throw Exception();
+        }
+
+        Watch unused;
+        unused.m_handle = INVALID_HANDLE;
+        unused.m_interest = 0;
+        unused.m_generation = 0;
+        unused.m_serial = 0;
+        unused.m_active = false;
+        unused.m_armed = false;
+        unused.m_sending = false;
+        unused.m_receiving = false;
+        unused.m_buffer = -1;
+        m_watches.resize(index + 1, unused);
+    }
+
+    return m_watches[index];
+}
+
+void UringDemultiplexer::queuePoll(int hint)
+{
+    Watch &watch = getWatch(hint);
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = watch.m_handle;
+    sqe->user_data = encode(hint, watch.m_generation);
+
+    if (watch.m_interest & InterestRead)
+    {
+        sqe->poll32_events |= POLLIN;
+    }
+
+    if (watch.m_interest & InterestWrite)
+    {
+        sqe->poll32_events |= POLLOUT;
+    }
+
+    watch.m_armed = true;
+}
+
+void UringDemultiplexer::queueCancel(int hint)
+{
+    Watch &watch = getWatch(hint);
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encode(hint, watch.m_generation);
+    sqe->user_data = CANCEL_FLAG;
+}
+
+void UringDemultiplexer::queueCancel(uint64_t userData)
+{
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = CANCEL_FLAG;
+}
+
+bool UringDemultiplexer::canSend() const
+{
+    return true;
+}
+
+void UringDemultiplexer::send(int hint, Handle /*handle*/, const struct msghdr *message)
+{
+    Watch &watch = getWatch(hint);
+    if (!watch.m_active || watch.m_sending)
+    {
+        throw Exception();
+    }
+
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = watch.m_handle;
+    sqe->addr = reinterpret_cast<uint64_t>(message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = encode(hint, watch.m_serial, KindSend);
+
+    watch.m_sending = true;
+}
+
+bool UringDemultiplexer::receive(int hint, Handle /*handle*/)
+{
+    Watch &watch = getWatch(hint);
+    if (!watch.m_active || watch.m_receiving)
+    {
+        throw Exception();
+    }
+
+    if (!setUpBuffers() || m_freeBuffers.empty())
+    {
+        return false;
+    }
+
+    int buffer = m_freeBuffers.back();
+    m_freeBuffers.pop_back();
+
+    struct io_uring_sqe *sqe = getSqe();
+
+    // Reading a socket (a stream) ignores the offset.
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = watch.m_handle;
+    sqe->addr = reinterpret_cast<uint64_t>(m_buffers + buffer * RECEIVE_BUFFER_SIZE);
+    sqe->len = RECEIVE_BUFFER_SIZE;
+    sqe->buf_index = 0;
+    sqe->user_data = encode(hint, watch.m_serial, KindReceive);
+
+    watch.m_receiving = true;
+    watch.m_buffer = buffer;
+    return true;
+}
+
+void UringDemultiplexer::finishTransfers(int hint)
+{
+    Watch &watch = getWatch(hint);
+    uint64_t sent = encode(hint, watch.m_serial, KindSend);
+    uint64_t received = encode(hint, watch.m_serial, KindReceive);
+
+    if (watch.m_sending)
+    {
+        queueCancel(sent);
+    }
+
+    if (watch.m_receiving)
+    {
+        queueCancel(received);
+    }
+
+    // Look for the completions among the ones not reaped yet.
+    unsigned int scanned = *m_cqHead;
+    while (watch.m_sending || watch.m_receiving)
+    {
+        unsigned int tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        for (; scanned != tail; ++scanned)
+        {
+            uint64_t userData = m_cqes[scanned & *m_cqMask].user_data;
+            if (watch.m_sending && userData == sent)
+            {
+                watch.m_sending = false;
+            }
+            else if (watch.m_receiving && userData == received)
+            {
+                watch.m_receiving = false;
+                m_freeBuffers.push_back(watch.m_buffer);
+                watch.m_buffer = -1;
+            }
+        }
+
+        if (watch.m_sending || watch.m_receiving)
+        {
+            enter(scanned - *m_cqHead + 1, -1);
+        }
+    }
+}
+
+bool UringDemultiplexer::setUpBuffers()
+{
+    if (m_buffers != NULL || m_buffersRefused)
+    {
+        return !m_buffersRefused;
+    }
+
+    void *buffers = mmap(NULL, RECEIVE_BUFFERS * RECEIVE_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED)
+    {
+        m_buffersRefused = true;
+        return false;
+    }
+
+    // Registered as one buffer, receives use parts of it.
+    struct iovec iov;
+    iov.iov_base = buffers;
+    iov.iov_len = RECEIVE_BUFFERS * RECEIVE_BUFFER_SIZE;
+    if (ringRegister(m_ringfd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+    {
+        // E.g. over the limit of locked memory.
+        munmap(buffers, iov.iov_len);
+        m_buffersRefused = true;
+        return false;
+    }
+
+    m_buffers = static_cast<char*>(buffers);
+    for (unsigned int i = 0; i < RECEIVE_BUFFERS; ++i)
+    {
+        m_freeBuffers.push_back(i);
+    }
+
+    return true;
+}
+
+struct io_uring_sqe *UringDemultiplexer::getSqe()
+{
+    if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= *m_sqEntries)
+    {
+        // Full. Submit without waiting.
+        enter(0, 0);
+    }
+
+    struct io_uring_sqe *sqe = &m_sqes[m_sqLocalTail & *m_sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++m_sqLocalTail;
+
+    return sqe;
+}
+
+void UringDemultiplexer::enter(unsigned int minComplete, int timeout)
+{
+    // Publish the queued entries.
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    unsigned int toSubmit = m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+
+    if (toSubmit == 0 && minComplete == 0)
+    {
+        return;
+    }
+
+    unsigned int flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void *argp = NULL;
+    size_t argSize = 0;
+
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+
+        if (timeout >= 0)
+        {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000L;
+
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argSize = sizeof(arg);
+        }
+    }
+
+    if (ringEnter(m_ringfd, toSubmit, minComplete, flags, argp, argSize) < 0)
+    {
+        // Timing out, being interrupted, or having too many completions
+        // pending are not errors: the caller reaps what is there.
+        if (errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        {
+            throw Exception(errno);
+        }
+    }
+}
+
+unsigned int UringDemultiplexer::completionsReady() const
+{
+    return __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) - *m_cqHead;
+}
+
+uint64_t UringDemultiplexer::encode(int hint, uint32_t generation, Kind kind)
+{
+    return (static_cast<uint64_t>(kind) << KIND_SHIFT) | (static_cast<uint64_t>(generation) << 32) |
+           static_cast<uint32_t>(hint);
+}
+
+} // namespace followermaze
@@ -0,0 +1,147 @@
+/* This file declears UringDemultiplexer class.
+ */
+#ifndef URINGDEMULTIPLEXER_H
+#define URINGDEMULTIPLEXER_H
+
+#include <vector>
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "demultiplexer.h"
+
+namespace followermaze
+{
+
+/* UringDemultiplexer is a Demultiplexer which uses Linux io_uring.
+ * Every watched Handle has a one-shot poll request in flight. Arming,
+ * re-arming, and cancelling the requests (i.e. changing the interest) don't
+ * cost a system call: the requests are queued in the submission ring and
+ * submitted in one go together with waiting for the completions (one
+ * io_uring_enter per wait).
+ * Polls are re-armed after the events have been dispatched so a Handle is
+ * reported again if it's still ready (level-triggered like poll and epoll).
+ * Sends (IORING_OP_SENDMSG) and receives are queued the same way, so the
+ * output of many Handles and the input of the next round go to the kernel
+ * with the one io_uring_enter which waits. Receives read into buffers
+ * registered with the ring (IORING_OP_READ_FIXED, the pages are not mapped
+ * for every read). The buffers are set up on the first receive.
+ * Requires Linux 5.11+ (IORING_FEAT_EXT_ARG). Construction will throw if
+ * io_uring is not available so the caller can fall back to other backend.
+ */
+class UringDemultiplexer : public Demultiplexer
+{
+public:
+    // entries is the size of the submission ring.
+    UringDemultiplexer(unsigned int entries = DEFAULT_ENTRIES);
+    virtual ~UringDemultiplexer();
+
+    virtual void add(int hint, Handle handle, unsigned int interest);
+    virtual void modify(int hint, Handle handle, unsigned int interest);
+    virtual void remove(int hint, Handle handle);
+    virtual void wait(EventList &ready, int timeout);
+    virtual bool canSend() const;
+    virtual void send(int hint, Handle handle, const struct msghdr *message);
+    virtual bool receive(int hint, Handle handle);
+
+    static const unsigned int DEFAULT_ENTRIES = 4096;
+
+    // Registered receive buffers (one per receive in flight).
+    static const unsigned int RECEIVE_BUFFERS = 8;
+    static const size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+protected:
+    // Watch keeps the state of a watched Handle.
+    struct Watch
+    {
+        Handle m_handle;
+        unsigned int m_interest;
+        uint32_t m_generation; // Identifies the current poll request.
+        uint32_t m_serial;     // Identifies the Handle's sends and receives.
+        bool m_active;         // Handle is watched.
+        bool m_armed;          // Poll request is queued or in flight.
+        bool m_sending;        // Send is queued or in flight.
+        bool m_receiving;      // Receive is queued or in flight.
+        int m_buffer;          // Receive buffer in use.
+    };
+
+    // Kinds of requests.
+    enum Kind
+    {
+        KindPoll,
+        KindSend,
+        KindReceive
+    };
+
+    typedef std::vector< Watch > WatchTable;
+
+    // Returns the Watch for the hint. Grows the table if asked to.
+    Watch &getWatch(int hint, bool grow = false);
+
+    // Queue requests.
+    void queuePoll(int hint);
+    void queueCancel(int hint);
+    void queueCancel(uint64_t userData);
+
+    // Cancels the send and receive in flight for the hint and waits until
+    // they are done (the completions are left in the ring, stale).
+    void finishTransfers(int hint);
+
+    // Sets up and registers the receive buffers unless done already.
+    // Returns false if the kernel refuses them.
+    bool setUpBuffers();
+
+    // Returns a free submission queue entry (submits queued ones if full).
+    struct io_uring_sqe *getSqe();
+
+    // Submits queued requests and waits for completions.
+    void enter(unsigned int minComplete, int timeout);
+
+    // Number of completions waiting to be reaped.
+    unsigned int completionsReady() const;
+
+    void unmap();
+
+    // Request's user data: kind and generation (or serial) in the upper
+    // half, hint in the lower.
+    static uint64_t encode(int hint, uint32_t generation, Kind kind = KindPoll);
+
+private:
+    // Make non-copyable.
+    UringDemultiplexer(const UringDemultiplexer&);
+    UringDemultiplexer& operator=(const UringDemultiplexer&);
+
+protected:
+    int m_ringfd;
+    unsigned int m_features;
+
+    // Submission ring.
+    void *m_sqRing;
+    size_t m_sqRingSize;
+    unsigned int *m_sqHead;
+    unsigned int *m_sqTail;
+    unsigned int *m_sqMask;
+    unsigned int *m_sqEntries;
+    struct io_uring_sqe *m_sqes;
+    size_t m_sqesSize;
+    unsigned int m_sqLocalTail; // Tail including not yet published entries.
+
+    // Completion ring (may share the mapping with the submission ring).
+    void *m_cqRing;
+    size_t m_cqRingSize;
+    unsigned int *m_cqHead;
+    unsigned int *m_cqTail;
+    unsigned int *m_cqMask;
+    struct io_uring_cqe *m_cqes;
+
+    WatchTable m_watches;
+    std::vector< int > m_rearm; // Hints to re-arm before the next wait.
+
+    // Receive buffers (NULL until set up).
+    char *m_buffers;
+    bool m_buffersRefused;
+    std::vector< int > m_freeBuffers;
+    std::vector< int > m_reportedBuffers; // To be freed by the next wait.
+};
+
+} // namespace followermaze
+
+#endif // URINGDEMULTIPLEXER_H
@@ -0,0 +1,140 @@
+/*
+ * acceptstorm is a benchmark which connects a lot of clients back to back to
+ * an Acceptor running in the same process and measures how long it takes to
+ * accept and register them with the Reactor. pending limits the amount of
+ * connection requests queueing at once (keep below the listen backlog).
+ * Usage: acceptstorm [connections [poll|epoll [pending]]]
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "client.h"
+#include "reactor.h"
+#include "acceptor.h"
+
+using namespace std;
+using namespace followermaze;
+
+static const int PORT = 9099;
+static const int DEFAULT_CONNECTIONS = 50000;
+static const int DEFAULT_PENDING = 256;
+static const int DESTINATIONS = 4;  // 127.0.0.1-4 to get enough ephemeral ports.
+
+class CountingFactory : public ClientFactory<Client>
+{
+public:
+    CountingFactory() : m_count(0)
+    {
+    }
+
+    virtual EventHandler *createEventHandler(auto_ptr<Connection> connection, Reactor &reactor)
+    {
+        m_count++;
+        return ClientFactory<Client>::createEventHandler(connection, reactor);
+    }
+
+public:
+    int m_count;
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connectTo(int destination)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sockfd < 0)
+    {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + destination);
+
+    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNECTIONS;
+    Reactor::Backend backend = Reactor::BackendDefault;
+    if (argc > 2)
+    {
+        backend = string("poll").compare(argv[2]) == 0 ? Reactor::BackendPoll : Reactor::BackendEpoll;
+    }
+    int pending = argc > 3 ? atoi(argv[3]) : DEFAULT_PENDING;
+
+    try
+    {
+        // Each connection takes two descriptors (client and server side).
+        long maxConnections = (Connection::raiseHandleLimit() - 64) / 2;
+        if (connections > maxConnections)
+        {
+            cout << "Open files limit allows " << maxConnections << " connections only." << endl;
+            connections = maxConnections;
+        }
+
+        Reactor reactor(backend);
+        CountingFactory factory;
+        auto_ptr<EventHandler> acceptor(new Acceptor(PORT, reactor, factory));
+        reactor.addHandler(acceptor, Reactor::EvntAccept);
+
+        vector< int > clients;
+        clients.reserve(connections);
+
+        double start = now();
+        while (factory.m_count < connections)
+        {
+            while (static_cast<int>(clients.size()) < connections &&
+                   static_cast<int>(clients.size()) - factory.m_count < pending)
+            {
+                int sockfd = connectTo(clients.size() % DESTINATIONS);
+                if (sockfd < 0)
+                {
+                    cout << "Failed to connect: " << strerror(errno) << endl;
+                    return 1;
+                }
+                clients.push_back(sockfd);
+            }
+
+            reactor.handleEvents();
+        }
+        double elapsed = now() - start;
+
+        cout << "Backend: " << Reactor::getBackendName(backend) << endl;
+        cout << "Accepted " << factory.m_count << " connections in " << elapsed << " s ("
+             << static_cast<long>(factory.m_count / elapsed) << " connections/s)" << endl;
+
+        for (vector< int >::iterator it = clients.begin(); it != clients.end(); ++it)
+        {
+            close(*it);
+        }
+    }
+    catch (BaseException &e)
+    {
+        cout << e.what() << ": " << e.getErr() << endl;
+        return 1;
+    }
+
+    return 0;
+}
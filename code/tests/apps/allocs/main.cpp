@@ -0,0 +1,312 @@
+/*
+ * allocs is a benchmark which counts heap allocations per event in the
+ * steady state of the server. It runs an Engine and a Reactor in process
+ * with user clients connected over TCP, feeds the Engine batches of
+ * out-of-order private messages, status updates, and broadcasts (after the
+ * users have followed each other), lets the Reactor send the notifications
+ * and drains them on the other end. Every operator new of the process is
+ * counted.
+ * Follow and unfollow events are left out of the measured part: they change
+ * the follower graph, which is allocated node by node on purpose.
+ * Usage: allocs [events [users]]
+ */
+
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "engine.h"
+#include "reactor.h"
+#include "logger.h"
+#include "pool.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::protocol;
+
+static const int PORT = 9097;
+static const int DEFAULT_EVENTS = 1000000;
+static const int DEFAULT_USERS = 100;
+static const int FOLLOWERS = 10;
+static const int BATCH = 100;
+
+static unsigned long g_allocations = 0;
+
+// Kept out of line so the compiler doesn't match the free calls against the
+// operator new calls it sees.
+void *operator new(size_t size) throw(std::bad_alloc) __attribute__((noinline));
+void operator delete(void *block) throw() __attribute__((noinline));
+
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+    __atomic_add_fetch(&g_allocations, 1, __ATOMIC_RELAXED);
+    void *block = malloc(size > 0 ? size : 1);
+    if (block == NULL)
+    {
+        throw std::bad_alloc();
+    }
+
+    return block;
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc)
+{
+    return operator new(size);
+}
+
+void operator delete(void *block) throw()
+{
+    free(block);
+}
+
+void operator delete[](void *block) throw()
+{
+    free(block);
+}
+
+static unsigned long allocations()
+{
+    return __atomic_load_n(&g_allocations, __ATOMIC_RELAXED);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connectTo(int port)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+/* Ticker keeps the Reactor from waiting: its eventfd stays readable. */
+class Ticker : public EventHandler
+{
+public:
+    Ticker() : m_handle(eventfd(1, EFD_NONBLOCK)) {}
+    virtual ~Ticker() { close(m_handle); }
+    virtual Handle getHandle() { return m_handle; }
+
+private:
+    Handle m_handle;
+};
+
+/* Stream generates the text of the events. */
+class Stream
+{
+public:
+    Stream(int users) : m_users(users), m_seqnum(Parser::FIRST_SEQNUM), m_random(12345) {}
+
+    // Appends the follow events making each user follow FOLLOWERS others.
+    void follow(Buffer &events)
+    {
+        for (int user = 1; user <= m_users; ++user)
+        {
+            for (int i = 0; i < FOLLOWERS; ++i)
+            {
+                append(events, m_seqnum++, 'F', next() % m_users + 1, user);
+            }
+        }
+    }
+
+    // Appends a batch of events in random order.
+    void batch(Buffer &events)
+    {
+        long first = m_seqnum;
+        m_seqnum += BATCH;
+        long order[BATCH];
+        for (int i = 0; i < BATCH; ++i)
+        {
+            order[i] = first + i;
+        }
+        for (int i = BATCH - 1; i > 0; --i)
+        {
+            int j = next() % (i + 1);
+            long swapped = order[i];
+            order[i] = order[j];
+            order[j] = swapped;
+        }
+
+        for (int i = 0; i < BATCH; ++i)
+        {
+            unsigned int kind = next() % 100;
+            long from = next() % m_users + 1;
+            long to = next() % m_users + 1;
+            if (kind == 0)
+            {
+                append(events, order[i], 'B', 0, 0);
+            }
+            else if (kind < 50)
+            {
+                append(events, order[i], 'P', from, to);
+            }
+            else
+            {
+                append(events, order[i], 'S', from, 0);
+            }
+        }
+    }
+
+private:
+    unsigned int next()
+    {
+        m_random = m_random * 1103515245 + 12345;
+        return (m_random >> 8) & 0xffffff;
+    }
+
+    static void append(Buffer &events, long seqnum, char type, long from, long to)
+    {
+        char event[64];
+        int length = 0;
+        if (type == 'B')
+        {
+            length = snprintf(event, sizeof(event), "%ld|B\r\n", seqnum);
+        }
+        else if (type == 'S')
+        {
+            length = snprintf(event, sizeof(event), "%ld|S|%ld\r\n", seqnum, from);
+        }
+        else
+        {
+            length = snprintf(event, sizeof(event), "%ld|%c|%ld|%ld\r\n", seqnum, type, from, to);
+        }
+        events.append(event, length);
+    }
+
+private:
+    int m_users;
+    long m_seqnum;
+    unsigned int m_random;
+};
+
+// Receives whatever has arrived for the users.
+static size_t drain(const vector< int > &peers)
+{
+    static char buffer[64 * 1024];
+    size_t received = 0;
+    for (size_t i = 0; i < peers.size(); ++i)
+    {
+        ssize_t length = 0;
+        while ((length = recv(peers[i], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        {
+            received += length;
+        }
+    }
+
+    return received;
+}
+
+// Feeds the Engine rounds batches and delivers the notifications.
+static size_t run(Engine &engine, Reactor &reactor, Stream &stream, Buffer &events,
+                  Framer &framer, const vector< int > &peers, int rounds)
+{
+    size_t received = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        stream.batch(events);
+        engine.handleEvents(events, framer);
+        reactor.handleEvents();
+        reactor.handleEvents();
+        received += drain(peers);
+    }
+
+    return received;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_EVENTS;
+    int users = argc > 2 ? atoi(argv[2]) : DEFAULT_USERS;
+    if (count < BATCH || users <= 0)
+    {
+        cout << "Usage: allocs [events [users]]" << endl;
+        return 1;
+    }
+
+    Logger::getInstance().setLogLevel(Logger::LvlError);
+
+    try
+    {
+        Reactor reactor;
+        Engine engine;
+        Connection server(PORT);
+        EngineDrivenClientFactory<UserClient> factory(engine);
+
+        // Connect the users and let them authenticate.
+        vector< int > peers;
+        for (int user = 1; user <= users; ++user)
+        {
+            int peer = connectTo(PORT);
+            auto_ptr<Connection> connection(server.accept(true));
+            reactor.addHandler(auto_ptr<EventHandler>(factory.createEventHandler(connection, reactor)),
+                               Reactor::EvntRead);
+            char id[16];
+            int length = snprintf(id, sizeof(id), "%d\n", user);
+            ::send(peer, id, length, 0);
+            peers.push_back(peer);
+        }
+        reactor.addHandler(auto_ptr<EventHandler>(new Ticker), Reactor::EvntRead);
+        for (int i = 0; i < 10; ++i)
+        {
+            reactor.handleEvents();
+        }
+
+        // Build the follower graph and warm up.
+        Stream stream(users);
+        Buffer events;
+        Framer framer(Parser::CR, Parser::LF);
+        stream.follow(events);
+        engine.handleEvents(events, framer);
+        int rounds = count / BATCH;
+        run(engine, reactor, stream, events, framer, peers, rounds / 10 + 1);
+
+        unsigned long before = allocations();
+        double start = now();
+        size_t received = run(engine, reactor, stream, events, framer, peers, rounds);
+        double elapsed = now() - start;
+        unsigned long allocated = allocations() - before;
+
+        long total = static_cast<long>(rounds) * BATCH;
+        cout << "events allocations allocations_per_event events_per_sec notified_bytes" << endl;
+        cout << total << " " << allocated << " " << static_cast<double>(allocated) / total << " "
+             << static_cast<long>(total / elapsed) << " " << received << endl;
+        Pool::formatAll(cout);
+        cout << "pool messages reused=" << Message::getReuses() << endl;
+
+        for (size_t i = 0; i < peers.size(); ++i)
+        {
+            close(peers[i]);
+        }
+    }
+    catch (BaseException &e)
+    {
+        cout << e.what() << ": " << e.getErr() << endl;
+        return 1;
+    }
+
+    return 0;
+}
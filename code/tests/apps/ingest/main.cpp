@@ -0,0 +1,219 @@
+/*
+ * ingest is a benchmark which measures how fast a running followermaze takes
+ * events in. It connects a user client and the event source (over TCP or a
+ * Unix-domain socket, see --event-listen), streams follow events (which
+ * don't notify the user) followed by a private message to the user, and
+ * measures the time until the message arrives. The events are sent as text
+ * or as binary records (negotiated by Parser::BINARY_MAGIC). They are
+ * generated before the clock starts.
+ * Usage: ingest [events [event_source_address [user_client_port [text|binary]]]]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include "socketaddress.h"
+#include "protocol.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::protocol;
+
+static const int DEFAULT_EVENTS = 1000000;
+static const int DEFAULT_EVENT_PORT = 9090;
+static const int DEFAULT_USER_PORT = 9099;
+static const size_t CHUNK = 64 * 1024;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Connects to the address on the local host.
+static int connectTo(const SocketAddress &address)
+{
+    struct sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    socklen_t addrLen = 0;
+    int domain = AF_INET;
+
+    if (address.m_family == SocketAddress::FamilyUnix)
+    {
+        struct sockaddr_un *unixAddr = (struct sockaddr_un *)&addr;
+        unixAddr->sun_family = AF_UNIX;
+        strncpy(unixAddr->sun_path, address.m_path.c_str(), sizeof(unixAddr->sun_path) - 1);
+        addrLen = sizeof(struct sockaddr_un);
+        domain = AF_UNIX;
+    }
+    else if (address.m_family == SocketAddress::FamilyTcp6)
+    {
+        struct sockaddr_in6 *inAddr = (struct sockaddr_in6 *)&addr;
+        inAddr->sin6_family = AF_INET6;
+        inAddr->sin6_port = htons(address.m_port);
+        inAddr->sin6_addr = in6addr_loopback;
+        if (!address.m_host.empty())
+        {
+            inet_pton(AF_INET6, address.m_host.c_str(), &inAddr->sin6_addr);
+        }
+        addrLen = sizeof(struct sockaddr_in6);
+        domain = AF_INET6;
+    }
+    else
+    {
+        struct sockaddr_in *inAddr = (struct sockaddr_in *)&addr;
+        inAddr->sin_family = AF_INET;
+        inAddr->sin_port = htons(address.m_port);
+        inAddr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (!address.m_host.empty())
+        {
+            inet_pton(AF_INET, address.m_host.c_str(), &inAddr->sin_addr);
+        }
+        addrLen = sizeof(struct sockaddr_in);
+    }
+
+    int sockfd = socket(domain, SOCK_STREAM, 0);
+    if (sockfd < 0)
+    {
+        return -1;
+    }
+
+    if (connect(sockfd, (struct sockaddr *)&addr, addrLen) < 0)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+static bool sendAll(int sockfd, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t res = send(sockfd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (res <= 0)
+        {
+            return false;
+        }
+        sent += res;
+    }
+
+    return true;
+}
+
+// Appends the event as text or as a binary record.
+static void appendEvent(string &out, bool binary, long seqnum, char type, long from, long to)
+{
+    Event event;
+    event.m_seqnum = seqnum;
+    event.m_type = type;
+    event.m_fromUserId = from;
+    event.m_toUserId = to;
+    Parser::formatPayload(event, event.m_payload);
+    if (binary)
+    {
+        Parser::encodeRecord(event, out);
+    }
+    else
+    {
+        out.append(event.m_payload);
+        out.append(Parser::CRLF);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int events = argc > 1 ? atoi(argv[1]) : DEFAULT_EVENTS;
+    SocketAddress eventAddress(DEFAULT_EVENT_PORT);
+    SocketAddress userAddress(argc > 3 ? atoi(argv[3]) : DEFAULT_USER_PORT);
+    string mode = argc > 4 ? argv[4] : "text";
+
+    if (events <= 0 || (argc > 2 && !SocketAddress::parse(argv[2], eventAddress)) ||
+        (mode != "text" && mode != "binary"))
+    {
+        cout << "Usage: ingest [events [event_source_address [user_client_port [text|binary]]]]" << endl;
+        return 1;
+    }
+    bool binary = (mode == "binary");
+
+    vector< string > chunks(1);
+    for (long seqnum = 1; seqnum < events; ++seqnum)
+    {
+        appendEvent(chunks.back(), binary, seqnum, Parser::TYPE_FOLLOW, seqnum % 1000 + 2, seqnum % 997 + 2);
+        if (chunks.back().size() >= CHUNK)
+        {
+            chunks.push_back(string());
+        }
+    }
+    appendEvent(chunks.back(), binary, events, Parser::TYPE_PRIVATE, 2, 1);
+
+    int user = connectTo(userAddress);
+    if (user < 0 || !sendAll(user, "1\r\n"))
+    {
+        cout << "Failed to connect the user client: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // Let the server register the user.
+    usleep(100 * 1000);
+
+    int eventSource = connectTo(eventAddress);
+    if (eventSource < 0)
+    {
+        cout << "Failed to connect the event source: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    double start = now();
+    char buffer[64];
+    if (binary)
+    {
+        // Wait for the magic to be echoed back.
+        string magic(Parser::BINARY_MAGIC, Parser::BINARY_MAGIC_LENGTH);
+        if (!sendAll(eventSource, magic) ||
+            recv(eventSource, buffer, Parser::BINARY_MAGIC_LENGTH, MSG_WAITALL) != static_cast<ssize_t>(Parser::BINARY_MAGIC_LENGTH) ||
+            magic.compare(0, string::npos, buffer, Parser::BINARY_MAGIC_LENGTH) != 0)
+        {
+            cout << "Binary records not accepted." << endl;
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        if (!sendAll(eventSource, chunks[i]))
+        {
+            cout << "Connection lost." << endl;
+            return 1;
+        }
+    }
+
+    // The message to the user is the last event so it arrives when all the
+    // events have been handled.
+    if (recv(user, buffer, sizeof(buffer), 0) <= 0)
+    {
+        cout << "Connection lost." << endl;
+        return 1;
+    }
+    double elapsed = now() - start;
+
+    close(eventSource);
+    close(user);
+
+    cout << "Event source: " << eventAddress.toString() << " (" << mode << ")" << endl;
+    cout << "Handled " << events << " events in " << elapsed << " s ("
+         << static_cast<long>(events / elapsed) << " events/s)" << endl;
+
+    return 0;
+}
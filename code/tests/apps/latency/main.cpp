@@ -0,0 +1,174 @@
+/*
+ * latency is a benchmark which measures how long it takes a running
+ * followermaze to deliver notifications. It connects a user client and the
+ * event source, sends bursts of private messages to the user and measures
+ * the time from sending a burst until the last notification arrives.
+ * Run it against servers started with different socket profiles (see
+ * --user-socket and --event-socket) to compare them.
+ * Usage: latency [rounds [burst [event_source_port user_client_port]]]
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+static const int DEFAULT_ROUNDS = 10000;
+static const int DEFAULT_BURST = 1;
+static const int DEFAULT_EVENT_PORT = 9090;
+static const int DEFAULT_USER_PORT = 9099;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connectTo(int port)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0)
+    {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    // Measure the server, not this side.
+    int one = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sockfd;
+}
+
+static bool sendAll(int sockfd, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t res = send(sockfd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (res <= 0)
+        {
+            return false;
+        }
+        sent += res;
+    }
+
+    return true;
+}
+
+// Receives until count lines have arrived.
+static bool receiveLines(int sockfd, int count)
+{
+    char buffer[64 * 1024];
+    while (count > 0)
+    {
+        ssize_t res = recv(sockfd, buffer, sizeof(buffer), 0);
+        if (res <= 0)
+        {
+            return false;
+        }
+
+        for (ssize_t i = 0; i < res; ++i)
+        {
+            if (buffer[i] == '\n')
+            {
+                count--;
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+    int burst = argc > 2 ? atoi(argv[2]) : DEFAULT_BURST;
+    int eventPort = argc > 4 ? atoi(argv[3]) : DEFAULT_EVENT_PORT;
+    int userPort = argc > 4 ? atoi(argv[4]) : DEFAULT_USER_PORT;
+
+    if (rounds <= 0 || burst <= 0)
+    {
+        cout << "Usage: latency [rounds [burst [event_source_port user_client_port]]]" << endl;
+        return 1;
+    }
+
+    int user = connectTo(userPort);
+    if (user < 0 || !sendAll(user, "1\r\n"))
+    {
+        cout << "Failed to connect the user client: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // Let the server register the user.
+    usleep(100 * 1000);
+
+    int eventSource = connectTo(eventPort);
+    if (eventSource < 0)
+    {
+        cout << "Failed to connect the event source: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    vector< double > latencies;
+    latencies.reserve(rounds);
+
+    long seqnum = 1;
+    for (int round = 0; round < rounds; ++round)
+    {
+        ostringstream events;
+        for (int i = 0; i < burst; ++i)
+        {
+            events << seqnum++ << "|P|2|1\r\n";
+        }
+
+        double start = now();
+        if (!sendAll(eventSource, events.str()) || !receiveLines(user, burst))
+        {
+            cout << "Connection lost." << endl;
+            return 1;
+        }
+        latencies.push_back((now() - start) * 1e6);
+    }
+
+    close(eventSource);
+    close(user);
+
+    sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (size_t i = 0; i < latencies.size(); ++i)
+    {
+        sum += latencies[i];
+    }
+
+    cout << "Rounds: " << rounds << ", burst: " << burst << endl;
+    cout << "Latency (us): min=" << static_cast<long>(latencies.front())
+         << " avg=" << static_cast<long>(sum / latencies.size())
+         << " p50=" << static_cast<long>(latencies[latencies.size() / 2])
+         << " p99=" << static_cast<long>(latencies[latencies.size() * 99 / 100])
+         << " max=" << static_cast<long>(latencies.back()) << endl;
+
+    return 0;
+}
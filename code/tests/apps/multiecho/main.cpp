@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include "client.h"
 #include "server.h"
 #include "acceptor.h"
@@ -45,9 +46,12 @@ public:
     public:
         int m_userPort;
         int m_adminPort;
+        int m_reactors;
     };
 
-    EchoServer(const Config& config) : m_config(config)
+    EchoServer(const Config& config) :
+        Server(Reactor::BackendDefault, config.m_reactors),
+        m_config(config)
     {
     }
 
@@ -57,9 +61,21 @@ public:
         m_reactor.addHandler(adminAcceptor, Reactor::EvntAccept);
         Logger::getInstance().info("Listening for admins on port ", m_config.m_adminPort);
 
-        auto_ptr<EventHandler> userAcceptor(new Acceptor(m_config.m_userPort, m_reactor, m_clientFactory));
-        m_reactor.addHandler(userAcceptor, Reactor::EvntAccept);
-        Logger::getInstance().info("Listening for users on port ", m_config.m_userPort);
+        if (m_workers.empty())
+        {
+            auto_ptr<EventHandler> userAcceptor(new Acceptor(m_config.m_userPort, m_reactor, m_clientFactory));
+            m_reactor.addHandler(userAcceptor, Reactor::EvntAccept);
+            Logger::getInstance().info("Listening for users on port ", m_config.m_userPort);
+        }
+    }
+
+    virtual void initWorker(Reactor &reactor, int index)
+    {
+        // Multi-reactor variant: each worker accepts users on the shared port.
+        auto_ptr<EventHandler> userAcceptor(new Acceptor(m_config.m_userPort, reactor, m_clientFactory,
+                                                         Connection::DEFAULT_BACKLOG, true));
+        reactor.addHandler(userAcceptor, Reactor::EvntAccept);
+        Logger::getInstance().info("Listening for users in reactor ", index);
     }
 
 protected:
@@ -68,13 +84,17 @@ protected:
     ClientFactory<EchoClient> m_clientFactory;
 };
 
-int main()
+// Usage: multiecho [reactors]
+// reactors - number of worker threads (each with own reactor) to handle the
+// clients. Default 0 (clients are handled by the main thread).
+int main(int argc, char *argv[])
 {
     try
     {
         EchoServer::Config config;
         config.m_userPort = 9099;
         config.m_adminPort = 9999;
+        config.m_reactors = argc > 1 ? atoi(argv[1]) : 0;
 
         EchoServer server(config);
         server.serve();
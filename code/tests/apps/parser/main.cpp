@@ -0,0 +1,339 @@
+/*
+ * parser is a benchmark which compares ways of parsing events: the original
+ * parser (a stringstream split into string tokens by getline and strtol on
+ * each one), the token by token parser which followed it (memchr for each
+ * delimiter and a separate pass over each number) and Parser::parseEvent.
+ * Every method parses the same generated messages in place and counts the
+ * valid events. The events are also parsed from binary records (with the
+ * text payload formatted from them), and both ways are compared with the
+ * payload taken as the Engine does. The rate is given per second of CPU time
+ * of the (only) thread, i.e. events per second per core.
+ * Usage: parser [events]
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <ctime>
+#include "protocol.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::protocol;
+
+static const int DEFAULT_EVENTS = 1000000;
+static const double MIN_SECONDS = 0.5;
+
+static double cpuNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Generates count messages (without CRLF) of all the types.
+static vector< string > generate(int count)
+{
+    static const char TYPES[] = "FUBPS";
+    vector< string > messages;
+    srand(1);
+    for (int seqnum = 1; seqnum <= count; ++seqnum)
+    {
+        char message[64];
+        char type = TYPES[rand() % 5];
+        int from = rand() % 1000 + 1;
+        int to = rand() % 1000 + 1;
+        if (type == 'B')
+        {
+            snprintf(message, sizeof(message), "%d|B", seqnum);
+        }
+        else if (type == 'S')
+        {
+            snprintf(message, sizeof(message), "%d|S|%d", seqnum, from);
+        }
+        else
+        {
+            snprintf(message, sizeof(message), "%d|%c|%d|%d", seqnum, type, from, to);
+        }
+        messages.push_back(message);
+    }
+
+    return messages;
+}
+
+// Parses a message into an event.
+class Method
+{
+public:
+    virtual ~Method() {}
+    virtual const char *getName() const = 0;
+    virtual void parse(Event &event, const string &message) = 0;
+
+    // Turns a message into the input of parse.
+    virtual string prepare(const string &message) const { return message; }
+};
+
+class Stringstream : public Method
+{
+public:
+    virtual const char *getName() const { return "stringstream"; }
+
+    virtual void parse(Event &event, const string &message)
+    {
+        event.m_seqnum = Parser::INVALID_LONG;
+        event.m_type = Parser::TYPE_INVALID;
+        event.m_fromUserId = Parser::INVALID_LONG;
+        event.m_toUserId = Parser::INVALID_LONG;
+
+        stringstream ss(message);
+        string token;
+        unsigned int tokenNum = 0;
+        while (getline(ss, token, Parser::DELIMITER) && tokenNum < 4)
+        {
+            switch (tokenNum++)
+            {
+            case 0:
+                event.m_seqnum = parseLong(token);
+                break;
+            case 1:
+                event.m_type = token.empty() ? Parser::TYPE_INVALID : token[0];
+                break;
+            case 2:
+                event.m_fromUserId = parseLong(token);
+                break;
+            case 3:
+                event.m_toUserId = parseLong(token);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+private:
+    static long parseLong(const string &str)
+    {
+        long res = strtol(str.c_str(), NULL, 10);
+        return (res == 0 || res == LONG_MAX || res == LONG_MIN) ? Parser::INVALID_LONG : res;
+    }
+};
+
+class Tokens : public Method
+{
+public:
+    virtual const char *getName() const { return "tokens"; }
+
+    virtual void parse(Event &event, const string &message)
+    {
+        event.m_seqnum = Parser::INVALID_LONG;
+        event.m_type = Parser::TYPE_INVALID;
+        event.m_fromUserId = Parser::INVALID_LONG;
+        event.m_toUserId = Parser::INVALID_LONG;
+
+        const char *data = message.data();
+        size_t length = message.length();
+        size_t pos = 0;
+        unsigned int tokenNum = 0;
+        while (pos < length && tokenNum < 4)
+        {
+            const char *token = data + pos;
+            const char *end = static_cast<const char*>(memchr(token, Parser::DELIMITER, length - pos));
+            size_t tokenLength = end != NULL ? static_cast<size_t>(end - token) : length - pos;
+            pos += tokenLength + 1;
+
+            switch (tokenNum++)
+            {
+            case 0:
+                event.m_seqnum = parseLong(token, tokenLength);
+                break;
+            case 1:
+                event.m_type = tokenLength == 0 ? Parser::TYPE_INVALID : token[0];
+                break;
+            case 2:
+                event.m_fromUserId = parseLong(token, tokenLength);
+                break;
+            case 3:
+                event.m_toUserId = parseLong(token, tokenLength);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+private:
+    static long parseLong(const char *str, size_t length)
+    {
+        size_t pos = 0;
+        while (pos < length && isspace(static_cast<unsigned char>(str[pos])))
+        {
+            pos++;
+        }
+
+        bool negative = false;
+        if (pos < length && (str[pos] == '+' || str[pos] == '-'))
+        {
+            negative = (str[pos] == '-');
+            pos++;
+        }
+
+        long res = 0;
+        for (; pos < length && str[pos] >= '0' && str[pos] <= '9'; ++pos)
+        {
+            long digit = str[pos] - '0';
+            if (negative ? res < (LONG_MIN + digit) / 10 : res > (LONG_MAX - digit) / 10)
+            {
+                return Parser::INVALID_LONG;
+            }
+
+            res = res * 10 + (negative ? -digit : digit);
+        }
+
+        return (res == 0 || res == LONG_MAX || res == LONG_MIN) ? Parser::INVALID_LONG : res;
+    }
+};
+
+class ParseEvent : public Method
+{
+public:
+    virtual const char *getName() const { return "parseEvent"; }
+
+    virtual void parse(Event &event, const string &message)
+    {
+        Parser::parseEvent(event, message.data(), message.length());
+    }
+};
+
+// Parses the message and copies it into the payload like the Engine does.
+class ParseEventPayload : public Method
+{
+public:
+    virtual const char *getName() const { return "parseEvent+payload"; }
+
+    virtual void parse(Event &event, const string &message)
+    {
+        Parser::parseEvent(event, message.data(), message.length());
+        event.m_payload.assign(message.data(), message.length());
+    }
+};
+
+// Parses a binary record (without the length prefix) and checks the length
+// of the payload like the Engine does. The payload is formatted if the event
+// notifies someone, or with formatting set.
+class ParseRecord : public Method
+{
+public:
+    ParseRecord(bool formatting) :
+        m_formatting(formatting)
+    {
+    }
+
+    virtual const char *getName() const { return m_formatting ? "parseRecord+payload" : "parseRecord"; }
+
+    virtual void parse(Event &event, const string &record)
+    {
+        size_t length = Parser::parseRecord(event, record.data(), record.length());
+        if (Parser::getPayloadLength(event) != length)
+        {
+            event.m_type = Parser::TYPE_INVALID;
+        }
+        else if (m_formatting)
+        {
+            Parser::formatPayload(event, event.m_payload);
+        }
+    }
+
+    virtual string prepare(const string &message) const
+    {
+        Event event;
+        event.m_payload = message;
+        Parser::parseEvent(event);
+        string record;
+        Parser::encodeRecord(event, record);
+        return record.substr(Parser::RECORD_PREFIX_LENGTH);
+    }
+
+private:
+    bool m_formatting;
+};
+
+// Parses the messages until MIN_SECONDS of CPU time have passed. Returns
+// events per second and nanoseconds per event.
+static void run(Method &method, const vector< string > &inputs, double &eventsPerSecond, double &nsPerEvent)
+{
+    vector< string > messages;
+    messages.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        messages.push_back(method.prepare(inputs[i]));
+    }
+
+    Event event;
+    size_t events = 0;
+    size_t valid = 0;
+    double start = cpuNow();
+    double elapsed = 0;
+    do
+    {
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            method.parse(event, messages[i]);
+            valid += Parser::isValidEvent(event) ? 1 : 0;
+        }
+        events += messages.size();
+        elapsed = cpuNow() - start;
+    }
+    while (elapsed < MIN_SECONDS);
+
+    if (valid != events)
+    {
+        cerr << method.getName() << ": " << events - valid << " invalid events" << endl;
+    }
+
+    eventsPerSecond = events / elapsed;
+    nsPerEvent = elapsed * 1e9 / events;
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_EVENTS;
+    if (count <= 0)
+    {
+        cout << "Usage: parser [events]" << endl;
+        return 1;
+    }
+
+    vector< string > messages = generate(count);
+
+    vector< Method* > methods;
+    methods.push_back(new Stringstream);
+    methods.push_back(new Tokens);
+    methods.push_back(new ParseEvent);
+    methods.push_back(new ParseEventPayload);
+    methods.push_back(new ParseRecord(false));
+    methods.push_back(new ParseRecord(true));
+
+    cout << "method events_per_sec_per_core ns_per_event" << endl;
+    for (size_t i = 0; i < methods.size(); ++i)
+    {
+        double eventsPerSecond = 0;
+        double nsPerEvent = 0;
+        run(*methods[i], messages, eventsPerSecond, nsPerEvent);
+        cout << methods[i]->getName() << " "
+             << static_cast<long>(eventsPerSecond) << " "
+             << static_cast<long>(nsPerEvent * 10) / 10.0 << endl;
+    }
+
+    for (size_t i = 0; i < methods.size(); ++i)
+    {
+        delete methods[i];
+    }
+
+    return 0;
+}
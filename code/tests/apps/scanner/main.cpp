@@ -0,0 +1,322 @@
+/*
+ * scanner is a benchmark which compares ways of splitting the input of the
+ * event source into messages: calling Parser::findMessage per message (the
+ * string flavour copies every message, the pointer flavour scans byte by
+ * byte) and one pass of DelimiterScanner with each instruction set the CPU
+ * supports. The input is a stream of generated events split into chunks the
+ * size of what a Connection receives at once and of small batches.
+ * The stream part receives the events into a Buffer in fragments down to a
+ * byte at a time (like from an event source sending small batches) and
+ * compares scanning all the buffered data after every fragment with resuming
+ * the scan with a Framer.
+ * Usage: scanner [events]
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "protocol.h"
+#include "scanner.h"
+#include "buffer.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::protocol;
+
+static const int DEFAULT_EVENTS = 1000000;
+static const size_t CHUNKS[] = { 256, Connection::READ_CHUNK };
+static const size_t FRAGMENTS[] = { 1, 7, 64, 1024 };
+static const double MIN_SECONDS = 0.5;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Generates the text of count events of all the types.
+static string generate(int count)
+{
+    static const char TYPES[] = "FUBPS";
+    string events;
+    srand(1);
+    for (int seqnum = 1; seqnum <= count; ++seqnum)
+    {
+        char event[64];
+        char type = TYPES[rand() % 5];
+        int from = rand() % 1000 + 1;
+        int to = rand() % 1000 + 1;
+        int length = 0;
+        if (type == 'B')
+        {
+            length = snprintf(event, sizeof(event), "%d|B\r\n", seqnum);
+        }
+        else if (type == 'S')
+        {
+            length = snprintf(event, sizeof(event), "%d|S|%d\r\n", seqnum, from);
+        }
+        else
+        {
+            length = snprintf(event, sizeof(event), "%d|%c|%d|%d\r\n", seqnum, type, from, to);
+        }
+        events.append(event, length);
+    }
+
+    return events;
+}
+
+// Splits a chunk into messages. Returns the number of messages.
+class Method
+{
+public:
+    virtual ~Method() {}
+    virtual const char *getName() const = 0;
+    virtual size_t split(const char *data, size_t size) = 0;
+};
+
+class FindMessageString : public Method
+{
+public:
+    virtual const char *getName() const { return "findMessage/string"; }
+
+    virtual size_t split(const char *data, size_t size)
+    {
+        m_chunk.assign(data, size);
+        size_t start = 0;
+        size_t count = 0;
+        while (start != string::npos && Parser::findMessage(m_chunk, start, m_message))
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+private:
+    string m_chunk;
+    string m_message;
+};
+
+class FindMessagePointer : public Method
+{
+public:
+    virtual const char *getName() const { return "findMessage/pointer"; }
+
+    virtual size_t split(const char *data, size_t size)
+    {
+        size_t start = 0;
+        size_t count = 0;
+        const char *message = NULL;
+        size_t length = 0;
+        while (Parser::findMessage(data, size, start, message, length))
+        {
+            ++count;
+        }
+
+        return count;
+    }
+};
+
+class Scan : public Method
+{
+public:
+    Scan(DelimiterScanner::Isa isa) :
+        m_scanner(Parser::CR, Parser::LF, isa),
+        m_name(string("scan/") + DelimiterScanner::getIsaName(isa))
+    {
+    }
+
+    virtual const char *getName() const { return m_name.c_str(); }
+
+    virtual size_t split(const char *data, size_t size)
+    {
+        m_spans.clear();
+        m_scanner.scan(data, size, m_spans);
+        return m_spans.size();
+    }
+
+private:
+    DelimiterScanner m_scanner;
+    string m_name;
+    SpanList m_spans;
+};
+
+// Splits the buffered data of a stream into messages. Returns the number of
+// messages (rescanning counts an empty one for every CRLF split between
+// fragments) and the amount of bytes consumed.
+class StreamMethod
+{
+public:
+    virtual ~StreamMethod() {}
+    virtual const char *getName() const = 0;
+    virtual size_t split(const char *data, size_t size, size_t &consumed) = 0;
+};
+
+class Rescan : public StreamMethod
+{
+public:
+    Rescan() :
+        m_scanner(Parser::CR, Parser::LF)
+    {
+    }
+
+    virtual const char *getName() const { return "rescan"; }
+
+    virtual size_t split(const char *data, size_t size, size_t &consumed)
+    {
+        m_spans.clear();
+        consumed = m_scanner.scan(data, size, m_spans);
+        return m_spans.size();
+    }
+
+private:
+    DelimiterScanner m_scanner;
+    SpanList m_spans;
+};
+
+class Frame : public StreamMethod
+{
+public:
+    Frame() :
+        m_framer(Parser::CR, Parser::LF)
+    {
+    }
+
+    virtual const char *getName() const { return "framer"; }
+
+    virtual size_t split(const char *data, size_t size, size_t &consumed)
+    {
+        m_spans.clear();
+        consumed = m_framer.frame(data, size, m_spans);
+        return m_spans.size();
+    }
+
+private:
+    Framer m_framer;
+    SpanList m_spans;
+};
+
+// Receives the events into a Buffer fragment by fragment and splits the
+// buffered data after each one until MIN_SECONDS have passed. Returns
+// nanoseconds per event (of count in events) and per byte.
+static void runStream(StreamMethod &method, const string &events, int count, size_t fragment, double &nsPerEvent, double &nsPerByte)
+{
+    Buffer buffer;
+    size_t passes = 0;
+    size_t bytes = 0;
+    double start = now();
+    double elapsed = 0;
+    do
+    {
+        for (size_t offset = 0; offset < events.size(); offset += fragment)
+        {
+            size_t size = events.size() - offset < fragment ? events.size() - offset : fragment;
+            buffer.append(events.data() + offset, size);
+            size_t consumed = 0;
+            method.split(buffer.data(), buffer.size(), consumed);
+            buffer.consume(consumed);
+        }
+        ++passes;
+        bytes += events.size();
+        elapsed = now() - start;
+    }
+    while (elapsed < MIN_SECONDS);
+
+    nsPerEvent = elapsed * 1e9 / (passes * count);
+    nsPerByte = elapsed * 1e9 / bytes;
+}
+
+// Splits the events chunk by chunk until MIN_SECONDS have passed. Returns
+// nanoseconds per message and megabytes per second.
+static void run(Method &method, const string &events, size_t chunk, double &nsPerMessage, double &mbPerSecond)
+{
+    size_t messages = 0;
+    size_t bytes = 0;
+    double start = now();
+    double elapsed = 0;
+    do
+    {
+        for (size_t offset = 0; offset < events.size(); offset += chunk)
+        {
+            size_t size = events.size() - offset < chunk ? events.size() - offset : chunk;
+            messages += method.split(events.data() + offset, size);
+        }
+        bytes += events.size();
+        elapsed = now() - start;
+    }
+    while (elapsed < MIN_SECONDS);
+
+    nsPerMessage = elapsed * 1e9 / messages;
+    mbPerSecond = bytes / elapsed / (1024 * 1024);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_EVENTS;
+    if (count <= 0)
+    {
+        cout << "Usage: scanner [events]" << endl;
+        return 1;
+    }
+
+    string events = generate(count);
+
+    vector< Method* > methods;
+    methods.push_back(new FindMessageString);
+    methods.push_back(new FindMessagePointer);
+    for (int isa = DelimiterScanner::IsaScalar; isa < DelimiterScanner::IsaBest; ++isa)
+    {
+        if (DelimiterScanner::isSupported(static_cast<DelimiterScanner::Isa>(isa)))
+        {
+            methods.push_back(new Scan(static_cast<DelimiterScanner::Isa>(isa)));
+        }
+    }
+
+    cout << "method chunk_bytes ns_per_message mb_per_sec" << endl;
+    for (size_t i = 0; i < sizeof(CHUNKS) / sizeof(CHUNKS[0]); ++i)
+    {
+        for (size_t j = 0; j < methods.size(); ++j)
+        {
+            double nsPerMessage = 0;
+            double mbPerSecond = 0;
+            run(*methods[j], events, CHUNKS[i], nsPerMessage, mbPerSecond);
+            cout << methods[j]->getName() << " " << CHUNKS[i] << " "
+                 << static_cast<long>(nsPerMessage * 10) / 10.0 << " "
+                 << static_cast<long>(mbPerSecond) << endl;
+        }
+    }
+
+    for (size_t j = 0; j < methods.size(); ++j)
+    {
+        delete methods[j];
+    }
+
+    vector< StreamMethod* > streamMethods;
+    streamMethods.push_back(new Rescan);
+    streamMethods.push_back(new Frame);
+
+    cout << endl << "stream fragment_bytes ns_per_event ns_per_byte" << endl;
+    for (size_t i = 0; i < sizeof(FRAGMENTS) / sizeof(FRAGMENTS[0]); ++i)
+    {
+        for (size_t j = 0; j < streamMethods.size(); ++j)
+        {
+            double nsPerEvent = 0;
+            double nsPerByte = 0;
+            runStream(*streamMethods[j], events, count, FRAGMENTS[i], nsPerEvent, nsPerByte);
+            cout << streamMethods[j]->getName() << " " << FRAGMENTS[i] << " "
+                 << static_cast<long>(nsPerEvent * 10) / 10.0 << " "
+                 << static_cast<long>(nsPerByte * 100) / 100.0 << endl;
+        }
+    }
+
+    for (size_t j = 0; j < streamMethods.size(); ++j)
+    {
+        delete streamMethods[j];
+    }
+
+    return 0;
+}
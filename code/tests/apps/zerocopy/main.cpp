@@ -0,0 +1,141 @@
+/*
+ * zerocopy is a benchmark which compares the CPU time it takes a Connection
+ * to send data with and without copying it into the kernel (see the zerocopy
+ * option of SocketProfile) for a range of batch sizes. A thread of the same
+ * process receives and drops the data.
+ * Zero-copy pays off for large batches sent through a real network device
+ * only: the OS copies the data anyway if it is delivered locally (the
+ * Connection notices and stops trying), so on loopback both columns should
+ * be about the same.
+ * Usage: zerocopy [megabytes_per_size]
+ */
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "connection.h"
+
+using namespace std;
+using namespace followermaze;
+
+static const int PORT = 9098;
+static const int DEFAULT_MEGABYTES = 256;
+static const size_t SIZES[] = { 1024, 4096, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+
+static double cpuTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *sink(void *arg)
+{
+    int sockfd = *static_cast<int*>(arg);
+    char buffer[256 * 1024];
+    while (recv(sockfd, buffer, sizeof(buffer), 0) > 0)
+    {
+    }
+
+    return NULL;
+}
+
+static int connectTo(int port)
+{
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+// Sends total bytes in batches of size. Returns CPU microseconds per
+// megabyte and the number of sends which went without copying.
+static double run(bool zeroCopy, size_t size, size_t total, unsigned int &zeroCopySends, long &sends)
+{
+    Connection server(PORT);
+    if (zeroCopy)
+    {
+        SocketProfile profile;
+        profile.m_zeroCopy = 1;
+        server.setProfile(profile);
+    }
+
+    int peer = connectTo(PORT);
+    auto_ptr<Connection> connection(server.accept());
+    pthread_t thread;
+    pthread_create(&thread, NULL, sink, &peer);
+
+    string data(size, 'x');
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(data.data());
+    iov.iov_len = size;
+
+    sends = 0;
+    double start = cpuTime();
+    for (size_t sent = 0; sent < total; )
+    {
+        size_t length = connection->send(&iov, 1);
+        sent += length;
+        ++sends;
+
+        // The data doesn't change so the completions are only collected to
+        // keep the amount of pinned pages down.
+        connection->reapZeroCopy();
+    }
+    double elapsed = cpuTime() - start;
+    zeroCopySends = connection->getZeroCopySends();
+
+    connection.reset();
+    pthread_join(thread, NULL);
+    close(peer);
+
+    return elapsed * 1e6 / (total / (1024.0 * 1024.0));
+}
+
+int main(int argc, char *argv[])
+{
+    int megabytes = argc > 1 ? atoi(argv[1]) : DEFAULT_MEGABYTES;
+    if (megabytes <= 0)
+    {
+        cout << "Usage: zerocopy [megabytes_per_size]" << endl;
+        return 1;
+    }
+    size_t total = static_cast<size_t>(megabytes) * 1024 * 1024;
+
+    try
+    {
+        cout << "batch_bytes copy_us_per_mb zerocopy_us_per_mb zerocopy_sends" << endl;
+        for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i)
+        {
+            unsigned int zeroCopySends = 0;
+            long sends = 0;
+            double copy = run(false, SIZES[i], total, zeroCopySends, sends);
+            double zeroCopy = run(true, SIZES[i], total, zeroCopySends, sends);
+            cout << SIZES[i] << " " << static_cast<long>(copy) << " " << static_cast<long>(zeroCopy)
+                 << " " << zeroCopySends << "/" << sends << endl;
+        }
+    }
+    catch (BaseException &e)
+    {
+        cout << e.what() << ": " << e.getErr() << endl;
+        return 1;
+    }
+
+    return 0;
+}
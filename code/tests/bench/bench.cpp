@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include "bench.h"
+
+namespace followermaze
+{
+
+namespace bench
+{
+
+namespace
+{
+
+double now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double median(vector< double > values)
+{
+    sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 != 0 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+// Writes str as a JSON string.
+void writeString(ostream &out, const string &str)
+{
+    out << '"';
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Writes value rounded to a tenth.
+void writeNumber(ostream &out, double value)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%.1f", value);
+    out << number;
+}
+
+} // namespace
+
+/*----------------------------------------------------------------------------*/
+
+Workload::Workload(size_t events, size_t maxBatch, size_t users, unsigned int seed) :
+    m_events(events),
+    m_maxBatch(maxBatch > 0 ? maxBatch : 1),
+    m_users(users > 1 ? users : 2)
+{
+    // Share of each type in percents.
+    static const char TYPES[] = { 'P', 'S', 'F', 'U', 'B' };
+    static const int SHARES[] = { 35, 30, 25, 8, 2 };
+
+    srand(seed);
+    m_payloads.reserve(m_events);
+
+    size_t seqnum = 1;
+    while (seqnum <= m_events)
+    {
+        size_t batch = 1 + rand() % m_maxBatch;
+        if (batch > m_events - seqnum + 1)
+        {
+            batch = m_events - seqnum + 1;
+        }
+
+        size_t first = m_payloads.size();
+        for (size_t i = 0; i < batch; ++i, ++seqnum)
+        {
+            int share = rand() % 100;
+            size_t type = 0;
+            while (share >= SHARES[type])
+            {
+                share -= SHARES[type++];
+            }
+
+            long from = 1 + rand() % m_users;
+            long to = 1 + rand() % m_users;
+            char payload[64];
+            switch (TYPES[type])
+            {
+            case 'B':
+                snprintf(payload, sizeof(payload), "%lu|B", static_cast<unsigned long>(seqnum));
+                break;
+            case 'S':
+                snprintf(payload, sizeof(payload), "%lu|S|%ld", static_cast<unsigned long>(seqnum), from);
+                break;
+            default:
+                snprintf(payload, sizeof(payload), "%lu|%c|%ld|%ld", static_cast<unsigned long>(seqnum), TYPES[type], from, to);
+                break;
+            }
+            m_payloads.push_back(payload);
+        }
+
+        // Shuffle the batch.
+        for (size_t i = m_payloads.size() - 1; i > first; --i)
+        {
+            swap(m_payloads[i], m_payloads[first + rand() % (i - first + 1)]);
+        }
+
+        size_t start = m_stream.size();
+        for (size_t i = first; i < m_payloads.size(); ++i)
+        {
+            m_stream += m_payloads[i];
+            m_stream += "\r\n";
+        }
+        m_batches.push_back(m_stream.size() - start);
+        m_batchEvents.push_back(batch);
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+Benchmark::Benchmark(const string &name) :
+    m_name(name)
+{
+    getRegistry().push_back(this);
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+const string &Benchmark::getName() const
+{
+    return m_name;
+}
+
+size_t Benchmark::getBytes() const
+{
+    return 0;
+}
+
+void Benchmark::tearDown()
+{
+}
+
+Result Benchmark::measure(size_t samples, double minSeconds)
+{
+    Result result;
+    result.m_name = m_name;
+    result.m_samples = samples > 0 ? samples : 1;
+    result.m_iterations = 0;
+    result.m_items = 0;
+    result.m_bytes = getBytes();
+
+    vector< double > nsPerItem;
+    vector< double > cpuNsPerItem;
+    for (size_t sample = 0; sample < result.m_samples; ++sample)
+    {
+        size_t items = 0;
+        double start = now(CLOCK_MONOTONIC);
+        double cpuStart = now(CLOCK_THREAD_CPUTIME_ID);
+        double elapsed = 0;
+        do
+        {
+            result.m_items = run();
+            items += result.m_items;
+            ++result.m_iterations;
+            elapsed = now(CLOCK_MONOTONIC) - start;
+        }
+        while (elapsed < minSeconds);
+
+        double cpuElapsed = now(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+        nsPerItem.push_back(items > 0 ? elapsed * 1e9 / items : 0);
+        cpuNsPerItem.push_back(items > 0 ? cpuElapsed * 1e9 / items : 0);
+    }
+
+    result.m_nsPerItem = median(nsPerItem);
+    result.m_minNsPerItem = *min_element(nsPerItem.begin(), nsPerItem.end());
+    result.m_cpuNsPerItem = median(cpuNsPerItem);
+    return result;
+}
+
+const vector< Benchmark* > &Benchmark::getAll()
+{
+    return getRegistry();
+}
+
+vector< Benchmark* > &Benchmark::getRegistry()
+{
+    // Constructed on first use as the Benchmarks are static, too.
+    static vector< Benchmark* > registry;
+    return registry;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void writeJson(ostream &out, const Workload &workload, const vector< Result > &results)
+{
+    out << "{\n";
+    out << "  \"workload\": {\"events\": " << workload.m_events
+        << ", \"max_batch\": " << workload.m_maxBatch
+        << ", \"users\": " << workload.m_users
+        << ", \"bytes\": " << workload.m_stream.size() << "},\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &result = results[i];
+        out << (i > 0 ? ",\n" : "\n") << "    {\"name\": ";
+        writeString(out, result.m_name);
+        out << ", \"samples\": " << result.m_samples
+            << ", \"iterations\": " << result.m_iterations
+            << ", \"items\": " << result.m_items
+            << ", \"bytes\": " << result.m_bytes
+            << ", \"ns_per_item\": ";
+        writeNumber(out, result.m_nsPerItem);
+        out << ", \"min_ns_per_item\": ";
+        writeNumber(out, result.m_minNsPerItem);
+        out << ", \"cpu_ns_per_item\": ";
+        writeNumber(out, result.m_cpuNsPerItem);
+        out << ", \"items_per_sec\": ";
+        writeNumber(out, result.m_nsPerItem > 0 ? 1e9 / result.m_nsPerItem : 0);
+        out << ", \"mb_per_sec\": ";
+        writeNumber(out, result.m_nsPerItem > 0 && result.m_items > 0 ?
+                         result.m_bytes / (result.m_nsPerItem * result.m_items / 1e9) / (1024 * 1024) : 0);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace bench
+
+} // namespace followermaze
@@ -0,0 +1,120 @@
+/*
+ * This file declares the Benchmark base class, the Workload the benchmarks
+ * run on, and the Result of a run.
+ *
+ * A benchmark is a subclass of Benchmark with a static instance (which
+ * registers itself, like the TESTs of the unit tests):
+ *
+ *      class MyBenchmark : public Benchmark
+ *      {
+ *      public:
+ *          MyBenchmark() : Benchmark("my") {}
+ *          virtual void setUp(const Workload &workload) { ... }
+ *          virtual size_t run() { ...; return items; }
+ *      };
+ *
+ *      static MyBenchmark myBenchmark;
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+namespace followermaze
+{
+
+namespace bench
+{
+
+/* Workload is a synthetic stream of events sent by an event source the way
+ * the followermaze test suite sends it: the events are cut into batches of
+ * random size (up to m_maxBatch) and shuffled within each batch, so they
+ * arrive out of order by up to a batch. The events are of all the types
+ * (mostly private messages, status updates, and follows) between m_users
+ * users.
+ */
+struct Workload
+{
+    Workload(size_t events, size_t maxBatch, size_t users, unsigned int seed);
+
+    size_t m_events;
+    size_t m_maxBatch;
+    size_t m_users;
+
+    string m_stream;                // CRLF terminated events in the order sent.
+    vector< size_t > m_batches;     // Length in bytes of each batch of m_stream.
+    vector< size_t > m_batchEvents; // Number of events in each batch.
+    vector< string > m_payloads;    // Of the events in the order sent.
+};
+
+/* Result holds the measurements of a benchmark. The time per item is the
+ * median of the samples (the least disturbed by other work) and the best
+ * one.
+ */
+struct Result
+{
+    string m_name;
+    size_t m_samples;
+    size_t m_iterations;   // Runs in all the samples.
+    size_t m_items;        // Per run.
+    size_t m_bytes;        // Per run (0 if not relevant).
+    double m_nsPerItem;    // Median of the samples.
+    double m_minNsPerItem; // Best of the samples.
+    double m_cpuNsPerItem; // CPU time of the thread, median of the samples.
+};
+
+/* Benchmark is a piece of code run over a Workload.
+ */
+class Benchmark
+{
+public:
+    // name should tell the parameters, if any (e.g. "handleEvents/batch=100").
+    explicit Benchmark(const string &name);
+    virtual ~Benchmark();
+
+    const string &getName() const;
+
+    // Prepares the input from the workload (not measured).
+    virtual void setUp(const Workload &workload) = 0;
+
+    // Runs once over the input. Returns the number of items (e.g. events)
+    // processed.
+    virtual size_t run() = 0;
+
+    // Returns the number of bytes processed per run (0 if not relevant).
+    virtual size_t getBytes() const;
+
+    // Frees the input.
+    virtual void tearDown();
+
+    // Runs samples samples of at least minSeconds each.
+    Result measure(size_t samples, double minSeconds);
+
+    // Returns all the Benchmarks in the order of registration.
+    static const vector< Benchmark* > &getAll();
+
+protected:
+    string m_name;
+
+private:
+    static vector< Benchmark* > &getRegistry();
+
+private:
+    // Make non-copyable.
+    Benchmark(const Benchmark&);
+    Benchmark& operator=(const Benchmark&);
+};
+
+// Writes the results (and the workload parameters) as a JSON document.
+void writeJson(ostream &out, const Workload &workload, const vector< Result > &results);
+
+} // namespace bench
+
+} // namespace followermaze
+
+#endif // BENCH_H
@@ -0,0 +1,198 @@
+/*
+ * Benchmarks of the Engine: sorting the queue of out of order events and
+ * handling the event source input end to end (parsing, sorting, processing,
+ * and notifying connected users). Each runs over workloads of batches of up
+ * to 1, 10, 100 (the default of the test suite), and 1000 events. The items
+ * are events.
+ */
+
+#include <memory>
+#include <sstream>
+#include "bench.h"
+#include "engine.h"
+#include "reactor.h"
+#include "buffer.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::bench;
+using namespace followermaze::protocol;
+
+namespace
+{
+
+const size_t BATCHES[] = { 1, 10, 100, 1000 };
+const unsigned int SEED = 1;
+
+string getBatchName(const char *name, size_t batch)
+{
+    ostringstream out;
+    out << name << "/batch=" << batch;
+    return out.str();
+}
+
+// Queues the events batch by batch, sorts the queue and takes the events
+// which are next in sequence off it like the Engine does.
+class SortEvents : public Benchmark
+{
+public:
+    SortEvents(size_t batch) :
+        Benchmark(getBatchName("SortEventQueue", batch)),
+        m_batch(batch)
+    {
+    }
+
+    virtual void setUp(const Workload &workload)
+    {
+        Workload batched(workload.m_events, m_batch, workload.m_users, SEED);
+        m_events.resize(batched.m_payloads.size());
+        for (size_t i = 0; i < m_events.size(); ++i)
+        {
+            m_events[i].m_payload = batched.m_payloads[i];
+            Parser::parseEvent(m_events[i]);
+        }
+
+        m_batches = batched.m_batchEvents;
+    }
+
+    virtual size_t run()
+    {
+        EventQueue queue;
+        long next = Parser::FIRST_SEQNUM;
+        size_t taken = 0;
+        size_t first = 0;
+        for (size_t i = 0; i < m_batches.size(); ++i)
+        {
+            for (size_t j = first; j < first + m_batches[i]; ++j)
+            {
+                queue.push_back(&m_events[j]);
+            }
+            first += m_batches[i];
+
+            SortEventQueue(queue);
+            while (!queue.empty() && queue.back()->m_seqnum == next)
+            {
+                queue.pop_back();
+                ++next;
+                ++taken;
+            }
+        }
+
+        return taken;
+    }
+
+    virtual void tearDown()
+    {
+        m_events.clear();
+        m_batches.clear();
+    }
+
+private:
+    size_t m_batch;
+    vector< Event > m_events;   // In the order sent.
+    vector< size_t > m_batches; // Events per batch.
+};
+
+// A connected user which counts its notifications.
+class BenchClient : public UserClient
+{
+public:
+    BenchClient(auto_ptr<Connection> connection, Reactor &reactor, Engine &engine) :
+        UserClient(connection, reactor, engine),
+        m_notifications(0)
+    {
+    }
+
+    virtual void send(Message* /*message*/)
+    {
+        ++m_notifications;
+    }
+
+    size_t m_notifications;
+};
+
+// Hands the stream to an Engine batch by batch (the way an event source
+// writes it) with all the users connected.
+class HandleEvents : public Benchmark
+{
+public:
+    HandleEvents(size_t batch) :
+        Benchmark(getBatchName("handleEvents", batch)),
+        m_batch(batch),
+        m_framer(Parser::CR, Parser::LF)
+    {
+    }
+
+    virtual void setUp(const Workload &workload)
+    {
+        Workload batched(workload.m_events, m_batch, workload.m_users, SEED);
+        m_stream = batched.m_stream;
+        m_batches = batched.m_batches;
+        m_events = batched.m_events;
+
+        m_reactor.reset(new Reactor);
+        m_engine.reset(new Engine);
+        for (size_t id = 1; id <= workload.m_users; ++id)
+        {
+            BenchClient *client = new BenchClient(auto_ptr<Connection>(new Connection()), *m_reactor, *m_engine);
+            m_engine->registerUser(client, id);
+            m_clients.push_back(client);
+        }
+    }
+
+    virtual size_t run()
+    {
+        m_engine->resetEventQueue();
+        m_buffer.clear();
+        m_framer.reset();
+
+        size_t offset = 0;
+        for (size_t i = 0; i < m_batches.size(); ++i)
+        {
+            m_buffer.append(m_stream.data() + offset, m_batches[i]);
+            m_engine->handleEvents(m_buffer, m_framer);
+            offset += m_batches[i];
+        }
+
+        return m_events;
+    }
+
+    virtual size_t getBytes() const
+    {
+        return m_stream.size();
+    }
+
+    virtual void tearDown()
+    {
+        for (size_t i = 0; i < m_clients.size(); ++i)
+        {
+            m_engine->unregisterUser(i + 1, m_clients[i]);
+            delete m_clients[i];
+        }
+        m_clients.clear();
+        m_engine.reset();
+        m_reactor.reset();
+    }
+
+private:
+    size_t m_batch;
+    string m_stream;
+    vector< size_t > m_batches;
+    size_t m_events;
+    auto_ptr<Reactor> m_reactor;
+    auto_ptr<Engine> m_engine;
+    vector< BenchClient* > m_clients;
+    Buffer m_buffer;
+    Framer m_framer; // Like the one of an EventSource.
+};
+
+SortEvents sortEvents1(BATCHES[0]);
+SortEvents sortEvents10(BATCHES[1]);
+SortEvents sortEvents100(BATCHES[2]);
+SortEvents sortEvents1000(BATCHES[3]);
+HandleEvents handleEvents1(BATCHES[0]);
+HandleEvents handleEvents10(BATCHES[1]);
+HandleEvents handleEvents100(BATCHES[2]);
+HandleEvents handleEvents1000(BATCHES[3]);
+
+} // namespace
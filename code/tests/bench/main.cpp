@@ -0,0 +1,163 @@
+/*
+ * followermaze_bench runs the benchmarks of the hot paths (see parser.cpp
+ * and engine.cpp) over a synthetic Workload and writes the results as JSON,
+ * so that runs can be compared from commit to commit.
+ * Usage: followermaze_bench [--events=N] [--batch=N] [--users=N]
+ *                           [--samples=N] [--min-time=seconds]
+ *                           [--filter=substring] [--output=file]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "bench.h"
+#include "logger.h"
+#include "protocol.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::bench;
+using namespace followermaze::protocol;
+
+namespace
+{
+
+const char USAGE[] =
+    "Usage: followermaze_bench [--events=N] [--batch=N] [--users=N]\n"
+    "                          [--samples=N] [--min-time=seconds]\n"
+    "                          [--filter=substring] [--output=file]";
+
+struct Options
+{
+    Options() :
+        m_events(100000),
+        m_batch(100),
+        m_users(100),
+        m_samples(5),
+        m_minSeconds(0.2)
+    {
+    }
+
+    long m_events;
+    long m_batch;
+    long m_users;
+    long m_samples;
+    double m_minSeconds;
+    string m_filter;
+    string m_output;
+};
+
+// Parses a positive number option value. Returns false if invalid.
+bool parsePositive(const string &value, long &number)
+{
+    number = Parser::parseLong(value);
+    return number != Parser::INVALID_LONG && number > 0;
+}
+
+// Parses an option (--name=value). Returns false if invalid.
+bool parseOption(const string &arg, Options &options)
+{
+    size_t pos = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || pos == string::npos)
+    {
+        return false;
+    }
+
+    string name = arg.substr(2, pos - 2);
+    string value = arg.substr(pos + 1);
+
+    if (name.compare("events") == 0)
+    {
+        return parsePositive(value, options.m_events);
+    }
+
+    if (name.compare("batch") == 0)
+    {
+        return parsePositive(value, options.m_batch);
+    }
+
+    if (name.compare("users") == 0)
+    {
+        return parsePositive(value, options.m_users) && options.m_users > 1;
+    }
+
+    if (name.compare("samples") == 0)
+    {
+        return parsePositive(value, options.m_samples);
+    }
+
+    if (name.compare("min-time") == 0)
+    {
+        char *end = NULL;
+        options.m_minSeconds = strtod(value.c_str(), &end);
+        return !value.empty() && *end == '\0' && options.m_minSeconds >= 0;
+    }
+
+    if (name.compare("filter") == 0)
+    {
+        options.m_filter = value;
+        return true;
+    }
+
+    if (name.compare("output") == 0)
+    {
+        options.m_output = value;
+        return !value.empty();
+    }
+
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Logger::getInstance().setLogLevel(Logger::LvlError);
+
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg(argv[i]);
+        if (!parseOption(arg, options))
+        {
+            cerr << "Invalid option: " << arg << endl << USAGE << endl;
+            return 1;
+        }
+    }
+
+    Workload workload(options.m_events, options.m_batch, options.m_users, 1);
+
+    vector< Result > results;
+    const vector< Benchmark* > &benchmarks = Benchmark::getAll();
+    for (size_t i = 0; i < benchmarks.size(); ++i)
+    {
+        Benchmark &benchmark = *benchmarks[i];
+        if (benchmark.getName().find(options.m_filter) == string::npos)
+        {
+            continue;
+        }
+
+        cerr << benchmark.getName() << "..." << endl;
+        benchmark.setUp(workload);
+        results.push_back(benchmark.measure(options.m_samples, options.m_minSeconds));
+        benchmark.tearDown();
+    }
+
+    if (options.m_output.empty())
+    {
+        writeJson(cout, workload, results);
+        return 0;
+    }
+
+    ofstream out(options.m_output.c_str());
+    writeJson(out, workload, results);
+    if (!out)
+    {
+        cerr << "Could not write " << options.m_output << endl;
+        return 1;
+    }
+
+    return 0;
+}
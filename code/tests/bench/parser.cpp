@@ -0,0 +1,146 @@
+/*
+ * Benchmarks of the Parser: splitting the event source input into messages,
+ * parsing events, and encoding notifications. The items are events.
+ */
+
+#include "bench.h"
+#include "protocol.h"
+
+using namespace std;
+using namespace followermaze;
+using namespace followermaze::bench;
+using namespace followermaze::protocol;
+
+namespace
+{
+
+// Calls findMessage for each message of the stream.
+class FindMessage : public Benchmark
+{
+public:
+    FindMessage() : Benchmark("findMessage") {}
+
+    virtual void setUp(const Workload &workload)
+    {
+        m_stream = &workload.m_stream;
+    }
+
+    virtual size_t run()
+    {
+        size_t start = 0;
+        size_t count = 0;
+        const char *message = NULL;
+        size_t length = 0;
+        while (Parser::findMessage(m_stream->data(), m_stream->size(), start, message, length))
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+    virtual size_t getBytes() const
+    {
+        return m_stream->size();
+    }
+
+private:
+    const string *m_stream;
+};
+
+// Finds all the messages of the stream at once.
+class FindMessages : public Benchmark
+{
+public:
+    FindMessages() : Benchmark("findMessages") {}
+
+    virtual void setUp(const Workload &workload)
+    {
+        m_stream = &workload.m_stream;
+    }
+
+    virtual size_t run()
+    {
+        m_spans.clear();
+        Parser::findMessages(m_stream->data(), m_stream->size(), m_spans);
+        return m_spans.size();
+    }
+
+    virtual size_t getBytes() const
+    {
+        return m_stream->size();
+    }
+
+private:
+    const string *m_stream;
+    SpanList m_spans;
+};
+
+// Parses each message of the stream in place.
+class ParseEvent : public Benchmark
+{
+public:
+    ParseEvent() : Benchmark("parseEvent") {}
+
+    virtual void setUp(const Workload &workload)
+    {
+        m_stream = &workload.m_stream;
+        m_spans.clear();
+        Parser::findMessages(m_stream->data(), m_stream->size(), m_spans);
+    }
+
+    virtual size_t run()
+    {
+        size_t valid = 0;
+        for (SpanList::const_iterator it = m_spans.begin(); it != m_spans.end(); ++it)
+        {
+            Parser::parseEvent(m_event, m_stream->data() + it->m_offset, it->m_length);
+            valid += Parser::isValidEvent(m_event) ? 1 : 0;
+        }
+
+        return valid;
+    }
+
+    virtual size_t getBytes() const
+    {
+        return m_stream->size();
+    }
+
+private:
+    const string *m_stream;
+    SpanList m_spans;
+    Event m_event;
+};
+
+// Encodes the notification of each event (into a reused string).
+class EncodeMessage : public Benchmark
+{
+public:
+    EncodeMessage() : Benchmark("encodeMessage") {}
+
+    virtual void setUp(const Workload &workload)
+    {
+        m_payloads = &workload.m_payloads;
+    }
+
+    virtual size_t run()
+    {
+        for (vector< string >::const_iterator it = m_payloads->begin(); it != m_payloads->end(); ++it)
+        {
+            Parser::encodeMessage(*it, m_message);
+        }
+
+        return m_payloads->size();
+    }
+
+private:
+    const vector< string > *m_payloads;
+    string m_message;
+};
+
+FindMessage findMessage;
+FindMessages findMessages;
+ParseEvent parseEvent;
+EncodeMessage encodeMessage;
+
+} // namespace
@@ -0,0 +1,120 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "testsocket.h"
+#include "acceptor.h"
+#include "client.h"
+#include "reactor.h"
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace followermaze;
+
+class CountingFactory : public ClientFactory<Client>
+{
+public:
+    CountingFactory() : m_count(0)
+    {
+    }
+
+    virtual EventHandler *createEventHandler(auto_ptr<Connection> connection, Reactor &reactor)
+    {
+        m_count++;
+        return ClientFactory<Client>::createEventHandler(connection, reactor);
+    }
+
+    int m_count;
+};
+
+TEST(AcceptorAcceptsUpToLimitPerWakeup)
+{
+    Reactor reactor;
+    CountingFactory factory;
+    AcceptStats stats("users");
+
+    Acceptor *acceptor = new Acceptor(9090, reactor, factory);
+    auto_ptr<EventHandler> handler(acceptor);
+    acceptor->setAcceptLimit(2);
+    acceptor->setStats(&stats);
+    reactor.addHandler(handler, Reactor::EvntAccept);
+
+    int peers[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        peers[i] = connectTo(9090);
+    }
+
+    // The queue is drained in bursts of the limit.
+    reactor.handleEvents();
+    CHECK_EQUAL(2, factory.m_count);
+    reactor.handleEvents();
+    CHECK_EQUAL(4, factory.m_count);
+    reactor.handleEvents();
+    CHECK_EQUAL(5, factory.m_count);
+
+    CHECK_EQUAL(3u, stats.getWakeups());
+    CHECK_EQUAL(5u, stats.getAccepted());
+    CHECK_EQUAL(2u, stats.getLimited());
+    CHECK_EQUAL(0u, stats.getErrors());
+    CHECK_EQUAL(0u, stats.getOverflows());
+
+    ostringstream out;
+    stats.format(out);
+    CHECK_EQUAL("accept users wakeups=3 accepted=5 limited=2 errors=0 overflows=0\n", out.str());
+
+    for (int i = 0; i < 5; ++i)
+    {
+        close(peers[i]);
+    }
+}
+
+TEST(AcceptorBacksOffWhenOutOfDescriptors)
+{
+    Reactor reactor;
+    CountingFactory factory;
+    AcceptStats stats("users");
+
+    Acceptor *acceptor = new Acceptor(9090, reactor, factory);
+    auto_ptr<EventHandler> handler(acceptor);
+    acceptor->setStats(&stats);
+    reactor.addHandler(handler, Reactor::EvntAccept);
+
+    int peer = connectTo(9090);
+
+    // No descriptor left for accepting (the lowest free one is the limit).
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    struct rlimit lowered = limit;
+    int free = dup(0);
+    close(free);
+    lowered.rlim_cur = free;
+    CHECK(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+
+    reactor.handleEvents();
+    CHECK_EQUAL(1u, stats.getErrors());
+
+    // The pending request keeps the socket readable, but the reactor blocks
+    // until the retry delays pass instead of spinning.
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    struct timespec now = started;
+    while ((now.tv_sec - started.tv_sec) * 1000 + (now.tv_nsec - started.tv_nsec) / 1000000 < 100)
+    {
+        reactor.handleEvents();
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+    CHECK(stats.getWakeups() <= 5u);
+    CHECK_EQUAL(0, factory.m_count);
+
+    // Accepted once descriptors are available again.
+    CHECK(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    for (int i = 0; i < 10 && factory.m_count == 0; ++i)
+    {
+        reactor.handleEvents();
+    }
+    CHECK_EQUAL(1, factory.m_count);
+
+    close(peer);
+}
@@ -0,0 +1,79 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "buffer.h"
+#include <string>
+#include <cstring>
+
+using namespace std;
+using namespace followermaze;
+
+TEST(BufferAppendConsume)
+{
+    Buffer buffer;
+    CHECK(buffer.empty());
+
+    buffer.append("message1\r\nmess", 14);
+    CHECK_EQUAL(14u, buffer.size());
+    CHECK(string(buffer.data(), buffer.size()) == "message1\r\nmess");
+
+    buffer.consume(10);
+    CHECK(string(buffer.data(), buffer.size()) == "mess");
+
+    buffer.append("age2\r\n", 6);
+    CHECK(string(buffer.data(), buffer.size()) == "message2\r\n");
+
+    buffer.consume(10);
+    CHECK(buffer.empty());
+}
+
+TEST(BufferPrepareCommit)
+{
+    Buffer buffer(8);
+
+    char *space = buffer.prepare(4);
+    CHECK_EQUAL(8u, buffer.capacity());
+    memcpy(space, "abcd", 4);
+    CHECK(buffer.empty());
+    buffer.commit(3);
+    CHECK(string(buffer.data(), buffer.size()) == "abc");
+
+    // Grows when there is no space.
+    space = buffer.prepare(16);
+    CHECK(buffer.capacity() >= 19u);
+    memcpy(space, "0123456789abcdef", 16);
+    buffer.commit(16);
+    CHECK(string(buffer.data(), buffer.size()) == "abc0123456789abcdef");
+}
+
+TEST(BufferReclaimsConsumedSpace)
+{
+    Buffer buffer(16);
+    buffer.append("0123456789ab", 12);
+    buffer.consume(10);
+
+    // The unconsumed data is moved to the front instead of growing.
+    buffer.prepare(12);
+    CHECK_EQUAL(16u, buffer.capacity());
+    CHECK(string(buffer.data(), buffer.size()) == "ab");
+
+    // Consuming everything makes all the space free.
+    buffer.consume(2);
+    buffer.prepare(16);
+    CHECK_EQUAL(16u, buffer.capacity());
+}
+
+TEST(BufferRelease)
+{
+    Buffer buffer;
+    buffer.append("0123456789", 10);
+    CHECK_EQUAL(buffer.capacity() - 10, buffer.available());
+
+    // Clearing keeps the storage, releasing frees it.
+    buffer.clear();
+    CHECK(buffer.capacity() >= 10u);
+    buffer.release();
+    CHECK(buffer.empty());
+    CHECK_EQUAL(0u, buffer.capacity());
+
+    buffer.append("ab", 2);
+    CHECK(string(buffer.data(), buffer.size()) == "ab");
+}
@@ -0,0 +1,380 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "testsocket.h"
+#include "client.h"
+#include "reactor.h"
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+using namespace followermaze;
+
+// Queues count messages of length bytes when asked for by the peer.
+class FloodingClient : public Client
+{
+public:
+    FloodingClient(auto_ptr<Connection> connection, Reactor &reactor, int count, size_t length) :
+        Client(connection, reactor),
+        m_count(count),
+        m_length(length),
+        m_transitions(0)
+    {
+    }
+
+    virtual void doHandleInput(int hint)
+    {
+        receive(m_in);
+        m_in.clear();
+
+        for (int i = 0; i < m_count; ++i)
+        {
+            string data(m_length, static_cast<char>('a' + i % 26));
+            Message *message = new Message(data);
+            queueOutput(hint, message);
+            message->release();
+        }
+    }
+
+    virtual void handleBackpressure(int /*hint*/)
+    {
+        m_transitions++;
+    }
+
+    Buffer m_in;
+    int m_count;
+    size_t m_length;
+    int m_transitions;
+};
+
+static void testPartiallyWrittenOutput(Reactor::Backend backend)
+{
+    Reactor reactor(backend);
+    Connection server(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> connection(server.accept(true));
+
+    // Small send buffer forces short writes.
+    int size = 4096;
+    setsockopt(connection->getHandle(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    static const int COUNT = 200;
+    static const size_t LENGTH = 1000;
+    FloodingClient *client = new FloodingClient(connection, reactor, COUNT, LENGTH);
+    client->setWatermarks(16 * 1024, 64 * 1024);
+    reactor.addHandler(auto_ptr<EventHandler>(client), Reactor::EvntRead);
+
+    CHECK(send(peer, "go", 2, 0) == 2);
+    reactor.handleEvents();
+    CHECK(client->isBackpressured());
+    CHECK_EQUAL(1, client->m_transitions);
+
+    string received;
+    char data[4096];
+    while (received.size() < COUNT * LENGTH)
+    {
+        reactor.handleEvents();
+
+        ssize_t length;
+        while ((length = recv(peer, data, sizeof(data), MSG_DONTWAIT)) > 0)
+        {
+            received.append(data, length);
+        }
+    }
+
+    CHECK_EQUAL(COUNT * LENGTH, received.size());
+    for (int i = 0; i < COUNT; ++i)
+    {
+        CHECK(received.compare(i * LENGTH, LENGTH, string(LENGTH, static_cast<char>('a' + i % 26))) == 0);
+    }
+
+    CHECK_EQUAL(0u, client->getPendingOutput());
+    CHECK(!client->isBackpressured());
+    CHECK_EQUAL(2, client->m_transitions);
+
+    close(peer);
+}
+
+TEST(ClientSendsPartiallyWrittenOutput)
+{
+    testPartiallyWrittenOutput(Reactor::BackendDefault);
+}
+
+// The io_uring backend does the sends (see Reactor::send).
+TEST(ClientSendsPartiallyWrittenOutputAsync)
+{
+    testPartiallyWrittenOutput(Reactor::BackendUring);
+}
+
+TEST(ClientKeepsEventWhileWriting)
+{
+    Reactor reactor(Reactor::BackendEpoll);
+    Connection server(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> connection(server.accept(true));
+
+    FloodingClient *client = new FloodingClient(connection, reactor, 1, 10);
+    int hint = reactor.addHandler(auto_ptr<EventHandler>(client), Reactor::EvntRead | Reactor::EvntEdge);
+
+    // Queueing output adds writing to the event, draining it takes writing
+    // away only.
+    CHECK(send(peer, "go", 2, 0) == 2);
+    reactor.handleEvents();
+    Reactor::EventType event = reactor.getEvent(hint);
+    CHECK_EQUAL(Reactor::EvntRead | Reactor::EvntEdge | Reactor::EvntWrite, event);
+
+    reactor.handleEvents();
+    CHECK_EQUAL(0u, client->getPendingOutput());
+    event = reactor.getEvent(hint);
+    CHECK_EQUAL(Reactor::EvntRead | Reactor::EvntEdge, event);
+
+    char data[16];
+    CHECK_EQUAL(10, recv(peer, data, sizeof(data), 0));
+    close(peer);
+}
+
+TEST(ClientHoldsZeroCopyOutputUntilCompleted)
+{
+    Reactor reactor;
+    Connection server(9090);
+    SocketProfile profile;
+    profile.m_zeroCopy = 8 * 1024;
+    server.setProfile(profile);
+
+    int peer = connectTo(9090);
+    auto_ptr<Connection> connection(server.accept(true));
+    Connection *raw = connection.get();
+
+    static const int COUNT = 20;
+    static const size_t LENGTH = 1000;
+    FloodingClient *client = new FloodingClient(connection, reactor, COUNT, LENGTH);
+    reactor.addHandler(auto_ptr<EventHandler>(client), Reactor::EvntRead);
+
+    CHECK(send(peer, "go", 2, 0) == 2);
+    while (client->getPendingOutput() == 0)
+    {
+        reactor.handleEvents();
+    }
+    reactor.handleEvents();
+    CHECK_EQUAL(0u, client->getPendingOutput());
+
+    // The batch is large enough to go without copying.
+    if (raw->getZeroCopySends() == 0)
+    {
+        // Not supported by the OS.
+        close(peer);
+        return;
+    }
+
+    string received;
+    char data[4096];
+    while (received.size() < COUNT * LENGTH)
+    {
+        ssize_t length = recv(peer, data, sizeof(data), 0);
+        CHECK(length > 0);
+        received.append(data, length);
+    }
+    CHECK(received.compare(0, LENGTH, string(LENGTH, 'a')) == 0);
+
+    // The completion is reported as an error which the client survives.
+    reactor.handleEvents();
+    CHECK_EQUAL(raw->getZeroCopySends(), raw->reapZeroCopy());
+    EventHandler *handler = reactor.detouchHandler(0);
+    CHECK(handler == client);
+    delete handler;
+
+    close(peer);
+}
+
+// A Message which tells when it's disposed of.
+class TrackedMessage : public Message
+{
+public:
+    TrackedMessage(bool &disposed) :
+        Message("data", 4),
+        m_disposed(disposed)
+    {
+    }
+
+protected:
+    virtual ~TrackedMessage()
+    {
+        m_disposed = true;
+    }
+
+    bool &m_disposed;
+};
+
+// Hands a connection with a zero-copy send (which never completes) to a
+// ZeroCopyLinger registered with the reactor. Returns the hint of the linger.
+static int linger(Reactor &reactor, auto_ptr<Connection> connection, Message *message)
+{
+    Client::HeldMessages held;
+    held.push_back(make_pair(connection->getZeroCopySends(), message));
+    connection->shutdownOutput();
+    int hint = reactor.addHandler(auto_ptr<EventHandler>(new ZeroCopyLinger(connection, reactor, held)), 0);
+    CHECK(held.empty());
+    return hint;
+}
+
+TEST(ZeroCopyLingerKeepsMessagesUntilHangup)
+{
+    Reactor reactor;
+    Connection server(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> connection(server.accept(true));
+
+    bool disposed = false;
+    int hint = linger(reactor, connection, new TrackedMessage(disposed));
+    reactor.scheduleTimeout(hint, 5000);
+
+    // The output has been shut down. The send is held until the peer is
+    // gone too.
+    char data[16];
+    CHECK_EQUAL(0, recv(peer, data, sizeof(data), 0));
+    CHECK(!disposed);
+
+    close(peer);
+    for (int i = 0; i < 100 && !disposed; ++i)
+    {
+        reactor.handleEvents();
+    }
+    CHECK(disposed);
+}
+
+TEST(ZeroCopyLingerResetsOnTimeout)
+{
+    Reactor reactor;
+    Connection server(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> connection(server.accept(true));
+
+    bool disposed = false;
+    int hint = linger(reactor, connection, new TrackedMessage(disposed));
+    reactor.scheduleTimeout(hint, 10);
+
+    for (int i = 0; i < 100 && !disposed; ++i)
+    {
+        reactor.handleEvents();
+    }
+    CHECK(disposed);
+    close(peer);
+}
+
+// Connects a FloodingClient which queues COUNT messages of LENGTH bytes.
+struct FloodingFixture
+{
+    static const int COUNT = 200;
+    static const size_t LENGTH = 1000;
+
+    FloodingFixture(OutputBudget::Policy policy) :
+        m_budget(10 * LENGTH, 1024 * 1024, policy),
+        m_server(9090),
+        m_peer(connectTo(9090))
+    {
+        auto_ptr<Connection> connection(m_server.accept(true));
+        m_client = new FloodingClient(connection, m_reactor, COUNT, LENGTH);
+        m_client->setWatermarks(2 * LENGTH, 5 * LENGTH);
+        m_client->setOutputBudget(&m_budget);
+        m_reactor.addHandler(auto_ptr<EventHandler>(m_client), Reactor::EvntRead);
+
+        send(m_peer, "go", 2, 0);
+        m_reactor.handleEvents();
+    }
+
+    ~FloodingFixture()
+    {
+        close(m_peer);
+    }
+
+    // Receives everything until the client's queue is drained.
+    string drain()
+    {
+        string received;
+        char data[4096];
+        while (m_client->getPendingOutput() > 0)
+        {
+            m_reactor.handleEvents();
+
+            ssize_t length;
+            while ((length = recv(m_peer, data, sizeof(data), MSG_DONTWAIT)) > 0)
+            {
+                received.append(data, length);
+            }
+        }
+
+        return received;
+    }
+
+    Reactor m_reactor;
+    OutputBudget m_budget;
+    Connection m_server;
+    int m_peer;
+    FloodingClient *m_client;
+};
+
+TEST(OutputBudgetAccounting)
+{
+    OutputBudget budget(100, 150);
+    CHECK(budget.fits(0, 100));
+    CHECK(!budget.fits(1, 100));
+
+    budget.acquire(100);
+    CHECK(budget.fits(0, 50));
+    CHECK(!budget.fits(0, 51));
+
+    budget.release(100);
+    CHECK_EQUAL(0u, budget.getPending());
+}
+
+TEST(SlowConsumerDropOldest)
+{
+    FloodingFixture fixture(OutputBudget::PolicyDropOldest);
+
+    // Only the newest messages fit.
+    CHECK_EQUAL(10 * FloodingFixture::LENGTH, fixture.m_client->getPendingOutput());
+    CHECK_EQUAL(10 * FloodingFixture::LENGTH, fixture.m_budget.getPending());
+    CHECK_EQUAL(190ul, fixture.m_budget.getDropped());
+    CHECK_EQUAL(190ul, fixture.m_budget.getOverflows());
+    CHECK_EQUAL(1ul, fixture.m_budget.getStalled());
+
+    string received = fixture.drain();
+    CHECK_EQUAL(10 * FloodingFixture::LENGTH, received.size());
+    CHECK_EQUAL(static_cast<char>('a' + 190 % 26), received[0]);
+    CHECK_EQUAL(static_cast<char>('a' + 199 % 26), received[received.size() - 1]);
+    CHECK_EQUAL(0u, fixture.m_budget.getPending());
+    CHECK_EQUAL(0ul, fixture.m_budget.getStalled());
+}
+
+TEST(SlowConsumerPause)
+{
+    FloodingFixture fixture(OutputBudget::PolicyPause);
+
+    // The messages after the first overflow are dropped.
+    CHECK_EQUAL(10 * FloodingFixture::LENGTH, fixture.m_client->getPendingOutput());
+    CHECK_EQUAL(190ul, fixture.m_budget.getDropped());
+    CHECK_EQUAL(1ul, fixture.m_budget.getOverflows());
+    CHECK(fixture.m_client->isBackpressured());
+
+    string received = fixture.drain();
+    CHECK_EQUAL(10 * FloodingFixture::LENGTH, received.size());
+    CHECK_EQUAL('a', received[0]);
+    CHECK(!fixture.m_client->isBackpressured());
+    CHECK_EQUAL(0ul, fixture.m_budget.getStalled());
+}
+
+TEST(SlowConsumerDisconnect)
+{
+    FloodingFixture fixture(OutputBudget::PolicyDisconnect);
+    CHECK_EQUAL(1ul, fixture.m_budget.getDisconnected());
+    CHECK_EQUAL(0u, fixture.m_budget.getPending());
+
+    // Closed when called back for writing.
+    fixture.m_reactor.handleEvents();
+    char data[4096];
+    ssize_t length;
+    while ((length = recv(fixture.m_peer, data, sizeof(data), 0)) > 0)
+    {
+    }
+    CHECK_EQUAL(0, length);
+    CHECK_EQUAL(0ul, fixture.m_budget.getStalled());
+}
@@ -1,6 +1,15 @@
 #include "test.h" // Brings in the UnitTest++ framework
+#include "testsocket.h"
 #include "connection.h"
+#include <memory>
+#include <cstring>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 
+using namespace std;
 using namespace followermaze;
 
 TEST(ConstructConnection)
@@ -48,6 +57,46 @@ TEST(AcceptAsyncFails)
     CHECK_THROW(conn.accept(), Connection::Exception);
 }
 
+TEST(AcceptPendingAsyncReturnsNull)
+{
+    Connection conn(9090, true);
+    CHECK(conn.acceptPending() == NULL);
+}
+
+TEST(CountsDroppedConnectionRequests)
+{
+    Connection conn(9090, true, 1);
+    long dropCount = conn.getDropCount();
+    if (dropCount < 0)
+    {
+        // Not supported by the OS.
+        return;
+    }
+
+    // The queue holds two requests at most. The rest are dropped.
+    int peers[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        peers[i] = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(9090);
+        connect(peers[i], (struct sockaddr *) &addr, sizeof(addr));
+    }
+
+    CHECK(conn.getDropCount() > dropCount);
+
+    auto_ptr<Connection> client(conn.acceptPending(true));
+    CHECK(client.get() != NULL);
+
+    for (int i = 0; i < 5; ++i)
+    {
+        close(peers[i]);
+    }
+}
+
 TEST(ReceiveUnacceptedAsyncFails)
 {
     Connection conn(9090, true);
@@ -68,3 +117,197 @@ TEST(InvalidMethodInvocationFails)
     CHECK_THROW(conn.receive(), Connection::Exception);
     CHECK_THROW(conn.send("bla"), Connection::Exception);
 }
+
+TEST(ReceiveDrainsUpToBudget)
+{
+    Connection conn(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> client(conn.accept(true));
+
+    string data(3 * Connection::READ_CHUNK, 'x');
+    CHECK(::send(peer, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+
+    // Stops at the budget.
+    Buffer buffer;
+    buffer.append("bla", 3);
+    CHECK_EQUAL(Connection::READ_CHUNK + 1, client->receive(buffer, Connection::READ_CHUNK + 1));
+    CHECK_EQUAL(Connection::READ_CHUNK + 4, buffer.size());
+
+    // Drains the rest. Nothing left.
+    CHECK_EQUAL(2 * Connection::READ_CHUNK - 1, client->receive(buffer, 4 * Connection::READ_CHUNK));
+    CHECK_EQUAL(0u, client->receive(buffer, Connection::READ_CHUNK));
+    CHECK_EQUAL(3 * Connection::READ_CHUNK + 3, buffer.size());
+    CHECK(string(buffer.data() + 3, buffer.size() - 3) == data);
+    CHECK(!client->isPeerClosed());
+
+    // Data sent before closing is received first.
+    CHECK(::send(peer, "bla", 3, 0) == 3);
+    close(peer);
+    CHECK_EQUAL(3u, client->receive(buffer, Connection::READ_CHUNK));
+    CHECK(client->isPeerClosed());
+    CHECK_THROW(client->receive(buffer, Connection::READ_CHUNK), Connection::Exception);
+}
+
+TEST(ReceiveSmallInputIntoSmallBuffer)
+{
+    Connection conn(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> client(conn.accept(true));
+
+    // A user ID takes a small first read. Draining the socket reads into
+    // the free space left and doesn't grow the buffer.
+    CHECK(::send(peer, "12345\r\n", 7, 0) == 7);
+    Buffer buffer;
+    CHECK_EQUAL(7u, client->receive(buffer, 4 * Connection::READ_CHUNK));
+    CHECK_EQUAL(0u, client->receive(buffer, 4 * Connection::READ_CHUNK));
+    CHECK_EQUAL(Connection::FIRST_READ_CHUNK, buffer.capacity());
+
+    // A full buffer grows by its capacity at a time.
+    string data(Connection::FIRST_READ_CHUNK, 'x');
+    CHECK(::send(peer, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+    CHECK_EQUAL(data.size(), client->receive(buffer, 4 * Connection::READ_CHUNK));
+    CHECK_EQUAL(2 * Connection::FIRST_READ_CHUNK, buffer.capacity());
+    close(peer);
+}
+
+TEST(SendGathersBuffers)
+{
+    Connection conn(9090);
+    int peer = connectTo(9090);
+    auto_ptr<Connection> client(conn.accept(true));
+
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>("1|B\n");
+    iov[0].iov_len = 4;
+    iov[1].iov_base = const_cast<char*>("2|S|1\n");
+    iov[1].iov_len = 6;
+    CHECK_EQUAL(10u, client->send(iov, 2));
+
+    char data[16];
+    CHECK_EQUAL(10, recv(peer, data, 10, MSG_WAITALL));
+    CHECK(string(data, 10) == "1|B\n2|S|1\n");
+
+    close(peer);
+}
+
+TEST(ParseSocketProfile)
+{
+    SocketProfile profile;
+    CHECK(SocketProfile::parse("nodelay,cork,sndbuf=65536,rcvbuf=1024,busy-poll=50,zerocopy=16384", profile));
+    CHECK(profile.m_noDelay);
+    CHECK(profile.m_cork);
+    CHECK_EQUAL(65536, profile.m_sendBuffer);
+    CHECK_EQUAL(1024, profile.m_receiveBuffer);
+    CHECK_EQUAL(50, profile.m_busyPoll);
+    CHECK_EQUAL(16384, profile.m_zeroCopy);
+
+    CHECK(SocketProfile::parse("default", profile));
+    CHECK(!profile.m_noDelay);
+    CHECK(!profile.m_cork);
+    CHECK_EQUAL(0, profile.m_sendBuffer);
+
+    CHECK(!SocketProfile::parse("", profile));
+    CHECK(!SocketProfile::parse("nodelay,", profile));
+    CHECK(!SocketProfile::parse("sndbuf=0", profile));
+    CHECK(!SocketProfile::parse("sndbuf=1k", profile));
+    CHECK(!SocketProfile::parse("bla", profile));
+}
+
+TEST(AcceptedConnectionInheritsProfile)
+{
+    Connection conn(9090);
+    SocketProfile profile;
+    profile.m_noDelay = true;
+    conn.setProfile(profile);
+
+    int peer = connectTo(9090);
+    auto_ptr<Connection> client(conn.accept(true));
+
+    int noDelay = 0;
+    socklen_t length = sizeof(noDelay);
+    CHECK(getsockopt(client->getHandle(), IPPROTO_TCP, TCP_NODELAY, &noDelay, &length) == 0);
+    CHECK(noDelay != 0);
+
+    close(peer);
+}
+
+TEST(ParseSocketAddress)
+{
+    SocketAddress address;
+    CHECK(SocketAddress::parse("9090", address));
+    CHECK_EQUAL(SocketAddress::FamilyTcp4, address.m_family);
+    CHECK_EQUAL(9090, address.m_port);
+    CHECK(address.m_host.empty());
+
+    CHECK(SocketAddress::parse("tcp4:127.0.0.1:9091", address));
+    CHECK_EQUAL("127.0.0.1", address.m_host);
+    CHECK_EQUAL(9091, address.m_port);
+    CHECK_EQUAL("tcp4:127.0.0.1:9091", address.toString());
+
+    CHECK(SocketAddress::parse("tcp6:[::1]:9092", address));
+    CHECK_EQUAL(SocketAddress::FamilyTcp6, address.m_family);
+    CHECK_EQUAL("::1", address.m_host);
+    CHECK_EQUAL(9092, address.m_port);
+    CHECK_EQUAL("tcp6:[::1]:9092", address.toString());
+
+    CHECK(SocketAddress::parse("unix:/tmp/followermaze.sock", address));
+    CHECK_EQUAL(SocketAddress::FamilyUnix, address.m_family);
+    CHECK_EQUAL("/tmp/followermaze.sock", address.m_path);
+
+    CHECK(!SocketAddress::parse("", address));
+    CHECK(!SocketAddress::parse("tcp4:70000", address));
+    CHECK(!SocketAddress::parse("tcp4:localhost:9090", address));
+    CHECK(!SocketAddress::parse("tcp6:::1:9090", address));
+    CHECK(!SocketAddress::parse("unix:", address));
+    CHECK(!SocketAddress::parse("udp:9090", address));
+    CHECK_EQUAL("/tmp/followermaze.sock", address.m_path);
+}
+
+TEST(UnixConnection)
+{
+    SocketAddress address;
+    CHECK(SocketAddress::parse("unix:/tmp/followermaze-test.sock", address));
+
+    {
+        Connection conn(address, true);
+
+        int peer = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, "/tmp/followermaze-test.sock");
+        CHECK(connect(peer, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+
+        auto_ptr<Connection> client(conn.acceptPending(true));
+        CHECK(client.get() != NULL);
+
+        // Nagle's algorithm is skipped.
+        SocketProfile profile;
+        profile.m_noDelay = true;
+        conn.setProfile(profile);
+
+        CHECK(::send(peer, "bla", 3, 0) == 3);
+        Buffer buffer;
+        CHECK_EQUAL(3u, client->receive(buffer, Connection::READ_CHUNK));
+        close(peer);
+
+        // The socket can't be taken over while listened on.
+        CHECK_THROW(Connection conn1(address), Connection::Exception);
+    }
+
+    // Removed at destruction.
+    CHECK(access("/tmp/followermaze-test.sock", F_OK) != 0);
+}
+
+TEST(Tcp6Connection)
+{
+    SocketAddress address;
+    CHECK(SocketAddress::parse("tcp6:9090", address));
+    Connection conn(address, true);
+
+    // Dual-stack: takes IPv4 clients, too.
+    int peer = connectTo(9090);
+    auto_ptr<Connection> client(conn.acceptPending(true));
+    CHECK(client.get() != NULL);
+    close(peer);
+}
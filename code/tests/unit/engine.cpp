@@ -18,10 +18,13 @@ public:
     {
     }
 
-    virtual void send(const string &message)
+    virtual void send(Message *message)
     {
-        m_msg.push_back(message);
+        m_msg.push_back(string(message->data(), message->size()));
+        m_sent.push_back(message);
     }
+
+    vector< Message* > m_sent; // Not referenced.
 };
 
 class TestEngine : public Engine
@@ -42,6 +45,11 @@ public:
     {
         return m_events.size();
     }
+
+    int eventsFree()
+    {
+        return m_freeEvents.size();
+    }
 };
 
 TEST(RegisterUser)
@@ -98,6 +106,135 @@ TEST(EventsHandledInOrder)
     engine.unregisterUser(id2, &client);
 }
 
+TEST(EventsHandledInPlace)
+{
+    Reactor reactor;
+    TestEngine engine;
+    TestClient client(auto_ptr<Connection>(new Connection()), reactor, engine);
+
+    long id = engine.registerUser(&client, "1\n");
+
+    Buffer events;
+    events.append("2|B\r\n1|B\r\n3|", 12);
+    engine.handleEvents(events);
+    CHECK_EQUAL("3|", string(events.data(), events.size()));
+    events.append("B\r", 2);
+    engine.handleEvents(events);
+    CHECK(events.empty());
+
+    CHECK_EQUAL(3, client.m_msg.size());
+    CHECK_EQUAL("1|B\n", client.m_msg[0]);
+    CHECK_EQUAL("2|B\n", client.m_msg[1]);
+    CHECK_EQUAL("3|B\n", client.m_msg[2]);
+
+    engine.unregisterUser(id, &client);
+}
+
+TEST(EventsHandledByteByByte)
+{
+    Reactor reactor;
+    TestEngine engine;
+    TestClient client(auto_ptr<Connection>(new Connection()), reactor, engine);
+
+    long id = engine.registerUser(&client, "1\n");
+
+    // Every CRLF is split between two calls.
+    const string stream = "2|B\r\n1|B\r\n3|S|2\r\n4|B\r\n";
+    Buffer events;
+    Framer framer(Parser::CR, Parser::LF);
+    for (size_t i = 0; i < stream.size(); ++i)
+    {
+        events.append(stream.data() + i, 1);
+        engine.handleEvents(events, framer);
+    }
+    CHECK(events.empty());
+
+    CHECK_EQUAL(3, client.m_msg.size());
+    CHECK_EQUAL("1|B\n", client.m_msg[0]);
+    CHECK_EQUAL("2|B\n", client.m_msg[1]);
+    CHECK_EQUAL("4|B\n", client.m_msg[2]);
+
+    engine.unregisterUser(id, &client);
+}
+
+TEST(EventsHandledFromTwoStreams)
+{
+    Reactor reactor;
+    TestEngine engine;
+    TestClient client(auto_ptr<Connection>(new Connection()), reactor, engine);
+
+    long id = engine.registerUser(&client, "1\n");
+
+    // Each stream is framed on its own: a long incomplete message of one
+    // doesn't hide the start of the other.
+    Buffer first;
+    Framer firstFramer(Parser::CR, Parser::LF);
+    first.append("1|B\r\n3|P|1|1", 12);
+    engine.handleEvents(first, firstFramer);
+
+    Buffer second;
+    Framer secondFramer(Parser::CR, Parser::LF);
+    second.append("2|B\r\n4|B\r\n", 10);
+    engine.handleEvents(second, secondFramer);
+    CHECK(second.empty());
+
+    first.append("\r\n", 2);
+    engine.handleEvents(first, firstFramer);
+    CHECK(first.empty());
+
+    CHECK_EQUAL(4, client.m_msg.size());
+    CHECK_EQUAL("1|B\n", client.m_msg[0]);
+    CHECK_EQUAL("2|B\n", client.m_msg[1]);
+    CHECK_EQUAL("3|P|1|1\n", client.m_msg[2]);
+    CHECK_EQUAL("4|B\n", client.m_msg[3]);
+
+    engine.unregisterUser(id, &client);
+}
+
+TEST(EventsHandledFromRecords)
+{
+    Reactor reactor;
+    TestEngine engine;
+    TestClient client(auto_ptr<Connection>(new Connection()), reactor, engine);
+
+    long id = engine.registerUser(&client, "1\n");
+
+    // The last event is not as long as its original payload.
+    const char *payloads[] = { "2|B", "1|P|2|1", "3|B" };
+    size_t lengths[] = { 3, 7, 4 };
+    string records;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        Event event;
+        event.m_payload = payloads[i];
+        Parser::parseEvent(event);
+        event.m_payload.resize(lengths[i], ' ');
+        Parser::encodeRecord(event, records);
+    }
+    const size_t recordSize = Parser::RECORD_PREFIX_LENGTH + Parser::RECORD_LENGTH;
+
+    Buffer events;
+    events.append(records.data(), 2 * recordSize - 5);
+    bool valid = engine.handleRecords(events);
+    CHECK(valid);
+    CHECK_EQUAL(recordSize - 5, events.size());
+    CHECK(client.m_msg.empty());
+
+    // The events before the wrong one are processed, and it's left (with
+    // the rest of the data) as a protocol error.
+    events.append(records.data() + 2 * recordSize - 5, recordSize + 5);
+    valid = engine.handleRecords(events);
+    CHECK(!valid);
+    CHECK_EQUAL(recordSize, events.size());
+
+    CHECK_EQUAL(2, client.m_msg.size());
+    CHECK_EQUAL("1|P|2|1\n", client.m_msg[0]);
+    CHECK_EQUAL("2|B\n", client.m_msg[1]);
+    CHECK_EQUAL(0, engine.eventsQueueing());
+
+    engine.unregisterUser(id, &client);
+}
+
 TEST(Follow)
 {
     Reactor reactor;
@@ -229,3 +366,56 @@ TEST(Broadcast)
     CHECK_EQUAL("1|B\n", client.m_msg[1]);
     CHECK_EQUAL("1|B\n", client.m_msg[2]);
 }
+
+TEST(BroadcastSharesNotification)
+{
+    Reactor reactor;
+    TestEngine engine;
+    TestClient client(auto_ptr<Connection>(new Connection()), reactor, engine);
+
+    engine.registerUser(&client, "1\n");
+    engine.registerUser(&client, "2\n");
+    engine.registerUser(&client, "3\n");
+
+    // Encoded once per event.
+    string events = "1|B\n2|B\n";
+    engine.handleEvents(events);
+    CHECK_EQUAL(6, client.m_sent.size());
+    CHECK(client.m_sent[0] == client.m_sent[1]);
+    CHECK(client.m_sent[0] == client.m_sent[2]);
+    CHECK(client.m_sent[3] == client.m_sent[4]);
+    CHECK(client.m_sent[3] == client.m_sent[5]);
+    CHECK_EQUAL("2|B\n", client.m_msg[5]);
+}
+
+TEST(EventsAndNotificationsReused)
+{
+    Reactor reactor;
+    TestEngine engine;
+    TestClient client(auto_ptr<Connection>(new Connection()), reactor, engine);
+
+    engine.registerUser(&client, "1\n");
+
+    string events = "1|B\n";
+    engine.handleEvents(events);
+    CHECK_EQUAL(1, engine.eventsFree());
+
+    // The processed Event and the released notification are taken again.
+    unsigned long reuses = Message::getReuses();
+    events = "3|B\n2|B\n";
+    engine.handleEvents(events);
+    CHECK_EQUAL(2, engine.eventsFree());
+    CHECK_EQUAL(3, client.m_sent.size());
+    CHECK(client.m_sent[0] == client.m_sent[1]);
+    CHECK(client.m_sent[1] == client.m_sent[2]);
+    CHECK_EQUAL(reuses + 2, Message::getReuses());
+    CHECK_EQUAL("3|B\n", client.m_msg[2]);
+
+    // Reset keeps the queued Events, too.
+    events = "5|B\n";
+    engine.handleEvents(events);
+    CHECK_EQUAL(1, engine.eventsQueueing());
+    engine.resetEventQueue();
+    CHECK_EQUAL(0, engine.eventsQueueing());
+    CHECK_EQUAL(2, engine.eventsFree());
+}
@@ -0,0 +1,197 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "message.h"
+#include <string>
+#include <cstring>
+
+using namespace std;
+using namespace followermaze;
+
+class CountedMessage : public Message
+{
+public:
+    CountedMessage(const char *data, int *disposed) :
+        Message(data, strlen(data)),
+        m_disposed(disposed)
+    {
+    }
+
+protected:
+    virtual ~CountedMessage()
+    {
+        (*m_disposed)++;
+    }
+
+    int *m_disposed;
+};
+
+static string gathered(const MessageQueue &queue)
+{
+    struct iovec iov[16];
+    int count = queue.gather(iov, 16);
+
+    string data;
+    for (int i = 0; i < count; ++i)
+    {
+        data.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    }
+
+    return data;
+}
+
+TEST(MessageTakesOverString)
+{
+    string data("1|B\n");
+    Message *message = new Message(data);
+    CHECK(data.empty());
+    CHECK_EQUAL("1|B\n", string(message->data(), message->size()));
+    message->release();
+}
+
+TEST(MessageCreateReusesReleasedMessage)
+{
+    string data("1|B\n");
+    data.reserve(64);
+    Message *message = Message::create(data);
+    CHECK(data.empty());
+    message->release();
+
+    // The storage of the released Message is handed back.
+    unsigned long reuses = Message::getReuses();
+    string next("2|B\n");
+    next.reserve(32);
+    const char *storage = next.data();
+    Message *reused = Message::create(next);
+    CHECK(reused == message);
+    CHECK_EQUAL(reuses + 1, Message::getReuses());
+    CHECK_EQUAL("2|B\n", string(reused->data(), reused->size()));
+    CHECK(next.empty());
+    CHECK(next.capacity() >= 64);
+    CHECK(reused->data() == storage);
+    reused->release();
+}
+
+TEST(MessageQueueSharesMessages)
+{
+    int disposed = 0;
+    Message *message = new CountedMessage("1|B\n", &disposed);
+
+    {
+        MessageQueue queue1;
+        MessageQueue queue2;
+        queue1.push(message);
+        queue2.push(message);
+        message->release();
+        CHECK_EQUAL(0, disposed);
+        CHECK_EQUAL(4u, queue1.size());
+
+        queue1.consume(4);
+        CHECK(queue1.empty());
+        CHECK_EQUAL(0, disposed);
+    }
+
+    // The last reference has been dropped by queue2.
+    CHECK_EQUAL(1, disposed);
+}
+
+TEST(MessageQueueConsumesPartially)
+{
+    int disposed = 0;
+    MessageQueue queue;
+    const char *data[] = { "1|B\n", "2|S|1\n", "3|P|1|2\n" };
+    for (int i = 0; i < 3; ++i)
+    {
+        Message *message = new CountedMessage(data[i], &disposed);
+        queue.push(message);
+        message->release();
+    }
+
+    CHECK_EQUAL(18u, queue.size());
+    CHECK_EQUAL("1|B\n2|S|1\n3|P|1|2\n", gathered(queue));
+
+    struct iovec iov[1];
+    CHECK_EQUAL(1, queue.gather(iov, 1));
+    CHECK_EQUAL(4u, iov[0].iov_len);
+
+    // Released as soon as all the bytes are consumed.
+    queue.consume(6);
+    CHECK_EQUAL(1, disposed);
+    CHECK_EQUAL("S|1\n3|P|1|2\n", gathered(queue));
+
+    queue.consume(4);
+    CHECK_EQUAL(2, disposed);
+    CHECK_EQUAL("3|P|1|2\n", gathered(queue));
+
+    queue.clear();
+    CHECK_EQUAL(3, disposed);
+    CHECK(queue.empty());
+}
+
+TEST(MessageQueueRetainsSentMessages)
+{
+    int disposed = 0;
+    MessageQueue queue;
+    const char *data[] = { "1|B\n", "2|S|1\n", "3|P|1|2\n" };
+    for (int i = 0; i < 3; ++i)
+    {
+        Message *message = new CountedMessage(data[i], &disposed);
+        queue.push(message);
+        message->release();
+    }
+
+    // The partially sent Message is held, too.
+    queue.consume(2);
+    vector< Message* > held;
+    queue.retain(5, held);
+    CHECK_EQUAL(2u, held.size());
+    queue.consume(5);
+    CHECK_EQUAL(0, disposed);
+
+    queue.clear();
+    CHECK_EQUAL(1, disposed);
+    for (size_t i = 0; i < held.size(); ++i)
+    {
+        held[i]->release();
+    }
+    CHECK_EQUAL(3, disposed);
+}
+
+TEST(MessageQueueWrapsAround)
+{
+    int disposed = 0;
+    MessageQueue queue;
+    char data[4] = "0\n";
+
+    // Keep the ring wrapping around while it grows.
+    size_t pushed = 0;
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int i = 0; i < 7; ++i)
+        {
+            data[0] = '0' + pushed++ % 10;
+            Message *message = new CountedMessage(data, &disposed);
+            queue.push(message);
+            message->release();
+        }
+        queue.consume(8);
+    }
+    CHECK_EQUAL(2 * 30u, queue.size());
+    CHECK_EQUAL(40, disposed);
+
+    // The partially sent Message stays in front.
+    queue.consume(1);
+    size_t count = 0;
+    CHECK_EQUAL(6u, queue.dropOldest(5, count));
+    CHECK_EQUAL(3u, count);
+    CHECK_EQUAL(43, disposed);
+    string expected("\n");
+    for (size_t i = 44; i < pushed; ++i)
+    {
+        expected += '0' + i % 10;
+        expected += '\n';
+    }
+    CHECK_EQUAL(expected.size(), queue.size());
+    CHECK_EQUAL(expected.substr(0, 1 + 15 * 2), gathered(queue)); // 16 Messages at most.
+
+    queue.clear();
+    CHECK_EQUAL(70, disposed);
+}
@@ -0,0 +1,73 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "pool.h"
+#include "connection.h"
+#include <sstream>
+
+using namespace std;
+using namespace followermaze;
+
+TEST(PoolReusesBlocks)
+{
+    Pool pool("test", 24, 2);
+    void *first = pool.allocate(24);
+    void *second = pool.allocate(16);
+    CHECK(first != second);
+    CHECK_EQUAL(2ul, pool.getAllocations());
+    CHECK_EQUAL(2ul, pool.getInUse());
+    CHECK_EQUAL(1ul, pool.getHeapAllocations());
+
+    pool.deallocate(first, 24);
+    CHECK_EQUAL(1ul, pool.getInUse());
+    CHECK_EQUAL(first, pool.allocate(24));
+
+    // The next slab is taken when the free list runs out.
+    void *third = pool.allocate(24);
+    CHECK_EQUAL(2ul, pool.getHeapAllocations());
+
+    pool.deallocate(first, 24);
+    pool.deallocate(second, 16);
+    pool.deallocate(third, 24);
+    CHECK_EQUAL(0ul, pool.getInUse());
+
+    ostringstream out;
+    pool.format(out);
+    CHECK_EQUAL("pool test allocations=4 heap=2 in_use=0\n", out.str());
+}
+
+TEST(PoolPassesLargerBlocksToHeap)
+{
+    Pool pool("test", 24);
+    void *block = pool.allocate(100);
+    CHECK(block != NULL);
+    CHECK_EQUAL(0ul, pool.getAllocations());
+    CHECK_EQUAL(1ul, pool.getHeapAllocations());
+    CHECK_EQUAL(0ul, pool.getInUse());
+    pool.deallocate(block, 100);
+}
+
+TEST(PoolsAreListed)
+{
+    ostringstream before;
+    Pool::formatAll(before);
+
+    {
+        Pool pool("listed", 24);
+        ostringstream out;
+        Pool::formatAll(out);
+        CHECK(out.str().find("pool listed ") != string::npos);
+        CHECK(out.str().find("pool connections ") != string::npos);
+    }
+
+    ostringstream after;
+    Pool::formatAll(after);
+    CHECK_EQUAL(before.str(), after.str());
+}
+
+TEST(ConnectionsAreReused)
+{
+    Connection *first = new Connection();
+    delete first;
+    Connection *second = new Connection();
+    CHECK_EQUAL(first, second);
+    delete second;
+}
@@ -1,9 +1,53 @@
 #include "test.h" // Brings in the UnitTest++ framework
 #include "protocol.h"
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
 
 using namespace std;
 using namespace followermaze;
 
+// The original parser (a stringstream split into tokens and strtol) which
+// defines how events are parsed.
+static long referenceParseLong(const string &str)
+{
+    long res = strtol(str.c_str(), NULL, 10);
+    return (res == 0 || res == LONG_MAX || res == LONG_MIN) ? protocol::Parser::INVALID_LONG : res;
+}
+
+static void referenceParseEvent(protocol::Event &event)
+{
+    event.m_seqnum = protocol::Parser::INVALID_LONG;
+    event.m_type = protocol::Parser::TYPE_INVALID;
+    event.m_fromUserId = protocol::Parser::INVALID_LONG;
+    event.m_toUserId = protocol::Parser::INVALID_LONG;
+
+    stringstream ss(event.m_payload);
+    string token;
+    unsigned int tokenNum = 0;
+    while (getline(ss, token, protocol::Parser::DELIMITER) && tokenNum < 4)
+    {
+        switch (tokenNum++)
+        {
+        case 0:
+            event.m_seqnum = referenceParseLong(token);
+            break;
+        case 1:
+            event.m_type = token.empty() ? protocol::Parser::TYPE_INVALID : token[0];
+            break;
+        case 2:
+            event.m_fromUserId = referenceParseLong(token);
+            break;
+        case 3:
+            event.m_toUserId = referenceParseLong(token);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
 TEST(ParseMessage)
 {
     string message;
@@ -56,6 +100,25 @@ TEST(ParseMultiMessage)
     CHECK(!protocol::Parser::findMessage(in, start, message));
 }
 
+TEST(ParseMessageInPlace)
+{
+    const char in[] = "message1\r\nmessage2\nincomplete";
+    const char *message = NULL;
+    size_t length = 0;
+    size_t start = 0;
+
+    CHECK(protocol::Parser::findMessage(in, sizeof(in) - 1, start, message, length));
+    CHECK(message == in);
+    CHECK_EQUAL(8u, length);
+    CHECK_EQUAL(10u, start);
+    CHECK(protocol::Parser::findMessage(in, sizeof(in) - 1, start, message, length));
+    CHECK(message == in + 10);
+    CHECK_EQUAL(8u, length);
+    CHECK_EQUAL(19u, start);
+    CHECK(!protocol::Parser::findMessage(in, sizeof(in) - 1, start, message, length));
+    CHECK_EQUAL(19u, start);
+}
+
 TEST(ParseLong)
 {
     string message = "1234";
@@ -118,6 +181,27 @@ TEST(ParseEvent)
     CHECK_EQUAL(event.m_toUserId, protocol::Parser::INVALID_LONG);
 }
 
+TEST(ParseEventInPlace)
+{
+    // Tokens are not zero terminated.
+    const char in[] = "123456|F|789|12345\r\n9";
+    protocol::Event event;
+    protocol::Parser::parseEvent(event, in, 18);
+    CHECK(protocol::Parser::isValidEvent(event));
+    CHECK_EQUAL(event.m_seqnum, 123456);
+    CHECK_EQUAL(event.m_type, protocol::Parser::TYPE_FOLLOW);
+    CHECK_EQUAL(event.m_fromUserId, 789);
+    CHECK_EQUAL(event.m_toUserId, 12345);
+    CHECK(event.m_payload.empty());
+
+    protocol::Parser::parseEvent(event, in, 16);
+    CHECK_EQUAL(event.m_toUserId, 123);
+
+    CHECK_EQUAL(protocol::Parser::parseLong("12345", 2), 12l);
+    CHECK_EQUAL(protocol::Parser::parseUserId("42\n", 3), 42l);
+    CHECK_EQUAL(protocol::Parser::parseUserId("42", 2), protocol::Parser::INVALID_LONG);
+}
+
 TEST(ParseInvalidEvent)
 {
     protocol::Event event;
@@ -187,6 +271,131 @@ TEST(ParseInvalidEvent)
     CHECK(!protocol::Parser::isValidEvent(event));
 }
 
+TEST(ParseEventLikeReferenceParser)
+{
+    // Tokens around the edges of strtol: signs, spaces, leading zeros,
+    // trailing garbage, and the limits of long.
+    ostringstream limits;
+    limits << LONG_MAX << " " << LONG_MAX - 1 << " " << LONG_MIN << " " << LONG_MIN + 1;
+    istringstream limitsIn(limits.str());
+    vector< string > pieces;
+    string piece;
+    while (limitsIn >> piece)
+    {
+        pieces.push_back(piece);
+    }
+
+    const char *edges[] =
+    {
+        "", "0", "1", "-1", "+7", " 42", "\t-3x", "007", "12ab", "-", "+",
+        "F", "U", "B", "P", "S", "Sx", "99999999999999999999", "00000000000000000000001",
+        "18446744073709551615", "-9999999999999999999", "1\r", "|", "||"
+    };
+    pieces.insert(pieces.end(), edges, edges + sizeof(edges) / sizeof(edges[0]));
+
+    const char alphabet[] = "0123456789|+- \tBFPSUx";
+    srand(11);
+
+    for (int round = 0; round < 20000; ++round)
+    {
+        protocol::Event expected;
+        for (int tokens = rand() % 7; tokens > 0; --tokens)
+        {
+            if (rand() % 3 == 0)
+            {
+                for (int length = rand() % 8; length > 0; --length)
+                {
+                    expected.m_payload += alphabet[rand() % (sizeof(alphabet) - 1)];
+                }
+            }
+            else
+            {
+                expected.m_payload += pieces[rand() % pieces.size()];
+            }
+
+            if (rand() % 5 != 0)
+            {
+                expected.m_payload += protocol::Parser::DELIMITER;
+            }
+        }
+        referenceParseEvent(expected);
+
+        protocol::Event event;
+        event.m_payload = expected.m_payload;
+        protocol::Parser::parseEvent(event);
+
+        CHECK_EQUAL(expected.m_seqnum, event.m_seqnum);
+        CHECK_EQUAL(expected.m_type, event.m_type);
+        CHECK_EQUAL(expected.m_fromUserId, event.m_fromUserId);
+        CHECK_EQUAL(expected.m_toUserId, event.m_toUserId);
+        CHECK_EQUAL(protocol::Parser::isValidEvent(expected), protocol::Parser::isValidEvent(event));
+        if (expected.m_seqnum != event.m_seqnum || expected.m_type != event.m_type ||
+            expected.m_fromUserId != event.m_fromUserId || expected.m_toUserId != event.m_toUserId)
+        {
+            cerr << "Mismatch parsing \"" << expected.m_payload << "\"" << endl;
+            break;
+        }
+    }
+}
+
+TEST(ParseRecord)
+{
+    const char *payloads[] =
+    {
+        "1|B", "2|S|42", "3|F|1|2", "4|U|12345|678", "5|P|9223372036854775806|1", "-6|B"
+    };
+
+    // Records of the payloads and a record of an invalid event (an incomplete
+    // record is left at the end).
+    string records;
+    for (size_t i = 0; i < sizeof(payloads) / sizeof(payloads[0]); ++i)
+    {
+        protocol::Event event;
+        event.m_payload = payloads[i];
+        protocol::Parser::parseEvent(event);
+        protocol::Parser::encodeRecord(event, records);
+    }
+    protocol::Event invalid;
+    invalid.m_payload = "7|B|1";
+    protocol::Parser::parseEvent(invalid);
+    protocol::Parser::encodeRecord(invalid, records);
+    size_t complete = records.size();
+    records.append("\0\x1b\0", 3);
+
+    SpanList spans;
+    CHECK_EQUAL(complete, protocol::Parser::findRecords(records.data(), records.size(), spans));
+    CHECK_EQUAL(7u, spans.size());
+
+    for (size_t i = 0; i < spans.size() && i < sizeof(payloads) / sizeof(payloads[0]); ++i)
+    {
+        CHECK_EQUAL(protocol::Parser::RECORD_LENGTH, spans[i].m_length);
+
+        protocol::Event expected;
+        expected.m_payload = payloads[i];
+        protocol::Parser::parseEvent(expected);
+
+        protocol::Event event;
+        size_t length = protocol::Parser::parseRecord(event, records.data() + spans[i].m_offset, spans[i].m_length);
+        CHECK_EQUAL(strlen(payloads[i]), length);
+        CHECK_EQUAL(expected.m_seqnum, event.m_seqnum);
+        CHECK_EQUAL(expected.m_type, event.m_type);
+        CHECK_EQUAL(expected.m_fromUserId, event.m_fromUserId);
+        CHECK_EQUAL(expected.m_toUserId, event.m_toUserId);
+        CHECK(protocol::Parser::isValidEvent(event));
+
+        protocol::Parser::formatPayload(event, event.m_payload);
+        CHECK_EQUAL(payloads[i], event.m_payload);
+    }
+
+    protocol::Event event;
+    protocol::Parser::parseRecord(event, records.data() + spans[6].m_offset, spans[6].m_length);
+    CHECK(!protocol::Parser::isValidEvent(event));
+
+    // Too short for a record.
+    CHECK_EQUAL(0u, protocol::Parser::parseRecord(event, records.data() + spans[0].m_offset, 8));
+    CHECK(!protocol::Parser::isValidEvent(event));
+}
+
 TEST(EncodeMessage)
 {
     string message;
@@ -194,6 +403,13 @@ TEST(EncodeMessage)
     CHECK_EQUAL("message\n", message);
 }
 
+TEST(EncodeMessageInPlace)
+{
+    string message("message");
+    protocol::Parser::encodeMessage(message);
+    CHECK_EQUAL("message\n", message);
+}
+
 TEST(EventQueue)
 {
     protocol::EventQueue eventQueue;
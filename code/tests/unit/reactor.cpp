@@ -0,0 +1,563 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "reactor.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace followermaze;
+
+class TestHandler : public EventHandler
+{
+public:
+    int m_inputs;
+    int m_outputs;
+    int m_closes;
+    int m_errors;
+    int m_timeouts;
+
+public:
+    TestHandler(Handle handle, bool own = true) :
+        m_inputs(0),
+        m_outputs(0),
+        m_closes(0),
+        m_errors(0),
+        m_timeouts(0),
+        m_handle(handle),
+        m_own(own)
+    {
+    }
+
+    virtual ~TestHandler()
+    {
+        if (m_own)
+        {
+            close(m_handle);
+        }
+    }
+
+    virtual Handle getHandle()
+    {
+        return m_handle;
+    }
+
+    virtual void handleInput(int /*hint*/)
+    {
+        char buffer[64];
+        recv(m_handle, buffer, sizeof(buffer), 0);
+        m_inputs++;
+    }
+
+    virtual void handleOutput(int /*hint*/)
+    {
+        m_outputs++;
+    }
+
+    virtual void handleClose(int /*hint*/)
+    {
+        m_closes++;
+    }
+
+    virtual void handleError(int /*hint*/)
+    {
+        m_errors++;
+    }
+
+    virtual void handleTimeout(int /*hint*/)
+    {
+        m_timeouts++;
+    }
+
+protected:
+    Handle m_handle;
+    bool m_own;
+};
+
+struct SocketPair
+{
+    int m_fds[2];
+
+    SocketPair()
+    {
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, m_fds);
+    }
+};
+
+static void testDispatch(Reactor::Backend backend)
+{
+    Reactor reactor(backend);
+
+    // io_uring falls back to epoll on kernels which don't support it.
+    CHECK(backend == reactor.getBackend() ||
+          (backend == Reactor::BackendUring && reactor.getBackend() == Reactor::BackendEpoll));
+
+    SocketPair pair;
+    TestHandler *handler = new TestHandler(pair.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), Reactor::EvntRead);
+
+    CHECK(send(pair.m_fds[1], "bla", 3, 0) == 3);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, handler->m_inputs);
+    CHECK_EQUAL(0, handler->m_outputs);
+
+    reactor.resetHandler(0, Reactor::EvntWrite);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, handler->m_inputs);
+    CHECK_EQUAL(1, handler->m_outputs);
+
+    reactor.resetHandler(0, Reactor::EvntRead);
+    close(pair.m_fds[1]);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, handler->m_closes);
+    CHECK_EQUAL(0, handler->m_errors);
+
+    EventHandler *detouched = reactor.detouchHandler(0);
+    CHECK(detouched == handler);
+    delete detouched;
+}
+
+static void testDuplicate(Reactor::Backend backend)
+{
+    Reactor reactor(backend);
+
+    SocketPair pair;
+    reactor.addHandler(auto_ptr<EventHandler>(new TestHandler(pair.m_fds[0])), Reactor::EvntRead);
+    reactor.addHandler(auto_ptr<EventHandler>(new TestHandler(pair.m_fds[1])), Reactor::EvntRead);
+
+    // Register a handler for a handle which has been registered already.
+    auto_ptr<EventHandler> duplicate(new TestHandler(pair.m_fds[0], false));
+    CHECK_THROW(reactor.addHandler(duplicate, Reactor::EvntRead), Reactor::Exception);
+}
+
+static void testSlotReuse(Reactor::Backend backend)
+{
+    Reactor reactor(backend);
+
+    SocketPair pair0;
+    SocketPair pair1;
+    reactor.addHandler(auto_ptr<EventHandler>(new TestHandler(pair0.m_fds[0])), Reactor::EvntRead);
+    reactor.addHandler(auto_ptr<EventHandler>(new TestHandler(pair1.m_fds[0])), Reactor::EvntRead);
+    delete reactor.detouchHandler(0);
+    CHECK(reactor.detouchHandler(0) == NULL);
+
+    // Duplicates must be detected even if there is a free slot.
+    auto_ptr<EventHandler> duplicate(new TestHandler(pair1.m_fds[0], false));
+    CHECK_THROW(reactor.addHandler(duplicate, Reactor::EvntRead), Reactor::Exception);
+
+    // The freed slot is reused.
+    TestHandler *handler = new TestHandler(pair0.m_fds[1]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), Reactor::EvntRead);
+    CHECK(reactor.detouchHandler(0) == handler);
+    delete handler;
+
+    close(pair1.m_fds[1]);
+}
+
+TEST(ReactorPollDispatch)
+{
+    testDispatch(Reactor::BackendPoll);
+}
+
+TEST(ReactorEpollDispatch)
+{
+    testDispatch(Reactor::BackendEpoll);
+}
+
+TEST(ReactorUringDispatch)
+{
+    testDispatch(Reactor::BackendUring);
+}
+
+TEST(ReactorPollDuplicateFails)
+{
+    testDuplicate(Reactor::BackendPoll);
+}
+
+TEST(ReactorEpollDuplicateFails)
+{
+    testDuplicate(Reactor::BackendEpoll);
+}
+
+TEST(ReactorUringDuplicateFails)
+{
+    testDuplicate(Reactor::BackendUring);
+}
+
+static void testManyHandlers(Reactor::Backend backend)
+{
+    // More handlers than the previous hard-coded limit (1024).
+    static const int HANDLERS = 1100;
+
+    Connection::raiseHandleLimit();
+    Reactor reactor(backend);
+
+    vector< int > peers;
+    TestHandler *last = NULL;
+    for (int i = 0; i < HANDLERS; ++i)
+    {
+        SocketPair pair;
+        CHECK(pair.m_fds[0] >= 0);
+        last = new TestHandler(pair.m_fds[0]);
+        reactor.addHandler(auto_ptr<EventHandler>(last), Reactor::EvntRead);
+        peers.push_back(pair.m_fds[1]);
+    }
+
+    CHECK(send(peers.back(), "bla", 3, 0) == 3);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, last->m_inputs);
+
+    for (vector< int >::iterator it = peers.begin(); it != peers.end(); ++it)
+    {
+        close(*it);
+    }
+}
+
+TEST(ReactorPollSlotReuse)
+{
+    testSlotReuse(Reactor::BackendPoll);
+}
+
+TEST(ReactorEpollSlotReuse)
+{
+    testSlotReuse(Reactor::BackendEpoll);
+}
+
+TEST(ReactorUringSlotReuse)
+{
+    testSlotReuse(Reactor::BackendUring);
+}
+
+TEST(ReactorPollManyHandlers)
+{
+    testManyHandlers(Reactor::BackendPoll);
+}
+
+TEST(ReactorEpollManyHandlers)
+{
+    testManyHandlers(Reactor::BackendEpoll);
+}
+
+TEST(ReactorUringManyHandlers)
+{
+    testManyHandlers(Reactor::BackendUring);
+}
+
+class CountTask : public Task
+{
+public:
+    CountTask(int &count) : m_count(count)
+    {
+    }
+
+    virtual void run()
+    {
+        m_count++;
+    }
+
+protected:
+    int &m_count;
+};
+
+static void *postCountTask(void *arg)
+{
+    pair< Reactor*, int* > *args = static_cast< pair< Reactor*, int* >* >(arg);
+    args->first->post(auto_ptr<Task>(new CountTask(*args->second)));
+    return NULL;
+}
+
+TEST(ReactorRunsTaskPostedFromOtherThread)
+{
+    Reactor reactor;
+    CHECK(reactor.isInLoopThread());
+
+    int count = 0;
+    pair< Reactor*, int* > args(&reactor, &count);
+    pthread_t thread;
+    CHECK_EQUAL(0, pthread_create(&thread, NULL, postCountTask, &args));
+
+    // Blocks until woken up by the task.
+    reactor.handleEvents();
+    pthread_join(thread, NULL);
+    CHECK_EQUAL(1, count);
+}
+
+TEST(ReactorRunsTasksInOrder)
+{
+    Reactor reactor;
+    int count = 0;
+
+    reactor.post(auto_ptr<Task>(new CountTask(count)));
+    reactor.post(auto_ptr<Task>(new CountTask(count)));
+    reactor.handleEvents();
+    CHECK_EQUAL(2, count);
+
+    // Not run tasks are disposed of.
+    reactor.post(auto_ptr<Task>(new CountTask(count)));
+}
+
+TEST(ReactorNullHandlerFails)
+{
+    Reactor reactor;
+    CHECK_THROW(reactor.addHandler(auto_ptr<EventHandler>(), Reactor::EvntRead), Reactor::Exception);
+}
+
+TEST(ReactorHandlesTimeout)
+{
+    Reactor reactor;
+
+    SocketPair pair;
+    TestHandler *handler = new TestHandler(pair.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), Reactor::EvntRead);
+    reactor.scheduleTimeout(0, 1000);
+
+    // Rescheduled timeout wakes the reactor up (waiting may be interrupted
+    // by a signal before that).
+    reactor.scheduleTimeout(0, 20);
+    for (int i = 0; i < 10 && handler->m_timeouts == 0; ++i)
+    {
+        reactor.handleEvents();
+    }
+    CHECK_EQUAL(1, handler->m_timeouts);
+    CHECK_EQUAL(0, handler->m_inputs);
+
+    // Cancelled (or detouched) handlers don't time out.
+    SocketPair other;
+    TestHandler *detouched = new TestHandler(other.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(detouched), Reactor::EvntRead);
+    reactor.scheduleTimeout(0, 0);
+    reactor.scheduleTimeout(1, 0);
+    reactor.cancelTimeout(0);
+    delete reactor.detouchHandler(1);
+    CHECK(send(pair.m_fds[1], "bla", 3, 0) == 3);
+    for (int i = 0; i < 10 && handler->m_inputs == 0; ++i)
+    {
+        reactor.handleEvents();
+    }
+    CHECK_EQUAL(1, handler->m_timeouts);
+    CHECK_EQUAL(1, handler->m_inputs);
+
+    close(pair.m_fds[1]);
+    close(other.m_fds[1]);
+}
+
+TEST(ReactorResumesEdgeTriggeredHandler)
+{
+    Reactor reactor(Reactor::BackendEpoll);
+
+    SocketPair pair;
+    TestHandler *handler = new TestHandler(pair.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), Reactor::EvntRead | Reactor::EvntEdge);
+
+    // The handler receives 64 bytes per call back.
+    char data[100] = { 0 };
+    CHECK(send(pair.m_fds[1], data, sizeof(data), 0) == sizeof(data));
+    reactor.handleEvents();
+    CHECK_EQUAL(1, handler->m_inputs);
+
+    // Not reported again without new data unless resumed (the timeout stops
+    // waiting otherwise).
+    reactor.scheduleTimeout(0, 50);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, handler->m_inputs);
+
+    reactor.resumeHandler(0);
+    reactor.cancelTimeout(0);
+    reactor.handleEvents();
+    CHECK_EQUAL(2, handler->m_inputs);
+
+    close(pair.m_fds[1]);
+}
+
+// DisposingHandler disposes of itself when called back.
+class DisposingHandler : public TestHandler
+{
+public:
+    DisposingHandler(Handle handle, Reactor &reactor, int &outputs) :
+        TestHandler(handle),
+        m_reactor(reactor),
+        m_disposedOutputs(outputs)
+    {
+    }
+
+    virtual void handleInput(int hint)
+    {
+        delete m_reactor.detouchHandler(hint);
+    }
+
+    virtual void handleOutput(int /*hint*/)
+    {
+        m_disposedOutputs++;
+    }
+
+protected:
+    Reactor &m_reactor;
+    int &m_disposedOutputs;
+};
+
+static void testDispatchAllReadiness(Reactor::Backend backend)
+{
+    Reactor reactor(backend);
+
+    SocketPair pair;
+    TestHandler *handler = new TestHandler(pair.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), Reactor::EvntRead | Reactor::EvntWrite);
+
+    // Readable and writable socket is handled in one round.
+    CHECK(send(pair.m_fds[1], "bla", 3, 0) == 3);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, handler->m_inputs);
+    CHECK_EQUAL(1, handler->m_outputs);
+
+    // Data sent before hangup is handled before close in one round.
+    reactor.resetHandler(0, Reactor::EvntRead);
+    CHECK(send(pair.m_fds[1], "bla", 3, 0) == 3);
+    close(pair.m_fds[1]);
+    reactor.handleEvents();
+    CHECK_EQUAL(2, handler->m_inputs);
+    CHECK_EQUAL(1, handler->m_closes);
+
+    // Handler disposed of while handling input is not called back anymore.
+    SocketPair other;
+    int outputs = 0;
+    reactor.addHandler(auto_ptr<EventHandler>(new DisposingHandler(other.m_fds[0], reactor, outputs)),
+                       Reactor::EvntRead | Reactor::EvntWrite);
+    CHECK(send(other.m_fds[1], "bla", 3, 0) == 3);
+    reactor.handleEvents();
+    CHECK(reactor.detouchHandler(1) == NULL);
+    CHECK_EQUAL(0, outputs);
+
+    close(other.m_fds[1]);
+}
+
+TEST(ReactorPollDispatchesAllReadiness)
+{
+    testDispatchAllReadiness(Reactor::BackendPoll);
+}
+
+TEST(ReactorEpollDispatchesAllReadiness)
+{
+    testDispatchAllReadiness(Reactor::BackendEpoll);
+}
+
+TEST(ReactorUringDispatchesAllReadiness)
+{
+    testDispatchAllReadiness(Reactor::BackendUring);
+}
+
+// AsyncHandler records the sends and receives done by the backend.
+class AsyncHandler : public TestHandler
+{
+public:
+    int m_sent;
+    int m_received;
+    string m_data;
+
+public:
+    AsyncHandler(Handle handle) :
+        TestHandler(handle),
+        m_sent(0),
+        m_received(-1)
+    {
+    }
+
+    virtual void handleSent(int /*hint*/, int result)
+    {
+        m_sent = result;
+    }
+
+    virtual void handleReceived(int /*hint*/, const char *data, int result)
+    {
+        m_received = result;
+        if (result > 0)
+        {
+            m_data.assign(data, result);
+        }
+    }
+};
+
+TEST(ReactorUringSendsAndReceives)
+{
+    Reactor reactor(Reactor::BackendUring);
+    if (!reactor.canSend())
+    {
+        return; // Fell back to epoll.
+    }
+
+    SocketPair pair;
+    AsyncHandler *handler = new AsyncHandler(pair.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), 0);
+
+    // The send is done with the next wait.
+    char data[] = "bla";
+    struct iovec iov = { data, 3 };
+    struct msghdr message = msghdr();
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    reactor.send(0, &message);
+    reactor.handleEvents();
+    CHECK_EQUAL(3, handler->m_sent);
+    CHECK_EQUAL(0, handler->m_outputs);
+
+    char buffer[8];
+    CHECK(recv(pair.m_fds[1], buffer, sizeof(buffer), 0) == 3);
+
+    // Registering the buffers may be refused (locked memory limit).
+    if (!reactor.receive(0))
+    {
+        close(pair.m_fds[1]);
+        return;
+    }
+
+    CHECK(send(pair.m_fds[1], "foo", 3, 0) == 3);
+    reactor.handleEvents();
+    CHECK_EQUAL(3, handler->m_received);
+    CHECK_EQUAL("foo", handler->m_data);
+    CHECK_EQUAL(0, handler->m_inputs);
+
+    // The buffers are given back, so receiving goes on; 0 on hangup.
+    for (int i = 0; i < 16; ++i)
+    {
+        CHECK(reactor.receive(0));
+        CHECK(send(pair.m_fds[1], "x", 1, 0) == 1);
+        reactor.handleEvents();
+        CHECK_EQUAL(1, handler->m_received);
+    }
+
+    CHECK(reactor.receive(0));
+    close(pair.m_fds[1]);
+    reactor.handleEvents();
+    CHECK_EQUAL(0, handler->m_received);
+}
+
+TEST(ReactorUringCancelsReceiveOfDetouchedHandler)
+{
+    Reactor reactor(Reactor::BackendUring);
+
+    SocketPair pair;
+    AsyncHandler *handler = new AsyncHandler(pair.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(handler), 0);
+    if (!reactor.receive(0))
+    {
+        close(pair.m_fds[1]);
+        return;
+    }
+
+    // Detouching returns once the receive is cancelled, so the handler
+    // reusing the slot gets only its own events.
+    CHECK(reactor.detouchHandler(0) == handler);
+    delete handler;
+
+    SocketPair other;
+    AsyncHandler *reused = new AsyncHandler(other.m_fds[0]);
+    reactor.addHandler(auto_ptr<EventHandler>(reused), Reactor::EvntRead);
+    CHECK(send(other.m_fds[1], "bla", 3, 0) == 3);
+    reactor.handleEvents();
+    CHECK_EQUAL(1, reused->m_inputs);
+    CHECK_EQUAL(-1, reused->m_received);
+
+    close(pair.m_fds[1]);
+    close(other.m_fds[1]);
+}
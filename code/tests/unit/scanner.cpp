@@ -0,0 +1,207 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "scanner.h"
+#include "protocol.h"
+#include <string>
+#include <cstdlib>
+
+using namespace std;
+using namespace followermaze;
+
+// Finds the messages by calling findMessage until there are no more.
+static size_t findOneByOne(const string &data, SpanList &spans)
+{
+    size_t start = 0;
+    size_t consumed = 0;
+    const char *message = NULL;
+    size_t length = 0;
+    while (protocol::Parser::findMessage(data.data(), data.size(), start, message, length))
+    {
+        consumed = (start == string::npos) ? data.size() : start;
+        Span span;
+        span.m_offset = message - data.data();
+        span.m_length = length;
+        spans.push_back(span);
+    }
+
+    return consumed;
+}
+
+static const DelimiterScanner::Isa ISAS[] =
+{
+    DelimiterScanner::IsaScalar,
+    DelimiterScanner::IsaSse2,
+    DelimiterScanner::IsaAvx2
+};
+
+TEST(ScanMessages)
+{
+    DelimiterScanner scanner('\r', '\n');
+    const string data = "1|B\r\n2|S|1\n\n\r3|P|1|2\r\n4|F";
+    SpanList spans;
+
+    size_t consumed = scanner.scan(data.data(), data.size(), spans);
+    CHECK_EQUAL(22u, consumed);
+    CHECK_EQUAL(3u, spans.size());
+    CHECK_EQUAL(0u, spans[0].m_offset);
+    CHECK_EQUAL(3u, spans[0].m_length);
+    CHECK_EQUAL(5u, spans[1].m_offset);
+    CHECK_EQUAL(5u, spans[1].m_length);
+    CHECK_EQUAL(13u, spans[2].m_offset);
+    CHECK_EQUAL(7u, spans[2].m_length);
+
+    // Delimiters up to the end consume everything.
+    spans.clear();
+    consumed = scanner.scan(data.data(), 5, spans);
+    CHECK_EQUAL(5u, consumed);
+    CHECK_EQUAL(1u, spans.size());
+
+    // Leading delimiters yield an empty message.
+    spans.clear();
+    consumed = scanner.scan("\r\n", 2, spans);
+    CHECK_EQUAL(2u, consumed);
+    CHECK_EQUAL(1u, spans.size());
+    CHECK_EQUAL(0u, spans[0].m_length);
+
+    spans.clear();
+    consumed = scanner.scan("1|B", 3, spans);
+    CHECK_EQUAL(0u, consumed);
+    CHECK(spans.empty());
+}
+
+TEST(ScanMessagesLikeFindMessage)
+{
+    const char alphabet[] = "0123456789|BFPSU\r\n";
+    srand(7);
+
+    for (int round = 0; round < 500; ++round)
+    {
+        // Random lengths cover messages and runs of delimiters crossing
+        // blocks, and partial blocks at the end.
+        string data(rand() % 300, ' ');
+        int delimiters = 1 + rand() % 40;
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = rand() % delimiters == 0 ? alphabet[16 + rand() % 2] : alphabet[rand() % 16];
+        }
+
+        SpanList expected;
+        size_t expectedConsumed = findOneByOne(data, expected);
+
+        for (size_t i = 0; i < sizeof(ISAS) / sizeof(ISAS[0]); ++i)
+        {
+            if (!DelimiterScanner::isSupported(ISAS[i]))
+            {
+                continue;
+            }
+
+            DelimiterScanner scanner('\r', '\n', ISAS[i]);
+            CHECK_EQUAL(ISAS[i], scanner.getIsa());
+
+            SpanList spans;
+            size_t consumed = scanner.scan(data.data(), data.size(), spans);
+            CHECK_EQUAL(expectedConsumed, consumed);
+            CHECK_EQUAL(expected.size(), spans.size());
+            for (size_t j = 0; j < spans.size() && j < expected.size(); ++j)
+            {
+                CHECK_EQUAL(expected[j].m_offset, spans[j].m_offset);
+                CHECK_EQUAL(expected[j].m_length, spans[j].m_length);
+            }
+        }
+    }
+}
+
+TEST(FrameMessages)
+{
+    Framer framer('\r', '\n');
+    SpanList spans;
+
+    string data = "1|B\r";
+    CHECK_EQUAL(4u, framer.frame(data.data(), data.size(), spans));
+    CHECK_EQUAL(1u, spans.size());
+    CHECK_EQUAL(0u, framer.getScanned());
+
+    // The rest of the run of delimiters is not an empty message.
+    spans.clear();
+    data = "\n2|S|";
+    CHECK_EQUAL(1u, framer.frame(data.data(), data.size(), spans));
+    CHECK(spans.empty());
+    CHECK_EQUAL(4u, framer.getScanned());
+
+    // The incomplete message is resumed.
+    data = "2|S|1";
+    CHECK_EQUAL(0u, framer.frame(data.data(), data.size(), spans));
+    CHECK(spans.empty());
+    CHECK_EQUAL(5u, framer.getScanned());
+
+    data = "2|S|1\r\n3|B\r\n4";
+    size_t consumed = framer.frame(data.data(), data.size(), spans);
+    CHECK_EQUAL(12u, consumed);
+    CHECK_EQUAL(2u, spans.size());
+    CHECK_EQUAL(0u, spans[0].m_offset);
+    CHECK_EQUAL(5u, spans[0].m_length);
+    CHECK_EQUAL(7u, spans[1].m_offset);
+    CHECK_EQUAL(3u, spans[1].m_length);
+    CHECK_EQUAL(1u, framer.getScanned());
+
+    // A new stream starts after reset.
+    framer.reset();
+    spans.clear();
+    data = "\r\n";
+    CHECK_EQUAL(2u, framer.frame(data.data(), data.size(), spans));
+    CHECK_EQUAL(1u, spans.size());
+    CHECK_EQUAL(0u, spans[0].m_length);
+}
+
+TEST(FrameStreamLikeScan)
+{
+    const char alphabet[] = "0123456789|BFPSU\r\n";
+    srand(13);
+
+    for (int round = 0; round < 300; ++round)
+    {
+        string stream(rand() % 400, ' ');
+        int delimiters = 1 + rand() % 20;
+        for (size_t i = 0; i < stream.size(); ++i)
+        {
+            stream[i] = rand() % delimiters == 0 ? alphabet[16 + rand() % 2] : alphabet[rand() % 16];
+        }
+
+        // All at once.
+        DelimiterScanner scanner('\r', '\n');
+        SpanList spans;
+        size_t consumed = scanner.scan(stream.data(), stream.size(), spans);
+        vector< string > expected;
+        for (size_t i = 0; i < spans.size(); ++i)
+        {
+            expected.push_back(stream.substr(spans[i].m_offset, spans[i].m_length));
+        }
+
+        // In fragments of up to maxFragment bytes, keeping the unconsumed
+        // data like the receive buffer does.
+        Framer framer('\r', '\n');
+        size_t maxFragment = 1 + rand() % 70;
+        string pending;
+        vector< string > messages;
+        for (size_t offset = 0; offset < stream.size();)
+        {
+            size_t fragment = 1 + rand() % maxFragment;
+            pending.append(stream, offset, fragment);
+            offset += fragment;
+
+            spans.clear();
+            size_t framed = framer.frame(pending.data(), pending.size(), spans);
+            for (size_t i = 0; i < spans.size(); ++i)
+            {
+                messages.push_back(pending.substr(spans[i].m_offset, spans[i].m_length));
+            }
+            pending.erase(0, framed);
+        }
+
+        CHECK_EQUAL(stream.substr(consumed), pending);
+        CHECK_EQUAL(expected.size(), messages.size());
+        for (size_t i = 0; i < messages.size() && i < expected.size(); ++i)
+        {
+            CHECK_EQUAL(expected[i], messages[i]);
+        }
+    }
+}
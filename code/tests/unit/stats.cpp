@@ -0,0 +1,109 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "stats.h"
+#include "reactor.h"
+#include <sstream>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace followermaze;
+
+TEST(HistogramBuckets)
+{
+    CHECK_EQUAL(0, Histogram::bucketOf(0));
+    CHECK_EQUAL(1, Histogram::bucketOf(1));
+    CHECK_EQUAL(2, Histogram::bucketOf(2));
+    CHECK_EQUAL(2, Histogram::bucketOf(3));
+    CHECK_EQUAL(11, Histogram::bucketOf(1024));
+    CHECK_EQUAL(64, Histogram::bucketOf(~0UL));
+
+    Histogram histogram;
+    histogram.record(0);
+    histogram.record(3);
+    histogram.record(2);
+    histogram.record(1000);
+    CHECK_EQUAL(4u, histogram.getCount());
+    CHECK_EQUAL(1005u, histogram.getSum());
+    CHECK_EQUAL(1000u, histogram.getMax());
+    CHECK_EQUAL(2u, histogram.getBucket(2));
+
+    ostringstream out;
+    histogram.format(out);
+    CHECK_EQUAL("count=4 sum=1005 max=1000 [0]=1 [2]=2 [512]=1", out.str());
+}
+
+TEST(LoopStatsRecordsCallbacksByCategory)
+{
+    static const char *NAMES[LoopStats::MAX_CATEGORIES + 1] = {
+        "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o", "p", "q" };
+
+    LoopStats stats;
+    stats.recordIteration(10, 2, 1);
+    for (int i = 0; i <= LoopStats::MAX_CATEGORIES; ++i)
+    {
+        stats.recordCallback(NAMES[i], 1);
+    }
+    stats.recordCallback(NAMES[0], 1);
+
+    ostringstream out;
+    stats.format(out);
+    string text = out.str();
+    CHECK(text.find("blocked_us count=1 sum=10") != string::npos);
+    CHECK(text.find("callback_us a count=2") != string::npos);
+
+    // Categories which don't fit are recorded together.
+    CHECK(text.find("callback_us o count=1") != string::npos);
+    CHECK(text.find("callback_us p ") == string::npos);
+    CHECK(text.find("callback_us other count=2") != string::npos);
+}
+
+class ReadingHandler : public EventHandler
+{
+public:
+    ReadingHandler(Handle handle) : m_handle(handle)
+    {
+    }
+
+    virtual ~ReadingHandler()
+    {
+        close(m_handle);
+    }
+
+    virtual Handle getHandle()
+    {
+        return m_handle;
+    }
+
+    virtual const char *getCategory() const
+    {
+        return "Reading";
+    }
+
+    virtual void handleInput(int /*hint*/)
+    {
+        char buffer[64];
+        recv(m_handle, buffer, sizeof(buffer), 0);
+    }
+
+protected:
+    Handle m_handle;
+};
+
+TEST(ReactorKeepsStats)
+{
+    Reactor reactor;
+
+    int fds[2];
+    CHECK_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    reactor.addHandler(auto_ptr<EventHandler>(new ReadingHandler(fds[0])), Reactor::EvntRead);
+    CHECK(send(fds[1], "bla", 3, 0) == 3);
+    reactor.handleEvents();
+
+    ostringstream out;
+    reactor.getStats().format(out);
+    CHECK(out.str().find("blocked_us count=1") != string::npos);
+    CHECK(out.str().find("events count=1 sum=1") != string::npos);
+    CHECK(out.str().find("callback_us Reading count=1") != string::npos);
+
+    close(fds[1]);
+}
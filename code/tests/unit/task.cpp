@@ -0,0 +1,133 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "task.h"
+#include "reactor.h"
+#include <vector>
+#include <pthread.h>
+
+using namespace std;
+using namespace followermaze;
+
+class OrderTask : public Task
+{
+public:
+    OrderTask(int producer, int seqnum, vector< int > *last = NULL, int *disposed = NULL) :
+        m_producer(producer),
+        m_seqnum(seqnum),
+        m_last(last),
+        m_disposed(disposed)
+    {
+    }
+
+    virtual ~OrderTask()
+    {
+        if (m_disposed != NULL)
+        {
+            (*m_disposed)++;
+        }
+    }
+
+    virtual void run()
+    {
+        // Tasks of a producer must come in order.
+        CHECK_EQUAL((*m_last)[m_producer] + 1, m_seqnum);
+        (*m_last)[m_producer] = m_seqnum;
+    }
+
+public:
+    int m_producer;
+    int m_seqnum;
+
+protected:
+    vector< int > *m_last;
+    int *m_disposed;
+};
+
+TEST(TaskQueueIsFifo)
+{
+    TaskQueue queue;
+    CHECK(queue.pop() == NULL);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        queue.push(auto_ptr<Task>(new OrderTask(0, i)));
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        auto_ptr<Task> task(queue.pop());
+        CHECK(task.get() != NULL);
+        CHECK_EQUAL(i, static_cast<OrderTask*>(task.get())->m_seqnum);
+    }
+
+    CHECK(queue.pop() == NULL);
+
+    // Can be reused after it's been emptied.
+    queue.push(auto_ptr<Task>(new OrderTask(0, 3)));
+    delete queue.pop();
+    CHECK(queue.pop() == NULL);
+}
+
+TEST(TaskQueueDisposesOfTasks)
+{
+    int disposed = 0;
+    {
+        TaskQueue queue;
+        queue.push(auto_ptr<Task>(new OrderTask(0, 0, NULL, &disposed)));
+        queue.push(auto_ptr<Task>(new OrderTask(0, 1, NULL, &disposed)));
+    }
+    CHECK_EQUAL(2, disposed);
+}
+
+static const int PRODUCERS = 4;
+static const int TASKS_PER_PRODUCER = 20000;
+
+struct Producer
+{
+    Reactor *m_reactor;
+    vector< int > *m_last;
+    int m_id;
+};
+
+static void *produce(void *arg)
+{
+    Producer *producer = static_cast<Producer*>(arg);
+    for (int i = 0; i < TASKS_PER_PRODUCER; ++i)
+    {
+        producer->m_reactor->post(auto_ptr<Task>(new OrderTask(producer->m_id, i, producer->m_last)));
+    }
+    return NULL;
+}
+
+TEST(ReactorRunsTasksFromManyThreads)
+{
+    Reactor reactor;
+    vector< int > last(PRODUCERS, -1);
+
+    Producer producers[PRODUCERS];
+    pthread_t threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; ++i)
+    {
+        producers[i].m_reactor = &reactor;
+        producers[i].m_last = &last;
+        producers[i].m_id = i;
+        CHECK_EQUAL(0, pthread_create(&threads[i], NULL, produce, &producers[i]));
+    }
+
+    // Each producer's last task must be run eventually.
+    bool done = false;
+    while (!done)
+    {
+        reactor.handleEvents();
+
+        done = true;
+        for (int i = 0; i < PRODUCERS; ++i)
+        {
+            done = done && last[i] == TASKS_PER_PRODUCER - 1;
+        }
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
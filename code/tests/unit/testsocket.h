@@ -0,0 +1,25 @@
+/* This file provides the socket helpers shared by the unit tests.
+ */
+#ifndef TESTSOCKET_H
+#define TESTSOCKET_H
+
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Connects a blocking socket to port on the loopback interface. Returns the
+// socket.
+inline int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+    return fd;
+}
+
+#endif // TESTSOCKET_H
@@ -0,0 +1,142 @@
+#include "test.h" // Brings in the UnitTest++ framework
+#include "timerwheel.h"
+#include <time.h>
+
+using namespace std;
+using namespace followermaze;
+
+TEST(TimerWheelExpiresInOrder)
+{
+    TimerWheel wheel(1000);
+    wheel.schedule(0, 1300);
+    wheel.schedule(1, 1010);
+    wheel.schedule(2, 1100);
+    CHECK_EQUAL(3u, wheel.size());
+    CHECK_EQUAL(10, wheel.nextTimeout(1000));
+
+    TimerWheel::IdList expired;
+    wheel.expire(1009, expired);
+    CHECK(expired.empty());
+
+    wheel.expire(2000, expired);
+    CHECK_EQUAL(3u, expired.size());
+    CHECK_EQUAL(1, expired[0]);
+    CHECK_EQUAL(2, expired[1]);
+    CHECK_EQUAL(0, expired[2]);
+    CHECK_EQUAL(0u, wheel.size());
+    CHECK_EQUAL(-1, wheel.nextTimeout(2000));
+}
+
+TEST(TimerWheelCancelAndReschedule)
+{
+    TimerWheel wheel;
+    wheel.schedule(5, 10);
+    wheel.schedule(6, 10);
+    wheel.cancel(5);
+    wheel.cancel(7); // Not scheduled.
+    CHECK(!wheel.isScheduled(5));
+    CHECK(wheel.isScheduled(6));
+
+    // Rescheduling replaces the previous timeout.
+    wheel.schedule(6, 20);
+    CHECK_EQUAL(1u, wheel.size());
+
+    TimerWheel::IdList expired;
+    wheel.expire(15, expired);
+    CHECK(expired.empty());
+    wheel.expire(20, expired);
+    CHECK_EQUAL(1u, expired.size());
+    CHECK_EQUAL(6, expired[0]);
+}
+
+TEST(TimerWheelOverdueExpiresNext)
+{
+    TimerWheel wheel(100);
+    wheel.schedule(0, 50);
+    CHECK_EQUAL(0, wheel.nextTimeout(100));
+
+    TimerWheel::IdList expired;
+    wheel.expire(100, expired);
+    CHECK_EQUAL(1u, expired.size());
+}
+
+TEST(TimerWheelCascades)
+{
+    // Timers in every level including beyond the range of the wheel.
+    static const TimerWheel::Tick EXPIRES[] = { 300, 20000, 1500000, 70000000, 200000000 };
+    static const int COUNT = sizeof(EXPIRES) / sizeof(EXPIRES[0]);
+
+    TimerWheel wheel(7);
+    for (int i = 0; i < COUNT; ++i)
+    {
+        wheel.schedule(i, EXPIRES[i]);
+    }
+
+    // Wait as advised and check that nothing expires early or late.
+    TimerWheel::Tick now = 7;
+    TimerWheel::IdList expired;
+    while (wheel.size() > 0)
+    {
+        long timeout = wheel.nextTimeout(now);
+        CHECK(timeout >= 0 && timeout <= 256);
+        now += timeout;
+
+        size_t before = expired.size();
+        wheel.expire(now, expired);
+        if (expired.size() > before)
+        {
+            CHECK_EQUAL(1u, expired.size() - before);
+            CHECK_EQUAL(EXPIRES[expired.back()], now);
+        }
+
+        now++;
+    }
+
+    CHECK_EQUAL(static_cast<size_t>(COUNT), expired.size());
+}
+
+TEST(TimerWheelInvalidIdFails)
+{
+    TimerWheel wheel;
+    CHECK_THROW(wheel.schedule(-1, 0), TimerWheel::Exception);
+}
+
+TEST(TimerWheelAdvancesAfterIdling)
+{
+    TimerWheel wheel(1000);
+
+    // A day without timers.
+    TimerWheel::Tick now = 1000 + 24 * 3600 * 1000ul;
+    wheel.advance(now);
+    wheel.schedule(0, now + 10000);
+
+    // Waits are not cut short by the idle ticks.
+    long timeout = wheel.nextTimeout(now);
+    CHECK(timeout > 0);
+
+    // The idle ticks are not walked, only the ones up to the timer.
+    TimerWheel::IdList expired;
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int waits = 0;
+    while (expired.empty())
+    {
+        now += timeout;
+        wheel.expire(now, expired);
+        timeout = wheel.nextTimeout(now);
+        ++waits;
+    }
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    CHECK_EQUAL(1000 + 24 * 3600 * 1000ul + 10000, now);
+    CHECK(waits <= 10000 / 256 + 1);
+    long elapsed = (finished.tv_sec - started.tv_sec) * 1000 + (finished.tv_nsec - started.tv_nsec) / 1000000;
+    CHECK(elapsed < 50);
+
+    // Advancing doesn't move a wheel with timers.
+    wheel.schedule(1, now + 10);
+    wheel.advance(now + 1000);
+    wheel.expire(now + 1000, expired);
+    CHECK_EQUAL(2u, expired.size());
+}